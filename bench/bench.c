@@ -0,0 +1,710 @@
+#define _GNU_SOURCE
+
+#include <argp.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+/*
+ * A benchmark harness for tcpp. It generates a synthetic corpus of scenarios, each stressing one part of the
+ * preprocessor, runs tcpp over every scenario repeatedly and reports the results as JSON, so that they can be compared
+ * between builds.
+ *
+ * The sizes of the scenarios grow linearly with the scale. The bytes and tokens of a scenario are counted while it is
+ * generated, over all of its files (each header is read once thanks to its include guard). The phase timings and
+ * counters tcpp records with '--stats' during the warm-up run are included as well, so that the timed runs are
+ * not affected by recording them.
+ */
+
+const char *argp_program_version =
+        "tcpp-bench 0.1";
+const char *argp_program_bug_address =
+        "<mrtomaszal@gmail.com>";
+
+/**
+ * Program documentation.
+ *
+ * Passed into the DOC field of the ARGP structure.
+ */
+static char doc[] =
+        "Benchmarks the tcpp executable <tcpp> on a generated corpus and prints the results as JSON.";
+
+/**
+ * A description of the accepted non-option arguments.
+ *
+ * Passed into the ARGS_DOC field of the ARGP structure.
+ */
+static char args_doc[] = "<tcpp>";
+
+/**
+ * Stores the configuration of a benchmark run.
+ *
+ * CORPUS is the directory in which the scenarios are generated, OUTPUT the file to which to write the JSON (NULL for
+ * stdout). Every scenario is run RUNS times after one warm-up run, ONLY is the name of the single scenario to run
+ * (NULL for all of them).
+ */
+typedef struct Bench {
+    char *tcpp;
+    char *corpus;
+    char *output;
+    char *only;
+
+    int scale;
+    int runs;
+} Bench;
+
+/**
+ * Stores a generated scenario and its measurements.
+ */
+typedef struct Scenario {
+    const char *name;
+    void (*generate)(struct Scenario *scenario, int scale);
+
+    char directory[0x1000];
+
+    long files;
+    long bytes;
+    long tokens;
+
+    double wall_min;
+    double wall_median;
+    double cpu_median;
+    long peak_rss;
+    long minor_faults;
+
+    char *stats;
+} Scenario;
+
+/**
+ * Punctuators of more than one character, the longest first, so that tokens are counted the way tcpp splits them.
+ */
+static const char *punctuators[] = {
+        "...", "<<=", ">>=", "##", "->", "++", "--", "<<", ">>", "<=", ">=", "==", "!=", "&&", "||", "*=", "/=",
+        "%=", "+=", "-=", "&=", "^=", "|=", NULL
+};
+
+/**
+ * Counts the tokens in a chunk of generated code. Every comment counts as one token. The chunk has to end at a line
+ * boundary and must not end inside a comment or a literal.
+ *
+ * @param code The code in which to count the tokens.
+ * @param length The length of the code.
+ * @return The number of tokens.
+ */
+static long count_tokens(const char *code, size_t length) {
+    const char *cursor = code, *end = code + length;
+    long count = 0;
+
+    while (cursor < end) {
+        if (isspace((unsigned char) *cursor)) {
+            cursor++;
+            continue;
+        }
+
+        count++;
+
+        if (cursor + 1 < end && cursor[0] == '/' && cursor[1] == '*') {
+            const char *close = strstr(cursor + 2, "*/");
+            cursor = close ? close + 2 : end;
+        } else if (cursor + 1 < end && cursor[0] == '/' && cursor[1] == '/') {
+            while (cursor < end && *cursor != '\n') {
+                cursor++;
+            }
+        } else if (*cursor == '"' || *cursor == '\'') {
+            char quote = *cursor++;
+
+            while (cursor < end && *cursor != quote) {
+                cursor += *cursor == '\\' ? 2 : 1;
+            }
+
+            cursor++;
+        } else if (isalnum((unsigned char) *cursor) || *cursor == '_') {
+            while (cursor < end && (isalnum((unsigned char) *cursor) || *cursor == '_' || *cursor == '.')) {
+                cursor++;
+            }
+        } else {
+            size_t width = 1;
+
+            for (int i = 0; punctuators[i]; i++) {
+                size_t punctuator_length = strlen(punctuators[i]);
+
+                if ((size_t) (end - cursor) >= punctuator_length &&
+                    strncmp(cursor, punctuators[i], punctuator_length) == 0) {
+                    width = punctuator_length;
+                    break;
+                }
+            }
+
+            cursor += width;
+        }
+    }
+
+    return count;
+}
+
+/**
+ * Creates a file of a scenario.
+ *
+ * @param scenario The scenario to which the file belongs.
+ * @param format The format of the file's name, relative to the scenario's directory.
+ * @return The opened file.
+ */
+static FILE *create_file(Scenario *scenario, const char *format, ...) {
+    char name[0x100], path[0x1200];
+    va_list list;
+
+    va_start(list, format);
+    vsnprintf(name, sizeof name, format, list);
+    va_end(list);
+
+    snprintf(path, sizeof path, "%s/%s", scenario->directory, name);
+    FILE *file = fopen(path, "w");
+
+    if (!file) {
+        fprintf(stderr, "Could not open or create file %s.\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    scenario->files++;
+
+    return file;
+}
+
+/**
+ * Writes a chunk of code into a file of a scenario, counting its bytes and tokens. Chunks have to end at line
+ * boundaries (see count_tokens).
+ *
+ * @param scenario The scenario to which the file belongs.
+ * @param file The file to write to.
+ * @param format The format of the code.
+ */
+static void emit(Scenario *scenario, FILE *file, const char *format, ...) {
+    static char *buffer;
+    static size_t capacity;
+    va_list list;
+
+    va_start(list, format);
+    int length = vsnprintf(buffer, capacity, format, list);
+    va_end(list);
+
+    if ((size_t) length >= capacity) {
+        capacity = (size_t) length + 1 > 2 * capacity ? (size_t) length + 1 : 2 * capacity;
+        buffer = realloc(buffer, capacity);
+
+        if (!buffer) {
+            fprintf(stderr, "Could not allocate enough memory.");
+            exit(EXIT_FAILURE);
+        }
+
+        va_start(list, format);
+        vsnprintf(buffer, capacity, format, list);
+        va_end(list);
+    }
+
+    fwrite(buffer, 1, (size_t) length, file);
+
+    scenario->bytes += length;
+    scenario->tokens += count_tokens(buffer, (size_t) length);
+}
+
+/**
+ * Closes a file of a scenario, exiting if it could not be written.
+ *
+ * @param file The file to close.
+ */
+static void close_file(FILE *file) {
+    if (ferror(file) | fclose(file)) {
+        fprintf(stderr, "Could not write the corpus.\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * Generates a chain of headers, each including the next one. The chain is nearly as deep as tcpp allows.
+ *
+ * @param scenario The scenario to generate.
+ * @param scale The scale of the scenario.
+ */
+static void generate_include_chain(Scenario *scenario, int scale) {
+    const int depth = 150;
+
+    FILE *source = create_file(scenario, "main.c");
+    emit(scenario, source, "#include \"chain0.h\"\n#include \"chain0.h\"\n\n");
+    emit(scenario, source, "int main(void) {\n    return chain0_0(1, 2);\n}\n");
+    close_file(source);
+
+    for (int i = 0; i < depth; i++) {
+        FILE *header = create_file(scenario, "chain%d.h", i);
+        emit(scenario, header, "#ifndef CHAIN%d_H\n#define CHAIN%d_H\n\n", i, i);
+
+        if (i + 1 < depth) {
+            emit(scenario, header, "#include \"chain%d.h\"\n\n", i + 1);
+        }
+
+        for (int j = 0; j < 20 * scale; j++) {
+            emit(scenario, header, "int chain%d_%d(int a, int b);\n", i, j);
+        }
+
+        emit(scenario, header, "\n#endif\n");
+        close_file(header);
+    }
+}
+
+/**
+ * Generates a file including many small headers, each of them twice.
+ *
+ * @param scenario The scenario to generate.
+ * @param scale The scale of the scenario.
+ */
+static void generate_include_fanout(Scenario *scenario, int scale) {
+    const int width = 500 * scale;
+
+    FILE *source = create_file(scenario, "main.c");
+
+    for (int repeat = 0; repeat < 2; repeat++) {
+        for (int i = 0; i < width; i++) {
+            emit(scenario, source, "#include \"fan%d.h\"\n", i);
+        }
+    }
+
+    emit(scenario, source, "\nint main(void) {\n    return FAN0_VALUE;\n}\n");
+    close_file(source);
+
+    for (int i = 0; i < width; i++) {
+        FILE *header = create_file(scenario, "fan%d.h", i);
+        emit(scenario, header, "#ifndef FAN%d_H\n#define FAN%d_H\n\n#define FAN%d_VALUE %d\n\n", i, i, i, i);
+
+        for (int j = 0; j < 10; j++) {
+            emit(scenario, header, "struct fan%d_%d { int value; char *name; };\n", i, j);
+        }
+
+        emit(scenario, header, "\n#endif\n");
+        close_file(header);
+    }
+}
+
+/**
+ * Generates a file defining thousands of macros and expanding them.
+ *
+ * @param scenario The scenario to generate.
+ * @param scale The scale of the scenario.
+ */
+static void generate_defines(Scenario *scenario, int scale) {
+    const int count = 5000 * scale;
+
+    FILE *source = create_file(scenario, "main.c");
+
+    for (int i = 0; i < 100; i++) {
+        emit(scenario, source, "#define OFFSET_%d %d\n", i, i * 7);
+    }
+
+    for (int i = 0; i < count; i++) {
+        emit(scenario, source, "#define SCALE_%d(x) ((x) * %d + OFFSET_%d)\n", i, i, i % 100);
+        emit(scenario, source, "#define VALUE_%d SCALE_%d(SCALE_%d(%d))\n", i, i / 2, i / 3, i);
+    }
+
+    for (int i = 0; i < count; i++) {
+        emit(scenario, source, "int value_%d = VALUE_%d + SCALE_%d(OFFSET_%d);\n", i, i, i, i % 100);
+
+        if (i % 10 == 0) {
+            emit(scenario, source, "#undef VALUE_%d\n#ifdef VALUE_%d\n#error VALUE_%d\n#endif\n", i, i, i);
+        }
+    }
+
+    close_file(source);
+}
+
+/**
+ * Generates a file with very long lines.
+ *
+ * @param scenario The scenario to generate.
+ * @param scale The scale of the scenario.
+ */
+static void generate_long_lines(Scenario *scenario, int scale) {
+    const int lines = 100 * scale, elements = 10000;
+
+    FILE *source = create_file(scenario, "main.c");
+    emit(scenario, source, "#define ELEMENT(x) (x)\n\n");
+
+    for (int i = 0; i < lines; i++) {
+        emit(scenario, source, "int long%d[] = {", i);
+
+        for (int j = 0; j < elements; j++) {
+            emit(scenario, source, j % 10 ? "%d, " : "ELEMENT(%d), ", j);
+        }
+
+        emit(scenario, source, "0};\n");
+    }
+
+    close_file(source);
+}
+
+/**
+ * Generates a file consisting mostly of comments.
+ *
+ * @param scenario The scenario to generate.
+ * @param scale The scale of the scenario.
+ */
+static void generate_comments(Scenario *scenario, int scale) {
+    const int functions = 2000 * scale;
+
+    FILE *source = create_file(scenario, "main.c");
+
+    for (int i = 0; i < functions; i++) {
+        emit(scenario, source, "/**\n"
+                             " * Computes the value number %d, which is not used by anything at all. The comment is\n"
+                             " * long enough to take up most of the file, like the documentation of a library does.\n"
+                             " *\n"
+                             " * @param a The first operand. // Not a line comment.\n"
+                             " * @param b The second operand. /* Not a nested comment.\n"
+                             " * @return The value.\n"
+                             " */\n", i);
+        emit(scenario, source, "int comment%d(int a, int b) { // Line comment after code\n"
+                             "    return a /* inline */ + b; // %d\n"
+                             "}\n\n", i, i);
+    }
+
+    close_file(source);
+}
+
+/**
+ * All the scenarios, in the order they are run.
+ */
+static Scenario scenarios[] = {
+        {"include_chain",  generate_include_chain},
+        {"include_fanout", generate_include_fanout},
+        {"defines",        generate_defines},
+        {"long_lines",     generate_long_lines},
+        {"comments",       generate_comments},
+};
+
+/**
+ * Creates a directory if it does not exist yet.
+ *
+ * @param path The location of the directory.
+ */
+static void make_directory(const char *path) {
+    if (mkdir(path, 0777) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Could not create directory %s.\n", path);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * Runs tcpp over a scenario once.
+ *
+ * @param bench The configuration of the benchmark.
+ * @param scenario The scenario to preprocess.
+ * @param stats The location of the file into which tcpp writes its statistics, NULL to not collect them.
+ * @param wall A pointer into which to store the elapsed time in seconds.
+ * @param usage A pointer into which to store the resource usage of the run.
+ */
+static void run_once(const Bench *bench, const Scenario *scenario, const char *stats, double *wall,
+                     struct rusage *usage) {
+    char input[0x1100], stats_option[0x1100];
+    snprintf(input, sizeof input, "%s/main.c", scenario->directory);
+    snprintf(stats_option, sizeof stats_option, "--stats=%s", stats ? stats : "");
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    pid_t pid = fork();
+
+    if (pid == 0) {
+        execl(bench->tcpp, bench->tcpp, "-q", "-i", input, "-o", "/dev/null", stats ? stats_option : (char *) NULL,
+              (char *) NULL);
+        _exit(127);
+    }
+
+    int status;
+
+    if (pid < 0 || wait4(pid, &status, 0, usage) != pid) {
+        fprintf(stderr, "Could not run %s.\n", bench->tcpp);
+        exit(EXIT_FAILURE);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+        fprintf(stderr, "%s failed on scenario %s.\n", bench->tcpp, scenario->name);
+        exit(EXIT_FAILURE);
+    }
+
+    *wall = (double) (end.tv_sec - start.tv_sec) + (double) (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+/**
+ * Reads the statistics written by tcpp, indented to be nested into the results.
+ *
+ * @param file_name The location of the statistics file.
+ * @return A newly allocated string, NULL if the file could not be read.
+ */
+static char *read_stats(const char *file_name) {
+    FILE *file = fopen(file_name, "r");
+
+    if (!file) {
+        return NULL;
+    }
+
+    char content[0x4000];
+    size_t length = fread(content, 1, sizeof content - 1, file);
+    fclose(file);
+
+    // Drop the final line break, and nest every other line two levels deeper
+    while (length && content[length - 1] == '\n') {
+        length--;
+    }
+
+    char *stats = malloc(7 * length + 1), *end = stats;
+
+    if (!stats) {
+        fprintf(stderr, "Could not allocate enough memory.");
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t i = 0; i < length; i++) {
+        *end++ = content[i];
+
+        if (content[i] == '\n') {
+            end += sprintf(end, "      ");
+        }
+    }
+
+    *end = '\0';
+
+    return stats;
+}
+
+/**
+ * Compares two doubles, for sorting them with QSORT.
+ */
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+
+    return (x > y) - (x < y);
+}
+
+/**
+ * Runs tcpp over a scenario repeatedly and records the measurements in it.
+ *
+ * @param bench The configuration of the benchmark.
+ * @param scenario The scenario to preprocess.
+ */
+static void run_scenario(const Bench *bench, Scenario *scenario) {
+    double *walls = malloc((size_t) bench->runs * sizeof *walls);
+    double *cpus = malloc((size_t) bench->runs * sizeof *cpus);
+
+    if (!walls || !cpus) {
+        fprintf(stderr, "Could not allocate enough memory.");
+        exit(EXIT_FAILURE);
+    }
+
+    struct rusage usage;
+    char stats[0x1100];
+    snprintf(stats, sizeof stats, "%s/stats.json", scenario->directory);
+
+    // The warm-up run brings the corpus into the page cache
+    run_once(bench, scenario, stats, &walls[0], &usage);
+    scenario->stats = read_stats(stats);
+
+    for (int i = 0; i < bench->runs; i++) {
+        run_once(bench, scenario, NULL, &walls[i], &usage);
+
+        cpus[i] = (double) (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+                  (double) (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+
+        if (usage.ru_maxrss > scenario->peak_rss) {
+            scenario->peak_rss = usage.ru_maxrss;
+        }
+
+        scenario->minor_faults += usage.ru_minflt;
+    }
+
+    qsort(walls, (size_t) bench->runs, sizeof *walls, compare_doubles);
+    qsort(cpus, (size_t) bench->runs, sizeof *cpus, compare_doubles);
+
+    scenario->wall_min = walls[0];
+    scenario->wall_median = walls[bench->runs / 2];
+    scenario->cpu_median = cpus[bench->runs / 2];
+    scenario->minor_faults /= bench->runs;
+
+    free(walls);
+    free(cpus);
+}
+
+/**
+ * Writes the measurements of the run scenarios as JSON.
+ *
+ * @param bench The configuration of the benchmark.
+ * @param file The file to write to.
+ */
+static void write_results(const Bench *bench, FILE *file) {
+    fprintf(file, "{\n  \"tcpp\": \"%s\",\n  \"scale\": %d,\n  \"runs\": %d,\n  \"scenarios\": [", bench->tcpp,
+            bench->scale, bench->runs);
+
+    const char *separator = "\n";
+
+    for (size_t i = 0; i < sizeof scenarios / sizeof *scenarios; i++) {
+        const Scenario *scenario = &scenarios[i];
+
+        if (!scenario->files) {
+            continue;
+        }
+
+        double seconds = scenario->wall_median > 0 ? scenario->wall_median : 1e-9;
+
+        fprintf(file, "%s    {\n", separator);
+        fprintf(file, "      \"name\": \"%s\",\n", scenario->name);
+        fprintf(file, "      \"files\": %ld,\n", scenario->files);
+        fprintf(file, "      \"bytes\": %ld,\n", scenario->bytes);
+        fprintf(file, "      \"tokens\": %ld,\n", scenario->tokens);
+        fprintf(file, "      \"wall_seconds_min\": %.6f,\n", scenario->wall_min);
+        fprintf(file, "      \"wall_seconds_median\": %.6f,\n", scenario->wall_median);
+        fprintf(file, "      \"cpu_seconds_median\": %.6f,\n", scenario->cpu_median);
+        fprintf(file, "      \"mb_per_second\": %.3f,\n", (double) scenario->bytes / 1e6 / seconds);
+        fprintf(file, "      \"tokens_per_second\": %.0f,\n", (double) scenario->tokens / seconds);
+        fprintf(file, "      \"peak_rss_kb\": %ld,\n", scenario->peak_rss);
+        fprintf(file, "      \"minor_faults\": %ld", scenario->minor_faults);
+
+        if (scenario->stats) {
+            fprintf(file, ",\n      \"stats\": %s", scenario->stats);
+        }
+
+        fprintf(file, "\n");
+        fprintf(file, "    }");
+
+        separator = ",\n";
+    }
+
+    fprintf(file, "\n  ]\n}\n");
+}
+
+/**
+ * An array of accepted ARGP_OPTION's.
+ *
+ * Passed into the OPTIONS field of the ARGP structure.
+ */
+static struct argp_option options[] = {
+        {"corpus",   'd', "<dir>",  0, "Generate the corpus into <dir> (\"bench_corpus\" by default)"},
+        {"output",   'o', "<file>", 0, "Write the JSON into <file> instead of stdout"},
+        {"scale",    'n', "<n>",    0, "Multiply the sizes of the scenarios by <n>"},
+        {"runs",     'r', "<n>",    0, "Run tcpp <n> times on every scenario (5 by default)"},
+        {"scenario", 'x', "<name>", 0, "Only run the scenario <name>"},
+        {0}
+};
+
+/**
+ * Parses an ARGP_OPTION.
+ *
+ * Passed into the PARSER field of the ARGP structure.
+ *
+ * @param key A key associated with an option.
+ * @param arg An argument associated with the key.
+ * @param state The current state of argument parsing.
+ * @return 0 if successful, error code otherwise.
+ */
+static error_t parse_opt(int key, char *arg, struct argp_state *state) {
+    Bench *bench = state->input;
+
+    switch (key) {
+        case 'd':
+            bench->corpus = arg;
+            break;
+        case 'o':
+            bench->output = arg;
+            break;
+        case 'n':
+            if ((bench->scale = atoi(arg)) < 1) {
+                argp_error(state, "The scale has to be a positive number.");
+            }
+            break;
+        case 'r':
+            if ((bench->runs = atoi(arg)) < 1) {
+                argp_error(state, "The number of runs has to be a positive number.");
+            }
+            break;
+        case 'x':
+            bench->only = arg;
+            break;
+
+        case ARGP_KEY_ARG:
+            if (bench->tcpp) {
+                argp_usage(state);
+            }
+
+            bench->tcpp = arg;
+            break;
+        case ARGP_KEY_END:
+            if (!bench->tcpp) {
+                argp_usage(state);
+            }
+            break;
+
+        default:
+            return ARGP_ERR_UNKNOWN;
+    }
+
+    return 0;
+}
+
+/**
+ * The ARGP structure itself.
+ */
+static struct argp argp = {options, parse_opt, args_doc, doc};
+
+int main(int argc, char **argv) {
+    Bench bench = {NULL, "bench_corpus", NULL, NULL, 1, 5};
+    argp_parse(&argp, argc, argv, 0, 0, &bench);
+
+    make_directory(bench.corpus);
+
+    int found = 0;
+
+    for (size_t i = 0; i < sizeof scenarios / sizeof *scenarios; i++) {
+        Scenario *scenario = &scenarios[i];
+
+        if (bench.only && strcmp(bench.only, scenario->name) != 0) {
+            continue;
+        }
+
+        found = 1;
+
+        snprintf(scenario->directory, sizeof scenario->directory, "%s/%s", bench.corpus, scenario->name);
+        make_directory(scenario->directory);
+
+        fprintf(stderr, "Generating scenario %s.\n", scenario->name);
+        scenario->generate(scenario, bench.scale);
+
+        fprintf(stderr, "Running scenario %s.\n", scenario->name);
+        run_scenario(&bench, scenario);
+    }
+
+    if (!found) {
+        fprintf(stderr, "Unknown scenario %s.\n", bench.only);
+        return EXIT_FAILURE;
+    }
+
+    FILE *file = bench.output ? fopen(bench.output, "w") : stdout;
+
+    if (!file) {
+        fprintf(stderr, "Could not open or create file %s.\n", bench.output);
+        return EXIT_FAILURE;
+    }
+
+    write_results(&bench, file);
+
+    if (ferror(file) | (file != stdout ? fclose(file) : fflush(file))) {
+        fprintf(stderr, "Could not write the results.\n");
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,1097 @@
+#define _GNU_SOURCE
+
+#include <argp.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+/*
+ * A differential fuzzer for tcpp. It generates random translation units, preprocesses each of them with both tcpp and
+ * GCC's preprocessor, and checks that both produce the same tokens. The outputs are compared as token streams, so
+ * that their different layouts make no difference.
+ *
+ * The generated files mix includes (with guards, '#pragma once' or neither), object-like, function-like, variadic,
+ * stringizing and pasting macros, nested conditionals, comments and literals. Line continuations are inserted at random
+ * positions, also within tokens, comments and directives, and some of the files use CRLF line endings.
+ *
+ * The time both preprocessors take is summed up over all the cases, so that the relative speed of tcpp is reported
+ * along with its correctness.
+ */
+
+const char *argp_program_version =
+        "tcpp-fuzz 0.1";
+const char *argp_program_bug_address =
+        "<mrtomaszal@gmail.com>";
+
+/**
+ * Program documentation.
+ *
+ * Passed into the DOC field of the ARGP structure.
+ */
+static char doc[] =
+        "Compares the tcpp executable <tcpp> against GCC's preprocessor on randomly generated inputs.";
+
+/**
+ * A description of the accepted non-option arguments.
+ *
+ * Passed into the ARGS_DOC field of the ARGP structure.
+ */
+static char args_doc[] = "<tcpp>";
+
+/**
+ * The maximum number of headers of a case.
+ */
+#define MAX_HEADERS 6
+
+/**
+ * The number of function-like macros F*, which are always defined.
+ */
+#define FUNCTION_MACROS 6
+
+/**
+ * Stores the configuration of a fuzzing run.
+ *
+ * CORPUS is the directory in which the cases are generated. CPP is the command of the reference preprocessor, split
+ * into its words, and OPTIONS the additional options passed to tcpp. COUNT cases are generated from SEED, with SIZE
+ * statements in every header (twice as many in the main file).
+ */
+typedef struct Fuzz {
+    char *tcpp;
+    char *corpus;
+
+    char **cpp;
+    int cpp_count;
+    char **options;
+    int option_count;
+
+    unsigned long long seed;
+    int count;
+    int size;
+} Fuzz;
+
+/**
+ * Stores a piece of generated text.
+ */
+typedef struct Text {
+    char *data;
+    size_t length;
+    size_t capacity;
+} Text;
+
+/**
+ * Stores the state of the file being generated.
+ *
+ * HEADER is the index of the file's header, -1 for the main file, which only includes headers with higher indexes so
+ * that the includes cannot recurse. Every line gets line continuations with a chance of SPLICES percent, and ends with
+ * CRLF if IS_CRLF is set.
+ */
+typedef struct Generator {
+    FILE *file;
+    Text line;
+
+    int header;
+    int header_count;
+    int splices;
+    int is_crlf;
+
+    long bytes;
+} Generator;
+
+/**
+ * Stores a token of a preprocessed output.
+ */
+typedef struct OutputToken {
+    const char *string;
+    size_t length;
+    int line;
+} OutputToken;
+
+/**
+ * Stores the totals of a fuzzing run.
+ */
+typedef struct Totals {
+    int mismatches;
+    long bytes;
+    long tokens;
+
+    double tcpp_seconds;
+    double cpp_seconds;
+} Totals;
+
+/**
+ * The state of the random number generator (xorshift64*), so that the cases only depend on the seed.
+ */
+static unsigned long long random_state;
+
+/**
+ * Generates a random number.
+ *
+ * @param bound The bound of the number.
+ * @return A random number from 0 to BOUND - 1.
+ */
+static int pick(int bound) {
+    random_state ^= random_state >> 12;
+    random_state ^= random_state << 25;
+    random_state ^= random_state >> 27;
+
+    return (int) (((random_state * 0x2545f4914f6cdd1dULL) >> 33) % (unsigned long long) bound);
+}
+
+/**
+ * Decides something randomly.
+ *
+ * @param percent The chance of a positive decision, in percent.
+ * @return 1 with the given chance, 0 otherwise.
+ */
+static int chance(int percent) {
+    return pick(100) < percent;
+}
+
+/**
+ * Appends formatted text to a piece of text.
+ *
+ * @param text The text to which to append.
+ * @param format The format of the appended text.
+ */
+static void append(Text *text, const char *format, ...) {
+    va_list list;
+
+    for (;;) {
+        va_start(list, format);
+        int length = vsnprintf(text->data + text->length, text->capacity - text->length, format, list);
+        va_end(list);
+
+        if (text->length + (size_t) length < text->capacity) {
+            text->length += (size_t) length;
+            return;
+        }
+
+        text->capacity = 2 * (text->length + (size_t) length + 1);
+        text->data = realloc(text->data, text->capacity);
+
+        if (!text->data) {
+            fprintf(stderr, "Could not allocate enough memory.");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+/**
+ * Writes the generated line into the file, inserting line continuations at random positions and ending it with the
+ * line ending of the file. The line is cleared afterwards.
+ *
+ * @param generator The generator of the file.
+ */
+static void end_line(Generator *generator) {
+    Text *line = &generator->line;
+    const char *line_ending = generator->is_crlf ? "\r\n" : "\n";
+    size_t splices[2] = {(size_t) -1, (size_t) -1};
+
+    if (chance(generator->splices)) {
+        splices[0] = (size_t) pick((int) line->length + 1);
+
+        if (chance(30)) {
+            splices[1] = (size_t) pick((int) line->length + 1);
+        }
+    }
+
+    for (size_t i = 0; i <= line->length; i++) {
+        for (int j = 0; j < 2; j++) {
+            if (splices[j] == i) {
+                fprintf(generator->file, "\\%s", line_ending);
+                generator->bytes += 1 + (long) strlen(line_ending);
+            }
+        }
+
+        if (i < line->length) {
+            fputc(line->data[i], generator->file);
+        }
+    }
+
+    fputs(line_ending, generator->file);
+    generator->bytes += (long) (line->length + strlen(line_ending));
+    line->length = 0;
+}
+
+/**
+ * Appends the whitespace between two tokens, which is sometimes a comment or missing altogether.
+ *
+ * @param text The text to which to append.
+ * @param is_required 1 if the tokens must be separated, 0 if they might be written together.
+ */
+static void write_space(Text *text, int is_required) {
+    static const char *spaces[] = {" ", " ", " ", "  ", "\t", " /* space */ ", "/**/", ""};
+    int count = (int) (sizeof spaces / sizeof *spaces);
+
+    append(text, "%s", spaces[pick(is_required ? count - 1 : count)]);
+}
+
+/**
+ * Appends an expression which is valid in a conditional directive: small integers, the numeric macros N*, the
+ * function-like macros F* and the operators which cannot overflow.
+ *
+ * Replacement lists of F* only invoke the F* before them and never N*, so that no F* is left unexpanded by recursion,
+ * which would be an error in a conditional directive. The N* can refer to each other freely, as they are 0 if left.
+ *
+ * @param text The text to which to append.
+ * @param depth The number of further levels of nesting allowed.
+ * @param parameters The number of parameters (a, b, c) which can be used, for the replacement lists of F*.
+ * @param functions The number of F* which can be invoked.
+ */
+static void write_numeric(Text *text, int depth, int parameters, int functions) {
+    static const char *operators[] = {"+", "-", "==", "!=", "<", ">", "<=", ">=", "&&", "||"};
+    int choice = depth > 0 ? pick(8) : pick(3);
+
+    if (choice == 0) {
+        append(text, "%d", pick(100));
+    } else if (choice == 1 && !parameters) {
+        append(text, "N%d", pick(8));
+    } else if (choice <= 2) {
+        if (parameters) {
+            append(text, "%c", 'a' + pick(parameters));
+        } else {
+            append(text, "%d", pick(10));
+        }
+    } else if (choice <= 4) {
+        append(text, "(");
+        write_numeric(text, depth - 1, parameters, functions);
+        append(text, " %s ", operators[pick(sizeof operators / sizeof *operators)]);
+        write_numeric(text, depth - 1, parameters, functions);
+        append(text, ")");
+    } else if (choice == 5 && functions) {
+        int macro = pick(functions);
+
+        append(text, "F%d(", macro);
+
+        for (int i = 0; i <= macro % 3; i++) {
+            if (i) {
+                append(text, ",");
+                write_space(text, 0);
+            }
+
+            write_numeric(text, depth - 1, parameters, functions);
+        }
+
+        append(text, ")");
+    } else if (choice <= 6) {
+        append(text, "!");
+        write_numeric(text, depth - 1, parameters, functions);
+    } else {
+        append(text, "(");
+        write_numeric(text, depth - 1, parameters, functions);
+        append(text, " ? ");
+        write_numeric(text, depth - 1, parameters, functions);
+        append(text, " : ");
+        write_numeric(text, depth - 1, parameters, functions);
+        append(text, ")");
+    }
+}
+
+/**
+ * Appends a string literal with escapes and comment-like contents.
+ *
+ * @param text The text to which to append.
+ */
+static void write_string(Text *text) {
+    static const char *strings[] = {"\"text\"", "\"/* no comment */\"", "\"// nor this\"", "\"\\\"quoted\\\"\"",
+                                    "\"back\\\\slash\"", "\"#define X\"", "\"\"", "L\"wide\"", "'x'", "'\\''",
+                                    "'\"'", "'\\\\'"};
+
+    append(text, "%s", strings[pick(sizeof strings / sizeof *strings)]);
+}
+
+/**
+ * Appends an expression for the text of a file, which might use any of the macros.
+ *
+ * @param text The text to which to append.
+ * @param depth The number of further levels of nesting allowed.
+ */
+static void write_code(Text *text, int depth) {
+    static const char *operators[] = {"+", "*", "-", "<<", "&", "|"};
+    int choice = depth > 0 ? pick(12) : pick(4);
+
+    if (choice == 0) {
+        write_numeric(text, depth, 0, FUNCTION_MACROS);
+    } else if (choice == 1) {
+        append(text, "O%d", pick(8));
+    } else if (choice == 2) {
+        append(text, "v%d", pick(20));
+    } else if (choice == 3) {
+        write_string(text);
+    } else if (choice <= 5) {
+        append(text, "(");
+        write_code(text, depth - 1);
+        write_space(text, 1);
+        append(text, "%s", operators[pick(sizeof operators / sizeof *operators)]);
+        write_space(text, 1);
+        write_code(text, depth - 1);
+        append(text, ")");
+    } else if (choice == 6) {
+        append(text, "V%d(", pick(3));
+        write_code(text, depth - 1);
+
+        for (int i = pick(3); i > 0; i--) {
+            append(text, ",");
+            write_space(text, 0);
+            write_code(text, depth - 1);
+        }
+
+        append(text, ")");
+    } else if (choice == 7) {
+        append(text, "%s%d(", chance(50) ? "S" : "X", pick(2));
+        write_space(text, 0);
+        write_code(text, depth - 1);
+        write_space(text, 0);
+        append(text, ")");
+    } else if (choice == 8) {
+        append(text, "P%d(%s,", pick(2), chance(50) ? "O" : "v");
+        write_space(text, 0);
+        append(text, "%d)", pick(10));
+    } else if (choice == 9) {
+        append(text, "g(");
+        write_code(text, depth - 1);
+        append(text, ")");
+    } else if (choice == 10) {
+        append(text, "F%d", pick(FUNCTION_MACROS));
+    } else {
+        write_numeric(text, depth, 0, FUNCTION_MACROS);
+    }
+}
+
+/**
+ * Appends the start of a directive, with the blanks and comments allowed around its '#'.
+ *
+ * @param text The text to which to append.
+ * @param name The name of the directive.
+ */
+static void write_directive(Text *text, const char *name) {
+    static const char *starts[] = {"#", "#", "#", "# ", " #", "\t#  ", "#/* directive */"};
+
+    append(text, "%s%s", starts[pick(sizeof starts / sizeof *starts)], name);
+}
+
+static void write_statements(Generator *generator, int count, int depth);
+
+/**
+ * Generates a conditional group, with nested statements and random branches.
+ *
+ * @param generator The generator of the file.
+ * @param depth The number of further levels of nesting allowed.
+ */
+static void write_conditional(Generator *generator, int depth) {
+    Text *line = &generator->line;
+    int choice = pick(4);
+
+    if (choice == 0) {
+        write_directive(line, chance(50) ? "ifdef " : "ifndef ");
+        append(line, "%c%d", "NFOVSP"[pick(6)], pick(8));
+    } else {
+        write_directive(line, "if ");
+
+        if (choice == 1) {
+            append(line, chance(50) ? "defined(%c%d)" : "!defined %c%d", "NFO"[pick(3)], pick(8));
+        } else if (choice == 2 && chance(20)) {
+            append(line, "__STDC_VERSION__ >= 199901L && __STDC__");
+        } else {
+            write_numeric(line, 3, 0, FUNCTION_MACROS);
+        }
+    }
+
+    end_line(generator);
+    write_statements(generator, 1 + pick(4), depth - 1);
+
+    for (int branches = pick(3); branches > 0; branches--) {
+        write_directive(line, "elif ");
+        write_numeric(line, 2, 0, FUNCTION_MACROS);
+        end_line(generator);
+        write_statements(generator, 1 + pick(3), depth - 1);
+    }
+
+    if (chance(50)) {
+        write_directive(line, "else");
+        end_line(generator);
+        write_statements(generator, 1 + pick(3), depth - 1);
+    }
+
+    write_directive(line, "endif");
+    end_line(generator);
+}
+
+/**
+ * Generates a macro definition.
+ *
+ * @param generator The generator of the file.
+ */
+static void write_define(Generator *generator) {
+    Text *line = &generator->line;
+    int choice = pick(10), macro = pick(8);
+
+    write_directive(line, "define ");
+
+    if (choice <= 2) {
+        append(line, "N%d ", macro);
+        write_numeric(line, 3, 0, FUNCTION_MACROS);
+    } else if (choice <= 4) {
+        // The number of parameters of every F* is fixed, so that its invocations all match it
+        macro %= FUNCTION_MACROS;
+        append(line, "F%d(a%s%s) ", macro, macro % 3 > 0 ? ", b" : "", macro % 3 > 1 ? ", c" : "");
+        write_numeric(line, 3, macro % 3 + 1, macro);
+    } else if (choice <= 6) {
+        append(line, "O%d", macro);
+        write_space(line, 1);
+        write_code(line, 3);
+    } else if (choice == 7) {
+        append(line, "V%d(a, ...) %s", macro % 3, chance(50) ? "g(a, __VA_ARGS__)" : "h(__VA_ARGS__) + a");
+    } else if (choice == 8) {
+        append(line, chance(50) ? "S%d(x) #x" : "X%d(x) S0(x)", macro % 2);
+    } else {
+        append(line, "P%d(a, b) a ## b", macro % 2);
+    }
+
+    end_line(generator);
+}
+
+/**
+ * Generates a comment, which might span lines or be continued by a backslash.
+ *
+ * @param generator The generator of the file.
+ */
+static void write_comment(Generator *generator) {
+    Text *line = &generator->line;
+    int choice = pick(4);
+
+    if (choice == 0) {
+        append(line, "/* comment with a // and a /* inside */");
+    } else if (choice == 1) {
+        append(line, "int c%d; // trailing comment, with a \"quote", pick(20));
+    } else if (choice == 2) {
+        append(line, "// comment continued on the next line \\");
+        end_line(generator);
+        append(line, "still inside the comment */ #define");
+    } else {
+        append(line, "/**");
+        end_line(generator);
+
+        for (int i = pick(3); i >= 0; i--) {
+            append(line, " * line %d of a block comment, ending ** /", i);
+            end_line(generator);
+        }
+
+        append(line, " */ int after_comment%d;", pick(20));
+    }
+
+    end_line(generator);
+}
+
+/**
+ * Generates a line of text, with macro invocations which might span lines.
+ *
+ * @param generator The generator of the file.
+ */
+static void write_text(Generator *generator) {
+    Text *line = &generator->line;
+    int choice = pick(4);
+
+    if (choice == 0) {
+        append(line, "int v%d = ", pick(20));
+        write_code(line, 3);
+        append(line, ";");
+    } else if (choice == 1) {
+        write_code(line, 3);
+        append(line, ";");
+    } else if (choice == 2) {
+        append(line, "const char *s%d = ", pick(20));
+        write_string(line);
+        write_space(line, 1);
+        write_string(line);
+        append(line, ";");
+    } else {
+        // The arguments of an invocation may span lines
+        append(line, "int w%d = F%d(", pick(20), 2);
+        end_line(generator);
+        write_numeric(line, 2, 0, FUNCTION_MACROS);
+        append(line, ",");
+        end_line(generator);
+        write_numeric(line, 2, 0, FUNCTION_MACROS);
+        append(line, ", ");
+        write_numeric(line, 2, 0, FUNCTION_MACROS);
+        append(line, ");");
+    }
+
+    end_line(generator);
+}
+
+/**
+ * Generates random statements: directives, comments and text.
+ *
+ * @param generator The generator of the file.
+ * @param count The number of statements to generate.
+ * @param depth The number of further levels of conditional nesting allowed.
+ */
+static void write_statements(Generator *generator, int count, int depth) {
+    Text *line = &generator->line;
+
+    for (int i = 0; i < count; i++) {
+        int choice = pick(100);
+
+        if (choice < 25) {
+            write_define(generator);
+        } else if (choice < 30) {
+            write_directive(line, "undef ");
+            append(line, "%c%d", "NOVSXP"[pick(6)], pick(8));
+            end_line(generator);
+        } else if (choice < 40 && depth > 0) {
+            write_conditional(generator, depth);
+        } else if (choice < 45 && generator->header + 1 < generator->header_count) {
+            int header = generator->header + 1 + pick(generator->header_count - generator->header - 1);
+
+            write_directive(line, "include ");
+            append(line, chance(80) ? "\"h%d.h\"" : "<h%d.h>", header);
+            end_line(generator);
+        } else if (choice < 55) {
+            write_comment(generator);
+        } else if (choice < 95) {
+            write_text(generator);
+        } else {
+            end_line(generator);
+        }
+    }
+}
+
+/**
+ * Creates a file of a case and prepares its generator, with random line endings and line continuations.
+ *
+ * @param generator The generator to prepare.
+ * @param directory The directory of the case.
+ * @param name The name of the file.
+ */
+static void create_file(Generator *generator, const char *directory, const char *name) {
+    static const int splices[] = {0, 0, 3, 10, 30};
+    char path[0x1200];
+
+    snprintf(path, sizeof path, "%s/%s", directory, name);
+    generator->file = fopen(path, "wb");
+
+    if (!generator->file) {
+        fprintf(stderr, "Could not open or create file %s.\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    generator->splices = splices[pick(sizeof splices / sizeof *splices)];
+    generator->is_crlf = chance(25);
+}
+
+/**
+ * Closes a generated file, exiting if it could not be written.
+ *
+ * @param generator The generator of the file.
+ */
+static void close_file(Generator *generator) {
+    if (ferror(generator->file) | fclose(generator->file)) {
+        fprintf(stderr, "Could not write the corpus.\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * Generates a case: a main file and the headers it includes, directly or through each other.
+ *
+ * @param fuzz The configuration of the run.
+ * @param directory The directory of the case.
+ * @return The number of bytes generated.
+ */
+static long generate_case(const Fuzz *fuzz, const char *directory) {
+    Generator generator = {.header_count = 1 + pick(MAX_HEADERS)};
+
+    for (int header = 0; header < generator.header_count; header++) {
+        char name[0x20];
+        int guard = pick(3);
+
+        snprintf(name, sizeof name, "h%d.h", header);
+        create_file(&generator, directory, name);
+        generator.header = header;
+
+        if (guard == 0) {
+            append(&generator.line, "#ifndef H%d_H", header);
+            end_line(&generator);
+            append(&generator.line, "#define H%d_H", header);
+            end_line(&generator);
+        } else if (guard == 1) {
+            append(&generator.line, "#pragma once");
+            end_line(&generator);
+        }
+
+        write_statements(&generator, fuzz->size, 3);
+
+        if (guard == 0) {
+            append(&generator.line, "#endif");
+            end_line(&generator);
+        }
+
+        close_file(&generator);
+    }
+
+    create_file(&generator, directory, "main.c");
+    generator.header = -1;
+
+    // The function-like macros F* are never undefined, as they are invoked in conditional directives
+    for (int macro = 0; macro < FUNCTION_MACROS; macro++) {
+        append(&generator.line, "#define F%d(a%s%s) (a + %d)", macro, macro % 3 > 0 ? ", b" : "",
+               macro % 3 > 1 ? ", c" : "", macro);
+        end_line(&generator);
+    }
+    write_statements(&generator, 2 * fuzz->size, 3);
+    append(&generator.line, "int main%d;", pick(100));
+    end_line(&generator);
+    close_file(&generator);
+
+    free(generator.line.data);
+
+    return generator.bytes;
+}
+
+/**
+ * Creates a directory if it does not exist yet.
+ *
+ * @param path The location of the directory.
+ */
+static void make_directory(const char *path) {
+    if (mkdir(path, 0777) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Could not create directory %s.\n", path);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * Runs a command, with its standard error redirected into a file.
+ *
+ * @param argv The command and its arguments, terminated by NULL.
+ * @param errors The location of the file into which to redirect its standard error.
+ * @param seconds A pointer to which to add the elapsed time in seconds.
+ * @return 1 if it exited successfully, 0 otherwise.
+ */
+static int run_command(char **argv, const char *errors, double *seconds) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    pid_t pid = fork();
+
+    if (pid == 0) {
+        int fd = open(errors, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+
+        if (fd >= 0) {
+            dup2(fd, STDERR_FILENO);
+        }
+
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+
+    int status;
+
+    if (pid < 0 || waitpid(pid, &status, 0) != pid) {
+        fprintf(stderr, "Could not run %s.\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    *seconds += (double) (end.tv_sec - start.tv_sec) + (double) (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    return WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+}
+
+/**
+ * Punctuators of more than one character, the longest first, so that the outputs are split into tokens the way a
+ * compiler would read them.
+ */
+static const char *punctuators[] = {
+        "...", "<<=", ">>=", "##", "->", "++", "--", "<<", ">>", "<=", ">=", "==", "!=", "&&", "||", "*=", "/=",
+        "%=", "+=", "-=", "&=", "^=", "|=", NULL
+};
+
+/**
+ * Splits a preprocessed output into tokens.
+ *
+ * @param data The output.
+ * @param size The size of the output.
+ * @param count A pointer into which to store the number of tokens.
+ * @return A newly allocated array of the tokens.
+ */
+static OutputToken *split_tokens(const char *data, size_t size, size_t *count) {
+    const char *cursor = data, *end = data + size;
+    OutputToken *tokens = NULL;
+    size_t capacity = 0;
+    int line = 1;
+
+    *count = 0;
+
+    while (cursor < end) {
+        if (isspace((unsigned char) *cursor)) {
+            line += *cursor++ == '\n';
+            continue;
+        }
+
+        const char *start = cursor++;
+        char quote = (*start == '"' || *start == '\'') ? *start : 0;
+
+        // Wide literals
+        if (*start == 'L' && cursor < end && (*cursor == '"' || *cursor == '\'')) {
+            quote = *cursor++;
+        }
+
+        if (quote) {
+            while (cursor < end && *cursor != quote && *cursor != '\n') {
+                cursor += (*cursor == '\\' && cursor + 1 < end) ? 2 : 1;
+            }
+
+            if (cursor < end && *cursor == quote) {
+                cursor++;
+            }
+        } else if (isdigit((unsigned char) *start) || (*start == '.' && cursor < end && isdigit((unsigned char) *cursor))) {
+            // Preprocessing numbers, with the signs of their exponents
+            while (cursor < end && (isalnum((unsigned char) *cursor) || *cursor == '_' || *cursor == '.' ||
+                                    ((*cursor == '+' || *cursor == '-') && strchr("eEpP", cursor[-1])))) {
+                cursor++;
+            }
+        } else if (isalpha((unsigned char) *start) || *start == '_' || *start == '$') {
+            while (cursor < end && (isalnum((unsigned char) *cursor) || *cursor == '_' || *cursor == '$')) {
+                cursor++;
+            }
+        } else {
+            for (int i = 0; punctuators[i]; i++) {
+                size_t length = strlen(punctuators[i]);
+
+                if ((size_t) (end - start) >= length && strncmp(start, punctuators[i], length) == 0) {
+                    cursor = start + length;
+                    break;
+                }
+            }
+        }
+
+        if (*count == capacity) {
+            capacity = capacity ? 2 * capacity : 0x400;
+            tokens = realloc(tokens, capacity * sizeof *tokens);
+
+            if (!tokens) {
+                fprintf(stderr, "Could not allocate enough memory.");
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        tokens[(*count)++] = (OutputToken) {start, (size_t) (cursor - start), line};
+    }
+
+    return tokens;
+}
+
+/**
+ * Reads a whole file into a newly allocated buffer.
+ *
+ * @param file_name The location of the file.
+ * @param size A pointer into which to store the size of the file.
+ * @return The newly allocated content, NULL if the file could not be read.
+ */
+static char *read_file(const char *file_name, size_t *size) {
+    FILE *file = fopen(file_name, "rb");
+
+    if (!file) {
+        return NULL;
+    }
+
+    size_t capacity = 0x10000;
+    char *data = malloc(capacity);
+    *size = 0;
+
+    while (data) {
+        *size += fread(data + *size, 1, capacity - *size, file);
+
+        if (*size < capacity) {
+            break;
+        }
+
+        data = realloc(data, capacity *= 2);
+    }
+
+    fclose(file);
+
+    return data;
+}
+
+/**
+ * Compares the token streams of two preprocessed outputs, reporting the first difference.
+ *
+ * @param name The name of the case.
+ * @param tcpp_output The location of tcpp's output.
+ * @param cpp_output The location of the reference preprocessor's output.
+ * @param token_count A pointer to which to add the number of tokens compared.
+ * @return 1 if the streams are the same, 0 otherwise.
+ */
+static int compare_outputs(const char *name, const char *tcpp_output, const char *cpp_output, long *token_count) {
+    size_t tcpp_size, cpp_size, tcpp_count, cpp_count;
+    char *tcpp_data = read_file(tcpp_output, &tcpp_size);
+    char *cpp_data = read_file(cpp_output, &cpp_size);
+
+    if (!tcpp_data || !cpp_data) {
+        fprintf(stderr, "%s: Could not read the outputs.\n", name);
+        free(tcpp_data);
+        free(cpp_data);
+        return 0;
+    }
+
+    OutputToken *tcpp_tokens = split_tokens(tcpp_data, tcpp_size, &tcpp_count);
+    OutputToken *cpp_tokens = split_tokens(cpp_data, cpp_size, &cpp_count);
+    size_t i = 0;
+
+    while (i < tcpp_count && i < cpp_count && tcpp_tokens[i].length == cpp_tokens[i].length &&
+           memcmp(tcpp_tokens[i].string, cpp_tokens[i].string, tcpp_tokens[i].length) == 0) {
+        i++;
+    }
+
+    int is_same = i == tcpp_count && i == cpp_count;
+
+    if (!is_same) {
+        OutputToken none = {"(end)", 5, 0};
+        const OutputToken *tcpp_token = i < tcpp_count ? &tcpp_tokens[i] : &none;
+        const OutputToken *cpp_token = i < cpp_count ? &cpp_tokens[i] : &none;
+
+        fprintf(stderr, "%s: Token %zu differs: '%.*s' on line %d of %s, '%.*s' on line %d of %s.\n", name, i + 1,
+                (int) (tcpp_token->length < 40 ? tcpp_token->length : 40), tcpp_token->string, tcpp_token->line,
+                tcpp_output, (int) (cpp_token->length < 40 ? cpp_token->length : 40), cpp_token->string,
+                cpp_token->line, cpp_output);
+    }
+
+    *token_count += (long) cpp_count;
+
+    free(tcpp_tokens);
+    free(cpp_tokens);
+    free(tcpp_data);
+    free(cpp_data);
+
+    return is_same;
+}
+
+/**
+ * Generates a case and runs both preprocessors over it, recording the results in the totals.
+ *
+ * @param fuzz The configuration of the run.
+ * @param index The index of the case.
+ * @param totals The totals of the run.
+ */
+static void run_case(const Fuzz *fuzz, int index, Totals *totals) {
+    char directory[0x1100], name[0x20], input[0x1200], tcpp_output[0x1200], cpp_output[0x1200], errors[0x1200];
+
+    snprintf(directory, sizeof directory, "%s/case%d", fuzz->corpus, index);
+    snprintf(name, sizeof name, "case%d", index);
+    make_directory(directory);
+
+    totals->bytes += generate_case(fuzz, directory);
+
+    snprintf(input, sizeof input, "%s/main.c", directory);
+    snprintf(tcpp_output, sizeof tcpp_output, "%s/tcpp.i", directory);
+    snprintf(cpp_output, sizeof cpp_output, "%s/cpp.i", directory);
+
+    // tcpp -q -I <dir> -i <input> -o <output> <options>...
+    char **argv = malloc((size_t) (fuzz->option_count + fuzz->cpp_count + 10) * sizeof *argv);
+    int argc = 0;
+
+    if (!argv) {
+        fprintf(stderr, "Could not allocate enough memory.");
+        exit(EXIT_FAILURE);
+    }
+
+    argv[argc++] = fuzz->tcpp;
+    argv[argc++] = "-q";
+    argv[argc++] = "-I";
+    argv[argc++] = directory;
+    argv[argc++] = "-i";
+    argv[argc++] = input;
+    argv[argc++] = "-o";
+    argv[argc++] = tcpp_output;
+
+    for (int i = 0; i < fuzz->option_count; i++) {
+        argv[argc++] = fuzz->options[i];
+    }
+
+    argv[argc] = NULL;
+    snprintf(errors, sizeof errors, "%s/tcpp.err", directory);
+    int is_tcpp_successful = run_command(argv, errors, &totals->tcpp_seconds);
+
+    // <cpp>... -I <dir> <input> -o <output>
+    argc = 0;
+
+    for (int i = 0; i < fuzz->cpp_count; i++) {
+        argv[argc++] = fuzz->cpp[i];
+    }
+
+    argv[argc++] = "-I";
+    argv[argc++] = directory;
+    argv[argc++] = input;
+    argv[argc++] = "-o";
+    argv[argc++] = cpp_output;
+    argv[argc] = NULL;
+    snprintf(errors, sizeof errors, "%s/cpp.err", directory);
+    int is_cpp_successful = run_command(argv, errors, &totals->cpp_seconds);
+
+    free(argv);
+
+    if (!is_tcpp_successful || !is_cpp_successful) {
+        fprintf(stderr, "%s: %s failed (see %s/%s.err).\n", name, is_tcpp_successful ? fuzz->cpp[0] : fuzz->tcpp,
+                directory, is_tcpp_successful ? "cpp" : "tcpp");
+        totals->mismatches++;
+    } else if (!compare_outputs(name, tcpp_output, cpp_output, &totals->tokens)) {
+        totals->mismatches++;
+    }
+}
+
+/**
+ * Splits a command into its words, separated by spaces.
+ *
+ * @param command The command, modified in place.
+ * @param count A pointer into which to store the number of words.
+ * @return A newly allocated array of the words.
+ */
+static char **split_command(char *command, int *count) {
+    char **words = malloc((strlen(command) / 2 + 2) * sizeof *words);
+
+    if (!words) {
+        fprintf(stderr, "Could not allocate enough memory.");
+        exit(EXIT_FAILURE);
+    }
+
+    *count = 0;
+
+    for (char *word = strtok(command, " "); word; word = strtok(NULL, " ")) {
+        words[(*count)++] = word;
+    }
+
+    return words;
+}
+
+/**
+ * An array of accepted ARGP_OPTION's.
+ *
+ * Passed into the OPTIONS field of the ARGP structure.
+ */
+static struct argp_option options[] = {
+        {"corpus", 'd', "<dir>",     0, "Generate the cases into <dir> (\"fuzz_corpus\" by default)"},
+        {"cases",  'n', "<n>",       0, "Generate <n> cases (200 by default)"},
+        {"size",   'z', "<n>",       0, "Generate <n> statements per header (40 by default)"},
+        {"seed",   's', "<n>",       0, "Generate the cases from the seed <n> (1 by default)"},
+        {"cpp",    'c', "<command>", 0, "Compare against <command> (\"gcc -E -P -undef -std=gnu99\" by default)"},
+        {"option", 'a', "<option>",  0, "Pass <option> on to tcpp (can be repeated)"},
+        {0}
+};
+
+/**
+ * Parses an ARGP_OPTION.
+ *
+ * Passed into the PARSER field of the ARGP structure.
+ *
+ * @param key A key associated with an option.
+ * @param arg An argument associated with the key.
+ * @param state The current state of argument parsing.
+ * @return 0 if successful, error code otherwise.
+ */
+static error_t parse_opt(int key, char *arg, struct argp_state *state) {
+    Fuzz *fuzz = state->input;
+
+    switch (key) {
+        case 'd':
+            fuzz->corpus = arg;
+            break;
+        case 'n':
+            if ((fuzz->count = atoi(arg)) < 1) {
+                argp_error(state, "The number of cases has to be a positive number.");
+            }
+            break;
+        case 'z':
+            if ((fuzz->size = atoi(arg)) < 1) {
+                argp_error(state, "The size has to be a positive number.");
+            }
+            break;
+        case 's':
+            fuzz->seed = strtoull(arg, NULL, 10);
+            break;
+        case 'c':
+            fuzz->cpp = split_command(arg, &fuzz->cpp_count);
+
+            if (!fuzz->cpp_count) {
+                argp_error(state, "The command cannot be empty.");
+            }
+            break;
+        case 'a':
+            fuzz->options = realloc(fuzz->options, (size_t) (fuzz->option_count + 1) * sizeof *fuzz->options);
+
+            if (!fuzz->options) {
+                fprintf(stderr, "Could not allocate enough memory.");
+                exit(EXIT_FAILURE);
+            }
+
+            fuzz->options[fuzz->option_count++] = arg;
+            break;
+
+        case ARGP_KEY_ARG:
+            if (fuzz->tcpp) {
+                argp_usage(state);
+            }
+
+            fuzz->tcpp = arg;
+            break;
+        case ARGP_KEY_END:
+            if (!fuzz->tcpp) {
+                argp_usage(state);
+            }
+            break;
+
+        default:
+            return ARGP_ERR_UNKNOWN;
+    }
+
+    return 0;
+}
+
+/**
+ * The ARGP structure itself.
+ */
+static struct argp argp = {options, parse_opt, args_doc, doc};
+
+int main(int argc, char **argv) {
+    char default_cpp[] = "gcc -E -P -undef -std=gnu99";
+    Fuzz fuzz = {NULL, "fuzz_corpus", NULL, 0, NULL, 0, 1, 200, 40};
+    Totals totals = {0};
+
+    argp_parse(&argp, argc, argv, 0, 0, &fuzz);
+
+    if (!fuzz.cpp) {
+        fuzz.cpp = split_command(default_cpp, &fuzz.cpp_count);
+    }
+
+    make_directory(fuzz.corpus);
+
+    // xorshift must not start from 0
+    random_state = fuzz.seed * 0x9e3779b97f4a7c15ULL + 1;
+
+    for (int i = 0; i < fuzz.count; i++) {
+        run_case(&fuzz, i, &totals);
+    }
+
+    double tcpp_seconds = totals.tcpp_seconds > 0 ? totals.tcpp_seconds : 1e-9;
+
+    printf("%d cases, %d mismatches, %.3f MB and %ld tokens compared.\n", fuzz.count, totals.mismatches,
+           (double) totals.bytes / 1e6, totals.tokens);
+    printf("tcpp: %.3f s, %s: %.3f s, tcpp is %.2fx as fast.\n", totals.tcpp_seconds, fuzz.cpp[0],
+           totals.cpp_seconds, totals.cpp_seconds / tcpp_seconds);
+
+    free(fuzz.cpp);
+    free(fuzz.options);
+
+    return totals.mismatches ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,106 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "arena.h"
+
+/**
+ * The default size of an arena block. Bigger allocations get a block of their own.
+ */
+static const size_t block_size = 0x10000;
+
+/**
+ * The alignment of every allocation made from an arena.
+ */
+static const size_t alignment = sizeof(void *);
+
+/**
+ * Generates a new, empty arena.
+ *
+ * @return A newly generated arena.
+ */
+Arena *new_arena(void) {
+    Arena *arena = calloc(1, sizeof *arena);
+
+    if (!arena) {
+        fprintf(stderr, "Could not allocate enough memory.");
+        exit(EXIT_FAILURE);
+    }
+
+    return arena;
+}
+
+/**
+ * Deletes an arena and frees all the memory allocated from it.
+ *
+ * @param arena An arena to delete.
+ */
+void delete_arena(Arena *arena) {
+    if (!arena) {
+        return;
+    }
+
+    while (arena->block) {
+        ArenaBlock *next = arena->block->next;
+        free(arena->block);
+        arena->block = next;
+    }
+
+    free(arena);
+}
+
+/**
+ * Allocates zero-initialized memory from an arena.
+ *
+ * @param arena An arena from which to allocate.
+ * @param size The number of bytes to allocate.
+ * @return A pointer to the allocated memory.
+ */
+void *arena_alloc(Arena *arena, size_t size) {
+    size = (size + alignment - 1) & ~(alignment - 1);
+
+    ArenaBlock *block = arena->block;
+
+    if (!block || block->size - block->used < size) {
+        size_t new_size = size > block_size ? size : block_size;
+
+        block = malloc(sizeof *block + new_size);
+
+        if (!block) {
+            fprintf(stderr, "Could not allocate enough memory.");
+            exit(EXIT_FAILURE);
+        }
+
+        block->size = new_size;
+        block->used = 0;
+        arena->size += new_size;
+
+        // Keep the current block for further allocations if the new one is taken in full
+        if (new_size == size && arena->block) {
+            block->next = arena->block->next;
+            arena->block->next = block;
+        } else {
+            block->next = arena->block;
+            arena->block = block;
+        }
+    }
+
+    void *memory = &block->data[block->used];
+    block->used += size;
+
+    return memset(memory, 0, size);
+}
+
+/**
+ * Copies a string into an arena.
+ *
+ * @param arena An arena into which to copy.
+ * @param string A string to copy.
+ * @param length The number of characters to copy.
+ * @return A NULL-terminated copy of the string.
+ */
+char *arena_strndup(Arena *arena, const char *string, size_t length) {
+    char *copy = arena_alloc(arena, length + 1);
+    memcpy(copy, string, length);
+
+    return copy;
+}
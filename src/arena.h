@@ -0,0 +1,35 @@
+#ifndef TCPP_ARENA_H
+#define TCPP_ARENA_H
+
+#include <stddef.h>
+
+/**
+ * Stores a single block of arena memory. Blocks are chained from the newest to the oldest.
+ */
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+
+    size_t size;
+    size_t used;
+
+    char data[];
+} ArenaBlock;
+
+/**
+ * Stores information about a bump allocator. Everything allocated from an arena is freed at once with the arena. SIZE
+ * is the total size of its blocks.
+ */
+typedef struct Arena {
+    ArenaBlock *block;
+    size_t size;
+} Arena;
+
+Arena *new_arena(void);
+
+void delete_arena(Arena *arena);
+
+void *arena_alloc(Arena *arena, size_t size);
+
+char *arena_strndup(Arena *arena, const char *string, size_t length);
+
+#endif //TCPP_ARENA_H
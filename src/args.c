@@ -3,8 +3,30 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <ctype.h>
 #include "args.h"
 
+const Arguments *args;
+
+/**
+ * Keys of the options which only have a long name.
+ */
+enum {
+    OPTION_ISYSTEM = 0x100,
+    OPTION_LIST_DIRS,
+    OPTION_TOKEN_STORE,
+    OPTION_MANIFEST,
+    OPTION_SERVER,
+    OPTION_CONNECT,
+    OPTION_SHUTDOWN,
+    OPTION_STREAM,
+    OPTION_LINE_MARKERS,
+    OPTION_STATS,
+    OPTION_TRACE,
+    OPTION_MD,
+    OPTION_MF
+};
+
 const char *argp_program_version =
         "tcpp 0.2";
 const char *argp_program_bug_address =
@@ -16,7 +38,130 @@ const char *argp_program_bug_address =
  * Passed into the DOC field of the ARGP structure.
  */
 static char doc[] =
-        "Tomaszal's C preprocessor (TCPP) -- a program for preprocessing C computer programming language.";
+        "Tomaszal's C preprocessor (TCPP) -- a program for preprocessing C computer programming language."
+        "\vInput files can also be listed in a response file, passed as @<file>. As with GCC, --MD and --MF can be "
+        "written as -MD and -MF.";
+
+/**
+ * A description of the accepted non-option arguments.
+ *
+ * Passed into the ARGS_DOC field of the ARGP structure.
+ */
+static char args_doc[] = "[@<file>]";
+
+/**
+ * Adds a string to a growing array of strings.
+ *
+ * @param array Pointer to the array.
+ * @param count Pointer to the number of strings in the array.
+ * @param string The string to add.
+ */
+static void add_string(char ***array, int *count, char *string) {
+    if ((*count & (*count - 1)) == 0) {
+        int capacity = *count ? *count * 2 : 1;
+        *array = realloc(*array, capacity * sizeof **array);
+
+        if (!*array) {
+            fprintf(stderr, "Could not allocate enough memory.");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    (*array)[(*count)++] = string;
+}
+
+/**
+ * Adds a '-D' or '-U' option to the macros of the arguments, as it would be written on the command line.
+ *
+ * @param args The arguments to which to add the option.
+ * @param key The option's key, 'D' or 'U'.
+ * @param arg The option's argument.
+ */
+static void add_macro(Arguments *args, int key, const char *arg) {
+    char *option = malloc(strlen(arg) + 3);
+
+    if (!option) {
+        fprintf(stderr, "Could not allocate enough memory.");
+        exit(EXIT_FAILURE);
+    }
+
+    sprintf(option, "-%c%s", key, arg);
+    add_string(&args->macros, &args->macro_count, option);
+}
+
+/**
+ * Adds the input files listed in a response file to the arguments. The file names are separated by whitespace.
+ *
+ * @param args The arguments to which to add the files.
+ * @param file_name The location of the response file.
+ * @return 1 if successful, 0 if the response file could not be read.
+ */
+static int read_response_file(Arguments *args, const char *file_name) {
+    FILE *file = fopen(file_name, "r");
+
+    if (!file) {
+        return 0;
+    }
+
+    char *word = NULL;
+    size_t length = 0, capacity = 0;
+
+    for (int ch = fgetc(file);; ch = fgetc(file)) {
+        if (ch == EOF || isspace(ch)) {
+            if (length) {
+                word[length] = '\0';
+                add_string(&args->input_files, &args->input_count, word);
+
+                word = NULL;
+                length = capacity = 0;
+            }
+
+            if (ch == EOF) {
+                break;
+            }
+
+            continue;
+        }
+
+        if (length + 1 >= capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            word = realloc(word, capacity * sizeof *word);
+
+            if (!word) {
+                fprintf(stderr, "Could not allocate enough memory.");
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        word[length++] = (char) ch;
+    }
+
+    fclose(file);
+
+    return 1;
+}
+
+/**
+ * Makes the name of the output file of an input file, which is the input file's name with the "c" extension replaced
+ * by "o".
+ *
+ * @param input_file The location of a "*.c" input file.
+ * @return A newly allocated file name.
+ */
+char *default_output_file(const char *input_file) {
+    size_t length = strlen(input_file);
+    char *output_file = malloc((length + 1) * (sizeof *output_file));
+
+    if (!output_file) {
+        fprintf(stderr, "Could not allocate enough memory.");
+        exit(EXIT_FAILURE);
+    }
+
+    strcpy(output_file, input_file);
+    output_file[length - 1] = 'o';
+
+    return output_file;
+}
 
 /**
  * An array of accepted ARGP_OPTION's.
@@ -24,12 +169,33 @@ static char doc[] =
  * Passed into the OPTIONS field of the ARGP structure.
  */
 static struct argp_option options[] = {
-        {"verbose",       'v', 0,        0, "Produce verbose output"},
-        {"quiet",         'q', 0,        0, "Do not produce any output at all"},
+        {"verbose",       'v',                0,          0, "Produce verbose output"},
+        {"quiet",         'q',                0,          0, "Do not produce any output at all"},
         {"silent",        's', 0, OPTION_ALIAS},
-        {"keep_comments", 'c', 0,        0, "Keep the comments instead of removing them"},
-        {"input",         'i', "<file>", 0, "Name of the \"*.c\" input <file>"},
-        {"output",        'o', "<file>", 0, "Place output into <file>"},
+        {"keep_comments", 'c',                0,          0, "Keep the comments instead of removing them"},
+        {"input",         'i',                "<file>",   0, "Name of a \"*.c\" input <file> (can be repeated)"},
+        {"output",        'o',                "<file>",   0, "Place output into <file> (\"-\" for stdout)"},
+        {"compact",       'P',                0,          0, "Write the output without blank lines or extra spaces"},
+        {"line_markers",  OPTION_LINE_MARKERS, 0,         0, "Mark the output's files and lines with linemarkers"},
+        {"stream",        OPTION_STREAM,      0,          0, "Write the output while preprocessing, in bounded memory"},
+        {"jobs",          'j',                "<n>",      0, "Preprocess <n> input files in parallel"},
+        {"prefetch",      'p',                "<n>",      0, "Read included headers ahead on <n> threads"},
+        {"include_dir",   'I',                "<dir>",    0, "Search <dir> for included headers"},
+        {"isystem",       OPTION_ISYSTEM,     "<dir>",    0, "Search <dir> for included headers after -I"},
+        {"define",        'D',                "<macro>",  0, "Define <macro>=<value>, as 1 without a value"},
+        {"undefine",      'U',                "<macro>",  0, "Undefine <macro>, also if it is predefined"},
+        {"list_dirs",     OPTION_LIST_DIRS,   0,          0, "Read the listings of the search directories"},
+        {"token_store",   OPTION_TOKEN_STORE, "<dir>",    0, "Keep the tokens of headers in <dir> between runs"},
+        {"manifest",      OPTION_MANIFEST,    "<dir>",    0, "Record the inputs in <dir>, reusing unchanged outputs"},
+        {"server",        OPTION_SERVER,      "<socket>", 0, "Serve requests on <socket>, keeping the caches"},
+        {"connect",       OPTION_CONNECT,     "<socket>", 0, "Send the input files to the server on <socket>"},
+        {"shutdown",      OPTION_SHUTDOWN,    0,          0, "Stop the server on the --connect socket"},
+        {"stats",         OPTION_STATS,       "<file>",   OPTION_ARG_OPTIONAL,
+                "Print phase timings and counters to stderr, or as JSON into <file>"},
+        {"trace",         OPTION_TRACE,       "<file>",   0, "Write a timeline of the includes into <file>"},
+        {0,               'M',                0,          0, "Only write a Makefile rule listing the included files"},
+        {"MD",            OPTION_MD,          0,          0, "Also write the rule while preprocessing, into \"*.d\""},
+        {"MF",            OPTION_MF,          "<file>",   0, "Write the Makefile rule into <file>"},
         {0}
 };
 
@@ -60,32 +226,165 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state) {
             break;
 
         case 'i':
-            args->input_file = arg;
+            add_string(&args->input_files, &args->input_count, arg);
             break;
         case 'o':
             args->output_file = arg;
             break;
+        case 'P':
+            args->compact = 1;
+            break;
+        case OPTION_LINE_MARKERS:
+            args->line_markers = 1;
+            break;
+        case OPTION_STREAM:
+            args->stream = 1;
+            break;
+        case 'j':
+            args->jobs = atoi(arg);
+
+            if (args->jobs < 1) {
+                fprintf(stderr, "The number of jobs must be positive.\n\n");
+                argp_usage(state);
+            }
+
+            break;
+        case 'p':
+            args->prefetch = atoi(arg);
+
+            if (args->prefetch < 0) {
+                fprintf(stderr, "The number of prefetch threads must not be negative.\n\n");
+                argp_usage(state);
+            }
+
+            break;
+
+        case 'I':
+            add_string(&args->include_dirs, &args->include_count, arg);
+            break;
+        case OPTION_ISYSTEM:
+            add_string(&args->system_dirs, &args->system_count, arg);
+            break;
+        case 'D':
+        case 'U':
+            add_macro(args, key, arg);
+            break;
+        case OPTION_LIST_DIRS:
+            args->list_dirs = 1;
+            break;
+        case OPTION_TOKEN_STORE:
+            args->token_store = arg;
+            break;
+        case OPTION_MANIFEST:
+            args->manifest = arg;
+            break;
+
+        case OPTION_SERVER:
+            args->server = arg;
+            break;
+        case OPTION_CONNECT:
+            args->connect = arg;
+            break;
+        case OPTION_SHUTDOWN:
+            args->shutdown = 1;
+            break;
+        case OPTION_STATS:
+            args->stats = 1;
+            args->stats_file = arg;
+            break;
+        case OPTION_TRACE:
+            args->trace_file = arg;
+            break;
+
+        case 'M':
+            args->dependencies_only = 1;
+            break;
+        case OPTION_MD:
+            args->dependencies = 1;
+            break;
+        case OPTION_MF:
+            args->dependency_file = arg;
+            break;
 
         case ARGP_KEY_ARG:
-            argp_usage(state);
+            if (arg[0] != '@') {
+                argp_usage(state);
+            } else if (!read_response_file(args, &arg[1])) {
+                fprintf(stderr, "Could not open response file %s.\n\n", &arg[1]);
+                argp_usage(state);
+            }
+
             break;
         case ARGP_KEY_END:
-            if (!args->input_file) {
+            if (args->compact && args->line_markers) {
+                fprintf(stderr, "Cannot write linemarkers into compact output.\n\n");
+                argp_usage(state);
+            } else if (args->server && args->connect) {
+                fprintf(stderr, "Cannot serve and connect to a server at the same time.\n\n");
+                argp_usage(state);
+            } else if (args->shutdown && !args->connect) {
+                fprintf(stderr, "Cannot shut down a server without connecting to it.\n\n");
+                argp_usage(state);
+            } else if ((args->server || args->shutdown) && (args->input_count || args->output_file)) {
+                fprintf(stderr, "Cannot specify input or output files for a server.\n\n");
+                argp_usage(state);
+            } else if ((args->server || args->connect) &&
+                       (args->dependencies || args->dependencies_only || args->dependency_file)) {
+                fprintf(stderr, "Cannot write dependencies through a server.\n\n");
+                argp_usage(state);
+            } else if (args->connect && (args->compact || args->line_markers)) {
+                fprintf(stderr, "Cannot change the output format of a server.\n\n");
+                argp_usage(state);
+            } else if (args->connect && args->macro_count) {
+                fprintf(stderr, "Cannot define macros for a server.\n\n");
+                argp_usage(state);
+            } else if ((args->server || args->connect) && args->manifest) {
+                fprintf(stderr, "Cannot reuse outputs through a server.\n\n");
+                argp_usage(state);
+            } else if (args->server || args->shutdown) {
+                break;
+            }
+
+            // Unchanged headers of changed translation units are not tokenized again either
+            if (args->manifest && !args->token_store) {
+                args->token_store = args->manifest;
+            }
+
+            if (!args->input_count) {
                 fprintf(stderr, "No input file specified.\n\n");
                 argp_usage(state);
-            } else {
-                size_t length = strlen(args->input_file);
+            }
 
-                if (length <= 2 || args->input_file[length - 2] != '.' || args->input_file[length - 1] != 'c') {
+            for (int i = 0; i < args->input_count; i++) {
+                size_t length = strlen(args->input_files[i]);
+
+                if (length <= 2 || args->input_files[i][length - 2] != '.' || args->input_files[i][length - 1] != 'c') {
                     fprintf(stderr, "Wrong C input file format (\"*.c\" expected).\n\n");
                     argp_usage(state);
                 }
+            }
 
-                if (!args->output_file) {
-                    args->output_file = malloc((length + 1) * (sizeof *args->output_file));
-                    strcpy(args->output_file, args->input_file);
-                    args->output_file[length - 1] = 'o';
-                }
+            if (args->input_count > 1 && args->output_file) {
+                fprintf(stderr, "Cannot specify an output file with multiple input files.\n\n");
+                argp_usage(state);
+            } else if (args->dependency_file && !args->dependencies && !args->dependencies_only) {
+                fprintf(stderr, "Cannot specify a dependency file without -M or -MD.\n\n");
+                argp_usage(state);
+            } else if (args->dependencies && args->dependencies_only) {
+                fprintf(stderr, "Cannot specify both -M and -MD.\n\n");
+                argp_usage(state);
+            } else if (args->dependencies && args->dependency_file && args->input_count > 1) {
+                fprintf(stderr, "Cannot specify a dependency file for -MD with multiple input files.\n\n");
+                argp_usage(state);
+            }
+
+            // Without a dependency file, '-M' writes the rules where the output would go
+            if (args->dependencies_only && !args->dependency_file) {
+                args->dependency_file = args->output_file ? args->output_file : "-";
+            }
+
+            if (!args->output_file && args->input_count == 1) {
+                args->output_file = default_output_file(args->input_files[0]);
             }
 
             if (args->verbose && args->quiet) {
@@ -103,7 +402,19 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state) {
 }
 
 /**
- * Verbose version of printf. Writes formatted output to stdout only if ACTIVE argument is true.
+ * Decides where to write the program's messages to.
+ *
+ * @return stderr if the preprocessed output (or the '-M' rules) is written to stdout, stdout otherwise.
+ */
+static FILE *message_stream(void) {
+    const char *file_name = args->dependencies_only ? args->dependency_file : args->output_file;
+
+    return (file_name && strcmp(file_name, "-") == 0) ? stderr : stdout;
+}
+
+/**
+ * Verbose version of printf. Writes formatted output to stdout only if VERBOSE argument is true. Writes to stderr
+ * instead if the preprocessed output goes to stdout.
  *
  * Adapted from StackOverflow answer:
  * https://stackoverflow.com/a/36096037/7353602
@@ -119,14 +430,15 @@ int verbose_printf(const char *restrict format, ...) {
 
     va_list ap;
     va_start(ap, format);
-    int ret = vprintf(format, ap);
+    int ret = vfprintf(message_stream(), format, ap);
     va_end(ap);
 
     return ret;
 }
 
 /**
- * Quiet version of printf. Writes formatted output to stdout only if QUIET argument is false.
+ * Quiet version of printf. Writes formatted output to stdout only if QUIET argument is false. Writes to stderr
+ * instead if the preprocessed output goes to stdout.
  *
  * Adapted from StackOverflow answer:
  * https://stackoverflow.com/a/36096037/7353602
@@ -142,20 +454,46 @@ int normal_printf(const char *restrict format, ...) {
 
     va_list ap;
     va_start(ap, format);
-    int ret = vprintf(format, ap);
+    int ret = vfprintf(message_stream(), format, ap);
     va_end(ap);
 
     return ret;
 }
 
 /**
- * Parses the option strings into global arguments array ARGS.
+ * Parses the option strings into global arguments array ARGS, which is read-only afterwards.
  *
  * @param argc Argument count.
  * @param argv Argument vector.
  */
 void args_parse(int argc, char **argv) {
-    struct argp argp = {options, parse_opt, 0, doc};
-    args = calloc(1, sizeof *args);
-    argp_parse(&argp, argc, argv, 0, 0, args);
+    struct argp argp = {options, parse_opt, args_doc, doc};
+    Arguments *parsed = calloc(1, sizeof *parsed);
+
+    if (!parsed) {
+        fprintf(stderr, "Could not allocate enough memory.");
+        exit(EXIT_FAILURE);
+    }
+
+    parsed->jobs = 1;
+    args = parsed;
+
+    // ARGP only has single letter short options, so GCC's '-MD' and '-MF' are turned into long ones
+    for (int i = 1; i < argc && strcmp(argv[i], "--") != 0; i++) {
+        if (strcmp(argv[i], "-MD") == 0) {
+            argv[i] = "--MD";
+        } else if (strncmp(argv[i], "-MF", 3) == 0) {
+            char *option = malloc(strlen(argv[i]) + 3);
+
+            if (!option) {
+                fprintf(stderr, "Could not allocate enough memory.");
+                exit(EXIT_FAILURE);
+            }
+
+            sprintf(option, argv[i][3] ? "--MF=%s" : "--MF", &argv[i][3]);
+            argv[i] = option;
+        }
+    }
+
+    argp_parse(&argp, argc, argv, 0, 0, parsed);
 }
@@ -1,20 +1,85 @@
 #ifndef TCPP_ARGS_H
 #define TCPP_ARGS_H
 
+/**
+ * Stores the configuration of a run. It is only written while the arguments are parsed and read by all the threads
+ * afterwards.
+ *
+ * INPUT_FILES are the translation units to preprocess, JOBS the number of threads preprocessing them and PREFETCH the
+ * number of threads reading included headers ahead. OUTPUT_FILE is only set if there is a single input file, the other
+ * ones have their output placed next to them. STREAM makes the output be written while preprocessing.
+ *
+ * The output keeps the tokens at their lines and columns in the source files, unless COMPACT ('-P') leaves out the
+ * blank lines and extra spaces, or LINE_MARKERS replaces the jumps between files and far lines by GCC-style
+ * linemarkers (see layout.h).
+ *
+ * Included headers are searched for in INCLUDE_DIRS ('-I') and then in SYSTEM_DIRS ('--isystem'). LIST_DIRS makes the
+ * search read the directories' listings.
+ *
+ * MACROS are the '-D' and '-U' options in their order, as they would be written ("-D<macro>[=<value>]", "-U<macro>").
+ * They are applied to the predefined macros (see predefined.h).
+ *
+ * TOKEN_STORE is the directory in which the tokens of headers are kept between runs, NULL if they are not kept.
+ * MANIFEST is the directory in which the files opened by each translation unit are recorded, so that the output of
+ * translation units whose files have not changed is reused (see manifest.h). It is the token store too if there is no
+ * other one.
+ *
+ * SERVER is the socket on which to serve requests instead of preprocessing input files (see server.h), CONNECT the
+ * socket of a server to which to send them instead. SHUTDOWN requests the server to stop.
+ *
+ * STATS makes the run record phase timings and counters (see stats.h), written into STATS_FILE as JSON or to stderr if
+ * it is NULL. TRACE_FILE is the file into which to write a timeline of the run (see trace.h), NULL for none.
+ *
+ * DEPENDENCIES ('-MD') makes a Makefile rule listing the files opened by each translation unit be written into
+ * DEPENDENCY_FILE ('-MF'), or next to the output file if it is NULL (see depend.h). DEPENDENCIES_ONLY ('-M') only
+ * follows the includes to write the rules into DEPENDENCY_FILE ("-" for stdout), without writing any output.
+ */
 typedef struct Arguments {
     int verbose;
     int quiet;
 
     int keep_comments;
+    int compact;
+    int line_markers;
+    int stream;
+    int jobs;
+    int prefetch;
 
-    char *input_file;
+    char **input_files;
+    int input_count;
     char *output_file;
+
+    char **include_dirs;
+    int include_count;
+    char **system_dirs;
+    int system_count;
+    int list_dirs;
+
+    char **macros;
+    int macro_count;
+
+    char *token_store;
+    char *manifest;
+
+    char *server;
+    char *connect;
+    int shutdown;
+
+    int stats;
+    char *stats_file;
+    char *trace_file;
+
+    int dependencies;
+    int dependencies_only;
+    char *dependency_file;
 } Arguments;
 
-Arguments *args;
+extern const Arguments *args;
 
 void args_parse(int argc, char **argv);
 
+char *default_output_file(const char *input_file);
+
 int verbose_printf(const char *restrict format, ...);
 int normal_printf(const char *restrict format, ...);
 
@@ -0,0 +1,134 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "depend.h"
+
+/**
+ * The column after which a dependency rule is continued on the next line, the same as GCC's.
+ */
+static const size_t max_rule_column = 72;
+
+/**
+ * Replaces the extension of a file name (or appends one if there is none).
+ *
+ * @param file_name The file name.
+ * @param extension The new extension, including the '.'.
+ * @return A newly allocated file name.
+ */
+static char *replace_extension(const char *file_name, const char *extension) {
+    const char *slash = strrchr(file_name, '/');
+    const char *dot = strrchr(slash ? slash + 1 : file_name, '.');
+    size_t length = dot ? (size_t) (dot - file_name) : strlen(file_name);
+    char *result = malloc(length + strlen(extension) + 1);
+
+    if (!result) {
+        fprintf(stderr, "Could not allocate enough memory.");
+        exit(EXIT_FAILURE);
+    }
+
+    memcpy(result, file_name, length);
+    strcpy(&result[length], extension);
+
+    return result;
+}
+
+/**
+ * Makes the target of the dependency rule of an input file, which is the object file compiled from it: the input
+ * file's base name with the "c" extension replaced by "o".
+ *
+ * @param input_file The location of a "*.c" input file.
+ * @return A newly allocated target name.
+ */
+char *dependency_target(const char *input_file) {
+    const char *slash = strrchr(input_file, '/');
+
+    return replace_extension(slash ? slash + 1 : input_file, ".o");
+}
+
+/**
+ * Makes the name of the file into which '-MD' writes the dependency rule of an input file, which is the output file's
+ * name with its extension replaced by "d". The input file's name is used instead if the output goes to stdout.
+ *
+ * @param output_file The location of the output file, "-" for stdout.
+ * @param input_file The location of the input file.
+ * @return A newly allocated file name.
+ */
+char *dependency_file(const char *output_file, const char *input_file) {
+    return replace_extension(strcmp(output_file, "-") == 0 ? input_file : output_file, ".d");
+}
+
+/**
+ * Writes a file name into a rule, escaping the characters which make has a meaning for: '$' is doubled, spaces and
+ * '#' are preceded by a backslash. The rule is continued on the next line if the name does not fit on the current one.
+ *
+ * @param writer The writer to which to write.
+ * @param name The file name.
+ * @param column The current column of the rule, advanced accordingly.
+ */
+static void write_rule_name(Writer *writer, const char *name, size_t *column) {
+    size_t length = strlen(name);
+
+    for (const char *ch = name; *ch; ch++) {
+        length += *ch == '$' || *ch == ' ' || *ch == '\t' || *ch == '#';
+    }
+
+    if (*column) {
+        if (*column + length > max_rule_column) {
+            writer_write(writer, " \\\n", 3);
+            *column = 0;
+        }
+
+        writer_write(writer, " ", 1);
+        (*column)++;
+    }
+
+    for (const char *ch = name; *ch; ch++) {
+        if (*ch == '$') {
+            writer_write(writer, "$", 1);
+        } else if (*ch == ' ' || *ch == '\t' || *ch == '#') {
+            writer_write(writer, "\\", 1);
+        }
+
+        writer_write(writer, ch, 1);
+    }
+
+    *column += length;
+}
+
+/**
+ * Writes a Makefile rule making a target depend on a list of files, in the same format as GCC's '-M'. Files listed
+ * more than once only appear the first time.
+ *
+ * @param writer The writer to which to write.
+ * @param target The target of the rule.
+ * @param files The files on which the target depends, starting with the input file.
+ */
+void write_dependency_rule(Writer *writer, const char *target, const FileList *files) {
+    unsigned int max_file = 0;
+
+    for (unsigned int i = 0; i < files->count; i++) {
+        max_file = files->files[i] > max_file ? files->files[i] : max_file;
+    }
+
+    unsigned char *is_written = calloc((size_t) max_file + 1, sizeof *is_written);
+
+    if (!is_written) {
+        fprintf(stderr, "Could not allocate enough memory.");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t column = 0;
+    write_rule_name(writer, target, &column);
+    writer_write(writer, ":", 1);
+    column++;
+
+    for (unsigned int i = 0; i < files->count; i++) {
+        if (!is_written[files->files[i]]) {
+            is_written[files->files[i]] = 1;
+            write_rule_name(writer, file_table_name(files->files[i]), &column);
+        }
+    }
+
+    writer_write(writer, "\n", 1);
+    free(is_written);
+}
@@ -0,0 +1,13 @@
+#ifndef TCPP_DEPEND_H
+#define TCPP_DEPEND_H
+
+#include "file.h"
+#include "writer.h"
+
+char *dependency_target(const char *input_file);
+
+char *dependency_file(const char *output_file, const char *input_file);
+
+void write_dependency_rule(Writer *writer, const char *target, const FileList *files);
+
+#endif //TCPP_DEPEND_H
@@ -0,0 +1,500 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <inttypes.h>
+#include "file.h"
+#include "expression.h"
+
+/**
+ * Combines two characters into the code of a two-character operator.
+ */
+#define OPERATOR(ch1, ch2) (((ch1) << 8) | (ch2))
+
+/**
+ * Stores the state of evaluating an expression.
+ *
+ * IS_EVALUATED is cleared in the operands which are not evaluated (the right side of '&&' and '||', one side of
+ * '?:'), so that errors like division by zero are not reported for them.
+ */
+typedef struct Expression {
+    Token *token;
+    Location location;
+
+    int is_evaluated;
+    int has_failed;
+} Expression;
+
+/**
+ * Stores a value of an expression. The arithmetic of #if expressions is done in intmax_t and uintmax_t (C99 6.10.1),
+ * so the value is kept as the bits of a uintmax_t, which are read as an intmax_t unless IS_UNSIGNED is set.
+ */
+typedef struct Value {
+    uintmax_t bits;
+    int is_unsigned;
+} Value;
+
+/**
+ * The number of bits of a value, by which it cannot be shifted.
+ */
+#define VALUE_WIDTH (sizeof(uintmax_t) * CHAR_BIT)
+
+static Value evaluate_conditional(Expression *expression);
+
+/**
+ * Makes a signed value.
+ *
+ * @param value The value.
+ * @return The value as a Value.
+ */
+static Value signed_value(intmax_t value) {
+    return (Value) {(uintmax_t) value, 0};
+}
+
+/**
+ * Reports an error in an expression. Only the first error is reported.
+ *
+ * @param expression The expression in which the error occurred.
+ * @param message The error's message.
+ */
+static void report_error(Expression *expression, const char *message) {
+    if (!expression->has_failed) {
+        fprintf(stderr, "%s:%d: %s in #if expression.\n", file_table_name(expression->location.file),
+                expression->location.line, message);
+    }
+
+    expression->has_failed = 1;
+}
+
+/**
+ * Peeks the next operator of an expression. The tokenizer splits operators into single characters, so adjacent ones
+ * are combined into two-character operators ('&&', '<=', etc.).
+ *
+ * @param expression The expression from which to peek.
+ * @param length Into which to store the number of tokens the operator consists of.
+ * @return The code of the operator, 0 if the next token is not an operator.
+ */
+static int peek_operator(const Expression *expression, int *length) {
+    const Token *token = expression->token;
+    *length = 1;
+
+    if (!token || !token->operator) {
+        return 0;
+    }
+
+    const Token *next = token->next;
+    int code = OPERATOR(token->operator, next ? next->operator : 0);
+
+    if (next && same_line(token->location, next->location) &&
+        next->location.column == token->location.column + token->width) {
+        switch (code) {
+            case OPERATOR('|', '|'):
+            case OPERATOR('&', '&'):
+            case OPERATOR('=', '='):
+            case OPERATOR('!', '='):
+            case OPERATOR('<', '='):
+            case OPERATOR('>', '='):
+            case OPERATOR('<', '<'):
+            case OPERATOR('>', '>'):
+                *length = 2;
+                return code;
+            default:
+                break;
+        }
+    }
+
+    return token->operator;
+}
+
+/**
+ * Skips a given number of tokens of an expression.
+ *
+ * @param expression The expression in which to skip.
+ * @param length The number of tokens to skip.
+ */
+static void skip_tokens(Expression *expression, int length) {
+    while (length-- && expression->token) {
+        expression->token = expression->token->next;
+    }
+}
+
+/**
+ * Evaluates an integer constant. It is unsigned with a 'u' suffix, or if it does not fit into an intmax_t (which GCC
+ * also does for decimal constants), the 'l' suffixes make no difference.
+ *
+ * @param expression The expression to which the constant belongs.
+ * @param token The token of the constant.
+ * @return The value of the constant.
+ */
+static Value evaluate_number(Expression *expression, const Token *token) {
+    Value zero = {0, 0};
+    char buffer[64];
+    int length = token->length;
+    int is_unsigned = 0;
+
+    while (length > 0 && strchr("uUlL", token->string[length - 1])) {
+        is_unsigned |= token->string[length - 1] == 'u' || token->string[length - 1] == 'U';
+        length--;
+    }
+
+    if (length <= 0 || length >= (int) sizeof buffer) {
+        report_error(expression, "Invalid integer constant");
+        return zero;
+    }
+
+    memcpy(buffer, token->string, (size_t) length);
+    buffer[length] = '\0';
+
+    char *end;
+    errno = 0;
+    uintmax_t value = strtoumax(buffer, &end, 0);
+
+    if (*end) {
+        report_error(expression, "Invalid integer constant");
+        return zero;
+    }
+
+    if (errno == ERANGE) {
+        report_error(expression, "Too large integer constant");
+        return zero;
+    }
+
+    return (Value) {value, is_unsigned || value > INTMAX_MAX};
+}
+
+/**
+ * Evaluates a character constant, also the constant of a wide one (L'a'). Only its first character (or escape
+ * sequence) is used.
+ *
+ * @param expression The expression to which the constant belongs.
+ * @param token The token of the constant.
+ * @return The value of the constant.
+ */
+static long long evaluate_character(Expression *expression, const Token *token) {
+    const char *string = token->string + 1;
+    const char *end = token->string + token->length;
+
+    if (string >= end || *string == '\'') {
+        report_error(expression, "Empty character constant");
+        return 0;
+    }
+
+    if (*string != '\\') {
+        return *string;
+    }
+
+    if (++string >= end) {
+        return '\\';
+    }
+
+    switch (*string) {
+        case 'a':
+            return '\a';
+        case 'b':
+            return '\b';
+        case 'f':
+            return '\f';
+        case 'n':
+            return '\n';
+        case 'r':
+            return '\r';
+        case 't':
+            return '\t';
+        case 'v':
+            return '\v';
+        case 'x':
+            return strtol(string + 1, NULL, 16);
+        default:
+            return (*string >= '0' && *string <= '7') ? strtol(string, NULL, 8) : *string;
+    }
+}
+
+/**
+ * Evaluates a primary expression (constant, identifier or parenthesized expression) together with its unary
+ * operators.
+ *
+ * @param expression The expression to evaluate.
+ * @return The value of the primary expression.
+ */
+static Value evaluate_unary(Expression *expression) {
+    Token *token = expression->token;
+    Value value = {0, 0};
+
+    if (!token) {
+        report_error(expression, "Missing operand");
+        return value;
+    }
+
+    expression->token = token->next;
+
+    switch (token->operator) {
+        case '+':
+            return evaluate_unary(expression);
+        case '-':
+            value = evaluate_unary(expression);
+            value.bits = 0 - value.bits;
+            return value;
+        case '~':
+            value = evaluate_unary(expression);
+            value.bits = ~value.bits;
+            return value;
+        case '!':
+            return signed_value(!evaluate_unary(expression).bits);
+
+        case '(':
+            value = evaluate_conditional(expression);
+
+            if (!expression->token || expression->token->operator != ')') {
+                report_error(expression, "Missing ')'");
+                return signed_value(0);
+            }
+
+            expression->token = expression->token->next;
+            return value;
+
+        default:
+            break;
+    }
+
+    if (token->is_number) {
+        return evaluate_number(expression, token);
+    }
+
+    if (token->string[0] == '\'') {
+        return signed_value(evaluate_character(expression, token));
+    }
+
+    // The tokenizer splits the prefix off wide character constants
+    if (token->length == 1 && token->string[0] == 'L' && token->next && token->next->string[0] == '\'' &&
+        !token->next->has_space) {
+        expression->token = token->next->next;
+        return signed_value(evaluate_character(expression, token->next));
+    }
+
+    // Identifiers which are left after macro expansion are replaced with 0
+    if (token->is_identifier) {
+        return value;
+    }
+
+    report_error(expression, "Unexpected token");
+    return value;
+}
+
+/**
+ * Gets the precedence of a binary operator.
+ *
+ * @param operator The code of the operator.
+ * @return The precedence of the operator (higher binds tighter), 0 if it is not a binary operator.
+ */
+static int binary_precedence(int operator) {
+    switch (operator) {
+        case '*':
+        case '/':
+        case '%':
+            return 10;
+        case '+':
+        case '-':
+            return 9;
+        case OPERATOR('<', '<'):
+        case OPERATOR('>', '>'):
+            return 8;
+        case '<':
+        case '>':
+        case OPERATOR('<', '='):
+        case OPERATOR('>', '='):
+            return 7;
+        case OPERATOR('=', '='):
+        case OPERATOR('!', '='):
+            return 6;
+        case '&':
+            return 5;
+        case '^':
+            return 4;
+        case '|':
+            return 3;
+        case OPERATOR('&', '&'):
+            return 2;
+        case OPERATOR('|', '|'):
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/**
+ * Applies a binary operator. Both operands are unsigned if one of them is (the usual arithmetic conversions), except
+ * for shifts, whose results have the type of their left operands. Comparisons and logical operators result in signed
+ * values.
+ *
+ * @param expression The expression to which the operator belongs.
+ * @param operator The code of the operator.
+ * @param left The left operand.
+ * @param right The right operand.
+ * @return The result.
+ */
+static Value apply_binary(Expression *expression, int operator, Value left, Value right) {
+    int is_unsigned = left.is_unsigned || right.is_unsigned;
+    uintmax_t a = left.bits, b = right.bits;
+    intmax_t signed_a = (intmax_t) a, signed_b = (intmax_t) b;
+
+    switch (operator) {
+        case '*':
+            return (Value) {a * b, is_unsigned};
+        case '/':
+        case '%':
+            if (b == 0) {
+                if (expression->is_evaluated) {
+                    report_error(expression, "Division by zero");
+                }
+                return (Value) {0, is_unsigned};
+            }
+            if (is_unsigned) {
+                return (Value) {operator == '/' ? a / b : a % b, 1};
+            }
+            if (signed_b == -1) {
+                return (Value) {operator == '/' ? 0 - a : 0, 0};
+            }
+            return signed_value(operator == '/' ? signed_a / signed_b : signed_a % signed_b);
+        case '+':
+            return (Value) {a + b, is_unsigned};
+        case '-':
+            return (Value) {a - b, is_unsigned};
+        case OPERATOR('<', '<'):
+        case OPERATOR('>', '>'): {
+            int is_out_of_range = right.is_unsigned ? b >= VALUE_WIDTH : signed_b < 0 || b >= VALUE_WIDTH;
+
+            if (operator == OPERATOR('<', '<')) {
+                return (Value) {is_out_of_range ? 0 : a << b, left.is_unsigned};
+            }
+
+            if (left.is_unsigned) {
+                return (Value) {is_out_of_range ? 0 : a >> b, 1};
+            }
+
+            return signed_value(is_out_of_range ? (signed_a < 0 ? -1 : 0) : signed_a >> b);
+        }
+        case '<':
+            return signed_value(is_unsigned ? a < b : signed_a < signed_b);
+        case '>':
+            return signed_value(is_unsigned ? a > b : signed_a > signed_b);
+        case OPERATOR('<', '='):
+            return signed_value(is_unsigned ? a <= b : signed_a <= signed_b);
+        case OPERATOR('>', '='):
+            return signed_value(is_unsigned ? a >= b : signed_a >= signed_b);
+        case OPERATOR('=', '='):
+            return signed_value(a == b);
+        case OPERATOR('!', '='):
+            return signed_value(a != b);
+        case '&':
+            return (Value) {a & b, is_unsigned};
+        case '^':
+            return (Value) {a ^ b, is_unsigned};
+        case '|':
+            return (Value) {a | b, is_unsigned};
+        case OPERATOR('&', '&'):
+            return signed_value(a && b);
+        default:
+            return signed_value(a || b);
+    }
+}
+
+/**
+ * Evaluates a chain of binary operators, which bind at least as tight as a given precedence.
+ *
+ * @param expression The expression to evaluate.
+ * @param precedence The minimal precedence of the operators.
+ * @return The value of the chain.
+ */
+static Value evaluate_binary(Expression *expression, int precedence) {
+    Value left = evaluate_unary(expression);
+    int length;
+    int operator;
+
+    while (binary_precedence(operator = peek_operator(expression, &length)) >= precedence &&
+           binary_precedence(operator) > 0) {
+        skip_tokens(expression, length);
+
+        // The right side of '&&' and '||' is not evaluated if the left one decides the result
+        int is_evaluated = expression->is_evaluated;
+        if ((operator == OPERATOR('&', '&') && !left.bits) || (operator == OPERATOR('|', '|') && left.bits)) {
+            expression->is_evaluated = 0;
+        }
+
+        Value right = evaluate_binary(expression, binary_precedence(operator) + 1);
+        expression->is_evaluated = is_evaluated;
+
+        left = apply_binary(expression, operator, left, right);
+    }
+
+    return left;
+}
+
+/**
+ * Evaluates a conditional ('?:') expression. Its value is unsigned if either of its operands is.
+ *
+ * @param expression The expression to evaluate.
+ * @return The value of the conditional expression.
+ */
+static Value evaluate_conditional(Expression *expression) {
+    Value condition = evaluate_binary(expression, 1);
+    int length;
+
+    if (peek_operator(expression, &length) != '?') {
+        return condition;
+    }
+
+    skip_tokens(expression, length);
+
+    int is_evaluated = expression->is_evaluated;
+
+    expression->is_evaluated = is_evaluated && condition.bits;
+    Value left = evaluate_conditional(expression);
+
+    if (peek_operator(expression, &length) != ':') {
+        report_error(expression, "Missing ':'");
+        return signed_value(0);
+    }
+
+    skip_tokens(expression, length);
+
+    expression->is_evaluated = is_evaluated && !condition.bits;
+    Value right = evaluate_conditional(expression);
+    expression->is_evaluated = is_evaluated;
+
+    Value value = condition.bits ? left : right;
+    value.is_unsigned = left.is_unsigned || right.is_unsigned;
+
+    return value;
+}
+
+/**
+ * Evaluates the integer constant expression of an #if or #elif directive. Macros have to be expanded and 'defined'
+ * operators replaced in advance.
+ *
+ * Arithmetic is done in intmax_t and uintmax_t (see Value). Errors are reported, and make the expression evaluate to 0.
+ *
+ * @param tokens The tokens of the expression, terminated by a NULL next pointer.
+ * @param location The location of the directive.
+ * @param is_true Set to 1 if the value of the expression is non-zero, 0 otherwise.
+ * @return 1 if successful, 0 if an error has been reported.
+ */
+int evaluate_expression(Token *tokens, Location location, int *is_true) {
+    Expression expression = {tokens, location, 1, 0};
+    *is_true = 0;
+
+    if (!tokens) {
+        report_error(&expression, "Missing expression");
+        return 0;
+    }
+
+    Value value = evaluate_conditional(&expression);
+
+    if (expression.token) {
+        report_error(&expression, "Missing binary operator");
+    }
+
+    *is_true = !expression.has_failed && value.bits != 0;
+
+    return !expression.has_failed;
+}
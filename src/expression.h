@@ -0,0 +1,8 @@
+#ifndef TCPP_EXPRESSION_H
+#define TCPP_EXPRESSION_H
+
+#include "token.h"
+
+int evaluate_expression(Token *tokens, Location location, int *is_true);
+
+#endif //TCPP_EXPRESSION_H
@@ -0,0 +1,126 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "file.h"
+
+FileTable *file_table;
+
+/**
+ * Initializes the global file table FILE_TABLE.
+ */
+void file_table_init(void) {
+    file_table = calloc(1, sizeof *file_table);
+
+    if (!file_table || !(file_table->map = new_hash_map(0x100, 0x5bd1e995))) {
+        fprintf(stderr, "Could not allocate enough memory.");
+        exit(EXIT_FAILURE);
+    }
+
+    file_table->arena = new_arena();
+    pthread_rwlock_init(&file_table->lock, NULL);
+
+    // Reserve id 0 (FILE_NONE) for locations which are not in any file
+    file_table->capacity = 0x100;
+    file_table->names = malloc(file_table->capacity * sizeof *file_table->names);
+
+    if (!file_table->names) {
+        fprintf(stderr, "Could not allocate enough memory.");
+        exit(EXIT_FAILURE);
+    }
+
+    file_table->names[FILE_NONE] = "";
+    file_table->count = 1;
+}
+
+/**
+ * Adds a file name into the global file table. Safe to be called from multiple threads at once.
+ *
+ * @param file_name The name of the file to add. It is copied if it has not been added before.
+ * @return The id of the file, the same for every occurrence of the name.
+ */
+unsigned int file_table_add(const char *file_name) {
+    unsigned int length = (unsigned int) strlen(file_name);
+    unsigned int hash = hash_map_hash(file_table->map, file_name, length);
+
+    pthread_rwlock_rdlock(&file_table->lock);
+    void *id = hash_map_get_hashed_key(file_table->map, file_name, length, hash);
+    pthread_rwlock_unlock(&file_table->lock);
+
+    if (id) {
+        return (unsigned int) (uintptr_t) id;
+    }
+
+    pthread_rwlock_wrlock(&file_table->lock);
+
+    // Another thread might have added the file in the meantime
+    if ((id = hash_map_get_hashed_key(file_table->map, file_name, length, hash))) {
+        pthread_rwlock_unlock(&file_table->lock);
+        return (unsigned int) (uintptr_t) id;
+    }
+
+    if (file_table->count >= file_table->capacity) {
+        file_table->capacity *= 2;
+        file_table->names = realloc(file_table->names, file_table->capacity * sizeof *file_table->names);
+
+        if (!file_table->names) {
+            fprintf(stderr, "Could not allocate enough memory.");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    unsigned int file = file_table->count++;
+    const char *name = file_table->names[file] = arena_strndup(file_table->arena, file_name, length);
+
+    hash_map_insert_hashed_key(file_table->map, name, length, hash, (void *) (uintptr_t) file);
+    pthread_rwlock_unlock(&file_table->lock);
+
+    return file;
+}
+
+/**
+ * Gets the name of a file in the global file table. Safe to be called from multiple threads at once.
+ *
+ * @param file The id of the file.
+ * @return The name of the file, an empty string for FILE_NONE. Stays valid until the program exits.
+ */
+const char *file_table_name(unsigned int file) {
+    pthread_rwlock_rdlock(&file_table->lock);
+    const char *name = file_table->names[file];
+    pthread_rwlock_unlock(&file_table->lock);
+
+    return name;
+}
+
+/**
+ * Appends a file id to a file list, growing it geometrically.
+ *
+ * @param list The list to append to.
+ * @param file The id of the file.
+ */
+void file_list_append(FileList *list, unsigned int file) {
+    if (list->count >= list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 0x10;
+        list->files = realloc(list->files, list->capacity * sizeof *list->files);
+
+        if (!list->files) {
+            fprintf(stderr, "Could not allocate enough memory.");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    list->files[list->count++] = file;
+}
+
+/**
+ * Frees the content of a file list, leaving it empty.
+ *
+ * @param list The list to clear.
+ */
+void file_list_clear(FileList *list) {
+    free(list->files);
+
+    list->files = NULL;
+    list->count = 0;
+    list->capacity = 0;
+}
@@ -0,0 +1,53 @@
+#ifndef TCPP_FILE_H
+#define TCPP_FILE_H
+
+#include <pthread.h>
+#include "hashmap.h"
+#include "arena.h"
+
+/**
+ * The file id of locations which are not in any file.
+ */
+#define FILE_NONE 0
+
+/**
+ * Stores the names of all the files which have been tokenized. A file's id is its index in the NAMES array, so that
+ * locations only need to store a 32-bit id instead of a pointer to the name.
+ *
+ * The table is shared by all the threads. LOCK is held for reading while looking a file up and for writing while adding
+ * one.
+ */
+typedef struct FileTable {
+    HashMap *map;
+    Arena *arena;
+
+    const char **names;
+    unsigned int count;
+    unsigned int capacity;
+
+    pthread_rwlock_t lock;
+} FileTable;
+
+/**
+ * Stores a list of file ids, e.g. the files opened while preprocessing a translation unit, in the order they were
+ * opened.
+ */
+typedef struct FileList {
+    unsigned int *files;
+    unsigned int count;
+    unsigned int capacity;
+} FileList;
+
+extern FileTable *file_table;
+
+void file_table_init(void);
+
+unsigned int file_table_add(const char *file_name);
+
+const char *file_table_name(unsigned int file);
+
+void file_list_append(FileList *list, unsigned int file);
+
+void file_list_clear(FileList *list);
+
+#endif //TCPP_FILE_H
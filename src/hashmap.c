@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <string.h>
 #include "hashmap.h"
+#include "stats.h"
 
 /**
  * 'm' and 'r' are mixing constants generated offline.
@@ -30,7 +31,8 @@ static unsigned int murmur_hash(const void *key, unsigned int length, unsigned i
 
     // Mix 4 bytes at a time into the hash
     while (length >= 4) {
-        unsigned int k = *(unsigned int *) data;
+        unsigned int k;
+        memcpy(&k, data, sizeof k);
 
         k *= m;
         k ^= k >> r;
@@ -63,22 +65,54 @@ static unsigned int murmur_hash(const void *key, unsigned int length, unsigned i
     return h;
 }
 
+/**
+ * The load factor (in percent) above which a hash map grows.
+ */
+static const unsigned int max_load = 75;
+
+/**
+ * Allocates the entries of a hash map.
+ *
+ * @param hash_map A hash map for which to allocate the entries.
+ * @param size The number of entries to allocate. Has to be a power of 2.
+ * @return 1 if successful, 0 otherwise.
+ */
+static int hash_map_allocate(HashMap *hash_map, unsigned int size) {
+    HashMapEntry *entries = calloc((size_t) size, sizeof *entries);
+
+    if (!entries) {
+        return 0;
+    }
+
+    hash_map->size = size;
+    hash_map->count = 0;
+    hash_map->entries = entries;
+
+    return 1;
+}
+
 /**
  * Generates a new hash map.
  *
- * @param size Size of the hash map. Bigger hash maps have less collisions.
+ * @param size Initial size of the hash map, rounded up to a power of 2. The hash map grows as keys are inserted.
  * @param seed Hash map hash function seed.
  * @return A newly generated hash map.
  */
 HashMap *new_hash_map(unsigned int size, unsigned int seed) {
     HashMap *hash_map = malloc(sizeof *hash_map);
 
-    hash_map->size = size;
-    hash_map->seed = seed;
+    if (!hash_map) {
+        return NULL;
+    }
 
-    hash_map->map = calloc((size_t) size, sizeof *(hash_map->map));
+    unsigned int capacity = 1;
+    while (capacity < size) {
+        capacity <<= 1u;
+    }
+
+    hash_map->seed = seed;
 
-    if (!hash_map->map) {
+    if (!hash_map_allocate(hash_map, capacity)) {
         free(hash_map);
         return NULL;
     }
@@ -89,51 +123,224 @@ HashMap *new_hash_map(unsigned int size, unsigned int seed) {
 /**
  * Deletes a hash map and frees the memory allocated to it.
  *
+ * The keys and the values are owned by the caller and are not freed.
+ *
  * @param hash_map A hash map to delete.
  */
 void delete_hash_map(HashMap *hash_map) {
-    for (unsigned int i = 0; i < hash_map->size; i++) {
-        if (hash_map->map[i]) {
-            free(hash_map->map[i]);
-        }
-    }
-
-    free(hash_map->map);
+    free(hash_map->entries);
     free(hash_map);
 }
 
 /**
  * Generates a hash value of a given key in a given hash map.
  *
+ * The hash can be passed to the "*_hashed_key" functions to avoid hashing the same key again.
+ *
  * @param hash_map A hash map in which to generate the hash.
  * @param key A key for which to generate the hash.
+ * @param length The length of the key.
  * @return The generated hash.
  */
-static unsigned int hash_map_hash(HashMap *hash_map, const char *key) {
-    return murmur_hash(key, (int) strlen(key), hash_map->seed) % hash_map->size;
+unsigned int hash_map_hash(const HashMap *hash_map, const char *key, unsigned int length) {
+    return murmur_hash(key, length, hash_map->seed);
+}
+
+/**
+ * Calculates how far an entry is from its preferred slot.
+ *
+ * @param hash_map The hash map to which the entry belongs.
+ * @param hash The hash of the entry.
+ * @param index The slot which the entry occupies.
+ * @return The probe distance of the entry.
+ */
+static unsigned int hash_map_distance(const HashMap *hash_map, unsigned int hash, unsigned int index) {
+    return (index - hash) & (hash_map->size - 1);
+}
+
+/**
+ * Finds the slot of a given key in a hash map.
+ *
+ * @param hash_map A hash map in which to search.
+ * @param key A key to search for.
+ * @param length The length of the key.
+ * @param hash The hash of the key.
+ * @return The slot of the key, -1 if the key is not in the hash map.
+ */
+static long hash_map_find(const HashMap *hash_map, const char *key, unsigned int length, unsigned int hash) {
+    unsigned int mask = hash_map->size - 1;
+    unsigned int index = hash & mask, distance = 0;
+    long found = -1;
+
+    for (;; index = (index + 1) & mask, distance++) {
+        HashMapEntry *entry = &hash_map->entries[index];
+
+        // Robin Hood invariant: the key would have displaced any entry closer to its preferred slot
+        if (!entry->key || hash_map_distance(hash_map, entry->hash, index) < distance) {
+            break;
+        }
+
+        if (entry->hash == hash && entry->length == length && memcmp(entry->key, key, length) == 0) {
+            found = index;
+            break;
+        }
+    }
+
+    stats_add(COUNTER_HASH_LOOKUPS, 1);
+    stats_add(COUNTER_HASH_PROBES, distance + 1);
+    stats_add(COUNTER_HASH_HITS, found >= 0);
+
+    return found;
+}
+
+/**
+ * Moves all the entries of a hash map into a bigger allocation.
+ *
+ * @param hash_map A hash map to grow.
+ * @return 1 if successful, 0 otherwise.
+ */
+static int hash_map_grow(HashMap *hash_map) {
+    HashMapEntry *entries = hash_map->entries;
+    unsigned int size = hash_map->size;
+
+    if (!hash_map_allocate(hash_map, size * 2)) {
+        return 0;
+    }
+
+    for (unsigned int i = 0; i < size; i++) {
+        if (entries[i].key) {
+            hash_map_insert_hashed_key(hash_map, entries[i].key, entries[i].length, entries[i].hash,
+                                       entries[i].value);
+        }
+    }
+
+    free(entries);
+
+    return 1;
+}
+
+/**
+ * Inserts the value to a given key in a hash map. Replaces the previous value of the key, if there is one.
+ *
+ * The key is not copied and has to outlive the hash map.
+ *
+ * @param hash_map A hash map to insert the value in.
+ * @param key A key of the value to be inserted.
+ * @param length The length of the key.
+ * @param hash The hash of the key, as generated by hash_map_hash.
+ * @param value The value to insert.
+ */
+void hash_map_insert_hashed_key(HashMap *hash_map, const char *key, unsigned int length, unsigned int hash,
+                                void *value) {
+    long found = hash_map_find(hash_map, key, length, hash);
+
+    if (found >= 0) {
+        hash_map->entries[found].value = value;
+        return;
+    }
+
+    if ((hash_map->count + 1) * 100 > hash_map->size * max_load && !hash_map_grow(hash_map)) {
+        fprintf(stderr, "Could not allocate enough memory.");
+        exit(EXIT_FAILURE);
+    }
+
+    HashMapEntry entry = {key, length, hash, value};
+    unsigned int mask = hash_map->size - 1;
+
+    for (unsigned int index = hash & mask, distance = 0;; index = (index + 1) & mask, distance++) {
+        HashMapEntry *slot = &hash_map->entries[index];
+
+        if (!slot->key) {
+            *slot = entry;
+            break;
+        }
+
+        // Take the slot from an entry which is closer to its preferred slot and carry on inserting that one instead
+        unsigned int slot_distance = hash_map_distance(hash_map, slot->hash, index);
+        if (slot_distance < distance) {
+            HashMapEntry displaced = *slot;
+            *slot = entry;
+            entry = displaced;
+            distance = slot_distance;
+        }
+    }
+
+    hash_map->count++;
 }
 
 /**
- * Inserts the value to a given key in a hash map.
+ * Inserts the value to a given key in a hash map. Replaces the previous value of the key, if there is one.
+ *
+ * The key is not copied and has to outlive the hash map.
  *
  * @param hash_map A hash map to insert the value in.
  * @param key A key of the value to be inserted.
+ * @param length The length of the key.
  * @param value The value to insert.
  */
-void hash_map_insert_key(HashMap *hash_map, const char *key, void *value) {
-    hash_map->map[hash_map_hash(hash_map, key)] = value;
+void hash_map_insert_key(HashMap *hash_map, const char *key, unsigned int length, void *value) {
+    hash_map_insert_hashed_key(hash_map, key, length, hash_map_hash(hash_map, key, length), value);
 }
 
 /**
- * Deletes the value of a given key in a hash map.
+ * Deletes the value of a given key in a hash map. The value itself is not freed.
  *
  * @param hash_map A hash map from which to delete the value from.
  * @param key A key of the value to be deleted.
+ * @param length The length of the key.
+ * @param hash The hash of the key, as generated by hash_map_hash.
  */
-void hash_map_delete_key(HashMap *hash_map, const char *key) {
-    unsigned int index = hash_map_hash(hash_map, key);
-    free(hash_map->map[index]);
-    hash_map->map[index] = NULL;
+void hash_map_delete_hashed_key(HashMap *hash_map, const char *key, unsigned int length, unsigned int hash) {
+    long found = hash_map_find(hash_map, key, length, hash);
+
+    if (found < 0) {
+        return;
+    }
+
+    // Shift the following entries back until one is found in its preferred slot
+    unsigned int mask = hash_map->size - 1;
+    unsigned int index = (unsigned int) found;
+
+    for (;;) {
+        unsigned int next = (index + 1) & mask;
+        HashMapEntry *entry = &hash_map->entries[next];
+
+        if (!entry->key || hash_map_distance(hash_map, entry->hash, next) == 0) {
+            break;
+        }
+
+        hash_map->entries[index] = *entry;
+        index = next;
+    }
+
+    memset(&hash_map->entries[index], 0, sizeof hash_map->entries[index]);
+    hash_map->count--;
+}
+
+/**
+ * Deletes the value of a given key in a hash map. The value itself is not freed.
+ *
+ * @param hash_map A hash map from which to delete the value from.
+ * @param key A key of the value to be deleted.
+ * @param length The length of the key.
+ */
+void hash_map_delete_key(HashMap *hash_map, const char *key, unsigned int length) {
+    hash_map_delete_hashed_key(hash_map, key, length, hash_map_hash(hash_map, key, length));
+}
+
+/**
+ * Retrieves the value of a given key in a hash map.
+ *
+ * @param hash_map A hash map from which to retrieve the value from.
+ * @param key A key of the value to be retrieved.
+ * @param length The length of the key.
+ * @param hash The hash of the key, as generated by hash_map_hash.
+ * @return The value of a given key, NULL if there is none.
+ */
+void *hash_map_get_hashed_key(const HashMap *hash_map, const char *key, unsigned int length, unsigned int hash) {
+    long found = hash_map_find(hash_map, key, length, hash);
+
+    return found < 0 ? NULL : hash_map->entries[found].value;
 }
 
 /**
@@ -141,8 +348,9 @@ void hash_map_delete_key(HashMap *hash_map, const char *key) {
  *
  * @param hash_map A hash map from which to retrieve the value from.
  * @param key A key of the value to be retrieved.
- * @return The value of a given key.
+ * @param length The length of the key.
+ * @return The value of a given key, NULL if there is none.
  */
-void *hash_map_get_key(HashMap *hash_map, const char *key) {
-    return hash_map->map[hash_map_hash(hash_map, key)];
+void *hash_map_get_key(const HashMap *hash_map, const char *key, unsigned int length) {
+    return hash_map_get_hashed_key(hash_map, key, length, hash_map_hash(hash_map, key, length));
 }
@@ -1,21 +1,45 @@
 #ifndef TCPP_HASHMAP_H
 #define TCPP_HASHMAP_H
 
+/**
+ * Stores a single key-value pair of a hash map, together with the key's hash.
+ */
+typedef struct HashMapEntry {
+    const char *key;
+    unsigned int length;
+    unsigned int hash;
+
+    void *value;
+} HashMapEntry;
+
+/**
+ * Stores information about an open-addressing (Robin Hood) hash map.
+ */
 typedef struct HashMap {
     unsigned int size;
+    unsigned int count;
     unsigned int seed;
 
-    void **map;
+    HashMapEntry *entries;
 } HashMap;
 
 HashMap *new_hash_map(unsigned int size, unsigned int seed);
 
 void delete_hash_map(HashMap *hash_map);
 
-void hash_map_insert_key(HashMap *hash_map, const char *key, void *value);
+unsigned int hash_map_hash(const HashMap *hash_map, const char *key, unsigned int length);
 
-void hash_map_delete_key(HashMap *hash_map, const char *key);
+void hash_map_insert_key(HashMap *hash_map, const char *key, unsigned int length, void *value);
 
-void *hash_map_get_key(HashMap *hash_map, const char *key);
+void hash_map_insert_hashed_key(HashMap *hash_map, const char *key, unsigned int length, unsigned int hash,
+                                void *value);
+
+void hash_map_delete_key(HashMap *hash_map, const char *key, unsigned int length);
+
+void hash_map_delete_hashed_key(HashMap *hash_map, const char *key, unsigned int length, unsigned int hash);
+
+void *hash_map_get_key(const HashMap *hash_map, const char *key, unsigned int length);
+
+void *hash_map_get_hashed_key(const HashMap *hash_map, const char *key, unsigned int length, unsigned int hash);
 
 #endif //TCPP_HASHMAP_H
@@ -0,0 +1,533 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "header.h"
+#include "tokenizer.h"
+#include "symbol.h"
+#include "file.h"
+#include "stats.h"
+#include "scan.h"
+#include "store.h"
+#include "args.h"
+
+/**
+ * Stores an include whose header is to be found and loaded on the prefetch pool of a header cache. Includes with quotes
+ * keep the DIRECTORY of the including file, in which they are searched for first, system includes an empty one.
+ */
+typedef struct Prefetch {
+    HeaderCache *cache;
+    const char *name;
+    size_t name_length;
+    const char *directory;
+    int is_system;
+    unsigned int epoch;
+} Prefetch;
+
+/**
+ * Generates a new, empty header cache.
+ *
+ * @param search The include search with which included headers are found.
+ * @param prefetch_threads The number of threads loading included headers ahead, 0 not to prefetch them.
+ * @return A newly generated header cache.
+ */
+HeaderCache *new_header_cache(IncludeSearch *search, int prefetch_threads) {
+    HeaderCache *cache = calloc(1, sizeof *cache);
+
+    if (!cache || !(cache->map = new_hash_map(64, 0x2f693b51)) || !(cache->names = new_hash_map(64, 0x2f693b51)) ||
+        !(cache->prefetched = new_hash_map(64, 0x2f693b51))) {
+        fprintf(stderr, "Could not allocate enough memory.");
+        exit(EXIT_FAILURE);
+    }
+
+    cache->arena = new_arena();
+    cache->search = search;
+    pthread_mutex_init(&cache->lock, NULL);
+    pthread_cond_init(&cache->loaded, NULL);
+
+    if (prefetch_threads > 0) {
+        cache->prefetch_pool = new_thread_pool(prefetch_threads);
+    }
+
+    return cache;
+}
+
+/**
+ * Deletes a header cache together with all the headers in it.
+ *
+ * @param cache A header cache to delete.
+ */
+void delete_header_cache(HeaderCache *cache) {
+    // Let the prefetches still running finish first
+    if (cache->prefetch_pool) {
+        delete_thread_pool(cache->prefetch_pool);
+    }
+
+    for (unsigned int i = 0; i < cache->count; i++) {
+        Header *header = cache->headers[i];
+
+        if (header->tokens) {
+            delete_token_list(header->tokens);
+        }
+
+        pthread_mutex_destroy(&header->lock);
+        free(header->file_name);
+        free(header->path);
+        free(header);
+    }
+
+    for (unsigned int i = 0; i < cache->retired_count; i++) {
+        delete_token_list(cache->retired[i]);
+    }
+
+    delete_hash_map(cache->map);
+    delete_hash_map(cache->names);
+    delete_hash_map(cache->prefetched);
+    delete_arena(cache->arena);
+    pthread_mutex_destroy(&cache->lock);
+    pthread_cond_destroy(&cache->loaded);
+    free(cache->headers);
+    free(cache->retired);
+    free(cache);
+}
+
+/**
+ * Checks if a header still is the same file it was when it was read.
+ *
+ * @param header The header to be checked.
+ * @param info The current status of the header's file.
+ * @return 1 if it is, 0 otherwise.
+ */
+static int header_is_current(const Header *header, const struct stat *info) {
+    return header->tokens &&
+           header->device == info->st_dev && header->inode == info->st_ino && header->size == info->st_size &&
+           header->modified.tv_sec == info->st_mtim.tv_sec && header->modified.tv_nsec == info->st_mtim.tv_nsec;
+}
+
+/**
+ * Adds a new header to a header cache.
+ *
+ * @param cache A header cache to which to add the header.
+ * @param file_name The name from which the header is opened.
+ * @param path The canonical path of the header. Taken over by the header.
+ * @return A newly generated header (without tokens).
+ */
+static Header *header_cache_add(HeaderCache *cache, const char *file_name, char *path) {
+    if (cache->count == cache->capacity) {
+        cache->capacity = cache->capacity ? cache->capacity * 2 : 64;
+        cache->headers = realloc(cache->headers, cache->capacity * sizeof *cache->headers);
+    }
+
+    Header *header = calloc(1, sizeof *header);
+
+    if (!cache->headers || !header) {
+        fprintf(stderr, "Could not allocate enough memory.");
+        exit(EXIT_FAILURE);
+    }
+
+    header->id = cache->count;
+    header->file_name = strdup(file_name);
+    header->path = path;
+    header->file = file_table_add(file_name);
+    pthread_mutex_init(&header->lock, NULL);
+
+    cache->headers[cache->count++] = header;
+    hash_map_insert_key(cache->map, header->path, (unsigned int) strlen(header->path), header);
+
+    return header;
+}
+
+/**
+ * Finds a header which has been retrieved from a header cache by the exact same file name before, without accessing
+ * the file system. The header's file is not checked for changes again within the same epoch. If another thread is
+ * reading the header again, waits for that instead.
+ *
+ * @param cache A header cache in which to search.
+ * @param file_name The location of the header's file.
+ * @return The header with its tokens, NULL if it has not been retrieved by this name in the current epoch yet.
+ */
+Header *header_cache_find(HeaderCache *cache, const char *file_name) {
+    pthread_mutex_lock(&cache->lock);
+    Header *header = hash_map_get_key(cache->names, file_name, (unsigned int) strlen(file_name));
+
+    while (header && header->is_loading) {
+        pthread_cond_wait(&cache->loaded, &cache->lock);
+    }
+
+    if (header && (header->epoch != cache->epoch || !header->tokens)) {
+        header = NULL;
+    } else if (header) {
+        cache->hits++;
+    }
+
+    pthread_mutex_unlock(&cache->lock);
+
+    return header;
+}
+
+/**
+ * Keeps the token list of a header which has changed until the cache is deleted, as other translation units might
+ * still be reading it.
+ *
+ * @param cache The header cache of the header.
+ * @param tokens The token list to be retired.
+ */
+static void header_cache_retire(HeaderCache *cache, TokenList *tokens) {
+    if ((cache->retired_count & (cache->retired_count - 1)) == 0) {
+        unsigned int capacity = cache->retired_count ? cache->retired_count * 2 : 1;
+        cache->retired = realloc(cache->retired, capacity * sizeof *cache->retired);
+
+        if (!cache->retired) {
+            fprintf(stderr, "Could not allocate enough memory.");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    cache->retired[cache->retired_count++] = tokens;
+}
+
+/**
+ * Retrieves a header from a header cache. The header is read and tokenized if it is not in the cache yet, or if its
+ * file has changed since it was read. Safe to be called from multiple threads at once. If another thread is reading
+ * the header already (e.g. prefetching it), waits for that instead.
+ *
+ * @param cache A header cache from which to retrieve the header.
+ * @param file_name The location of the header's file.
+ * @return The header, NULL if its file could not be opened.
+ */
+Header *header_cache_get(HeaderCache *cache, const char *file_name) {
+    struct stat info;
+    char *path;
+
+    if (stat(file_name, &info) != 0 || !(path = realpath(file_name, NULL))) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    Header *header = hash_map_get_key(cache->map, path, (unsigned int) strlen(path));
+
+    if (header) {
+        free(path);
+
+        while (header->is_loading) {
+            pthread_cond_wait(&cache->loaded, &cache->lock);
+        }
+
+        if (header_is_current(header, &info)) {
+            header->epoch = cache->epoch;
+            cache->hits++;
+            pthread_mutex_unlock(&cache->lock);
+            return header;
+        }
+
+        // The file has changed, drop its old tokens
+        if (header->tokens) {
+            header_cache_retire(cache, header->tokens);
+            header->tokens = NULL;
+        }
+    } else {
+        header = header_cache_add(cache, file_name, path);
+    }
+
+    // Remember the name for header_cache_find
+    unsigned int name_length = (unsigned int) strlen(file_name);
+    if (!hash_map_get_key(cache->names, file_name, name_length)) {
+        char *name = arena_strndup(cache->arena, file_name, name_length);
+        hash_map_insert_key(cache->names, name, name_length, header);
+    }
+
+    cache->misses++;
+    header->is_loading = 1;
+
+    pthread_mutex_lock(&header->lock);
+    header->guard = SYMBOL_NONE;
+    header->is_once = 0;
+    pthread_mutex_unlock(&header->lock);
+
+    // Read the file without holding the lock, so that other headers can be read in the meantime
+    pthread_mutex_unlock(&cache->lock);
+
+    // Loading the tokens from the token store counts as tokenizing
+    StatsPhase phase = stats_enter(PHASE_TOKENIZE);
+    Arena *arena = new_arena();
+    TokenList *tokens = args->token_store ? store_load(args->token_store, header, &info, arena) : NULL;
+    int is_stored = tokens != NULL;
+
+    if (!tokens) {
+        tokens = tokenize_file(header->file_name, arena);
+    }
+
+    stats_leave(phase);
+
+    if (!tokens) {
+        delete_arena(arena);
+    }
+
+    pthread_mutex_lock(&cache->lock);
+
+    if (tokens) {
+        header->device = info.st_dev;
+        header->inode = info.st_ino;
+        header->size = info.st_size;
+        header->modified = info.st_mtim;
+        header->tokens = tokens;
+        header->is_stored = is_stored;
+        header->epoch = cache->epoch;
+    }
+
+    header->is_loading = 0;
+    pthread_cond_broadcast(&cache->loaded);
+    pthread_mutex_unlock(&cache->lock);
+
+    return tokens ? header : NULL;
+}
+
+static void prefetch_includes(HeaderCache *cache, const Source *source);
+
+static void prefetch_stored_includes(HeaderCache *cache, const TokenList *list);
+
+/**
+ * Checks if a header has been retrieved from a header cache by a file name in the current epoch already, so that its
+ * includes have been prefetched as well.
+ *
+ * @param cache The header cache to check.
+ * @param file_name The location of the header's file.
+ * @return 1 if it has, 0 otherwise.
+ */
+static int is_name_retrieved(HeaderCache *cache, const char *file_name) {
+    pthread_mutex_lock(&cache->lock);
+    Header *header = hash_map_get_key(cache->names, file_name, (unsigned int) strlen(file_name));
+    int is_retrieved = header && header->epoch == cache->epoch;
+    pthread_mutex_unlock(&cache->lock);
+
+    return is_retrieved;
+}
+
+/**
+ * Finds and loads the header of an include on the prefetch pool, then prefetches the headers it includes in turn.
+ *
+ * @param argument The prefetch to run.
+ */
+static void run_prefetch(void *argument) {
+    StatsPhase phase = stats_enter(PHASE_INCLUDE);
+    const Prefetch *prefetch = argument;
+    HeaderCache *cache = prefetch->cache;
+    char *file_name = include_search_resolve(cache->search, prefetch->directory, prefetch->name, prefetch->name_length,
+                                             prefetch->is_system, NULL);
+    Header *header = file_name && !is_name_retrieved(cache, file_name) ? header_cache_get(cache, file_name) : NULL;
+
+    if (header && header->is_stored) {
+        prefetch_stored_includes(cache, header->tokens);
+    } else if (header) {
+        prefetch_includes(cache, header->tokens->sources);
+    }
+
+    free(file_name);
+    stats_leave(phase);
+}
+
+/**
+ * Starts finding and loading the header of an include on the prefetch pool of a header cache, unless the same include
+ * has been requested before in the current epoch. The include is not resolved here, so that the preprocessing thread
+ * does not access the file system.
+ *
+ * @param cache The header cache into which to load the header.
+ * @param including_file The location of the including file.
+ * @param name The header's name (without quotes or angle brackets).
+ * @param name_length The length of the name.
+ * @param is_system 1 if the header is included with angle brackets, 0 if it is included with quotes.
+ */
+static void request_prefetch(HeaderCache *cache, const char *including_file, const char *name, size_t name_length,
+                             int is_system) {
+    const char *separator = is_system ? NULL : strrchr(including_file, '/');
+    size_t directory_length = separator ? (size_t) (separator - including_file) + 1 : 0;
+
+    // The key is the kind of the include and its name, followed by the directory searched first after a '\0'
+    unsigned int length = (unsigned int) (name_length + directory_length + 2);
+    char *key = malloc(length + 1);
+
+    if (!key) {
+        fprintf(stderr, "Could not allocate enough memory.");
+        exit(EXIT_FAILURE);
+    }
+
+    key[0] = is_system ? '<' : '"';
+    memcpy(&key[1], name, name_length);
+    key[name_length + 1] = '\0';
+    memcpy(&key[name_length + 2], including_file, directory_length);
+    key[length] = '\0';
+
+    pthread_mutex_lock(&cache->lock);
+    Prefetch *prefetch = hash_map_get_key(cache->prefetched, key, length);
+
+    if (prefetch && prefetch->epoch == cache->epoch) {
+        pthread_mutex_unlock(&cache->lock);
+        free(key);
+        return;
+    }
+
+    // A prefetch from an earlier epoch is submitted again, only its epoch changes
+    if (!prefetch) {
+        char *copy = arena_alloc(cache->arena, length + 1);
+        memcpy(copy, key, length + 1);
+
+        prefetch = arena_alloc(cache->arena, sizeof *prefetch);
+        prefetch->cache = cache;
+        prefetch->name = &copy[1];
+        prefetch->name_length = name_length;
+        prefetch->directory = &copy[name_length + 2];
+        prefetch->is_system = is_system;
+        hash_map_insert_key(cache->prefetched, copy, length, prefetch);
+    }
+
+    prefetch->epoch = cache->epoch;
+
+    pthread_mutex_unlock(&cache->lock);
+    free(key);
+
+    thread_pool_submit(cache->prefetch_pool, run_prefetch, prefetch);
+}
+
+/**
+ * Scans a source for '#include "..."' and '#include <...>' lines and requests their headers to be prefetched. This is
+ * only a hint, so comments, conditionals and line continuations are not taken into account.
+ *
+ * @param cache The header cache into which to prefetch.
+ * @param source The source to scan.
+ */
+static void prefetch_includes(HeaderCache *cache, const Source *source) {
+    const char *end = source->data + source->size;
+
+    for (const char *line = source->data; line < end;) {
+        const char *line_end = memchr(line, '\n', (size_t) (end - line));
+        if (!line_end) {
+            line_end = end;
+        }
+
+        const char *cursor = scan_skip_blanks(line, line_end);
+        line = line_end + 1;
+
+        if (cursor == line_end || *cursor != '#') {
+            continue;
+        }
+
+        cursor = scan_skip_blanks(cursor + 1, line_end);
+
+        if (line_end - cursor < 8 || memcmp(cursor, "include", 7) != 0) {
+            continue;
+        }
+
+        cursor = scan_skip_blanks(cursor + 7, line_end);
+
+        if (cursor == line_end || (*cursor != '"' && *cursor != '<')) {
+            continue;
+        }
+
+        int is_system = *cursor == '<';
+        const char *close = memchr(cursor + 1, is_system ? '>' : '"', (size_t) (line_end - cursor - 1));
+
+        if (close) {
+            request_prefetch(cache, source->file_name, cursor + 1, (size_t) (close - cursor - 1), is_system);
+        }
+    }
+}
+
+/**
+ * Finds the include directives of a token list loaded from the token store and requests their headers to be
+ * prefetched. Such a list has no source to scan, but it is tokenized in full.
+ *
+ * @param cache The header cache into which to prefetch.
+ * @param list The token list.
+ */
+static void prefetch_stored_includes(HeaderCache *cache, const TokenList *list) {
+    for (const Token *token = list->front_token; token; token = token->next) {
+        const Token *name = token->next;
+
+        if (!token->is_directive || token->symbol != SYMBOL_INCLUDE || !name || name->length < 2 ||
+            !is_on_line(name, token->location) || (name->string[0] != '"' && name->string[0] != '<')) {
+            continue;
+        }
+
+        request_prefetch(cache, file_table_name(name->location.file), &name->string[1], (size_t) name->length - 2,
+                         name->string[0] == '<');
+    }
+}
+
+/**
+ * Starts loading the headers included by a token list's file ahead, on the prefetch pool of a header cache. Does
+ * nothing if the cache has no prefetch pool.
+ *
+ * @param cache The header cache into which to prefetch.
+ * @param list A token list straight from tokenize_file.
+ */
+void header_cache_prefetch(HeaderCache *cache, const TokenList *list) {
+    if (cache->prefetch_pool && list->sources) {
+        prefetch_includes(cache, list->sources);
+    }
+}
+
+/**
+ * Starts a new epoch of a header cache, so that the files of its headers are checked for changes again. The paths
+ * remembered by the cache's include search are checked as well.
+ *
+ * @param cache The header cache to revalidate.
+ */
+void header_cache_revalidate(HeaderCache *cache) {
+    pthread_mutex_lock(&cache->lock);
+    cache->epoch++;
+    pthread_mutex_unlock(&cache->lock);
+
+    include_search_revalidate(cache->search);
+}
+
+/**
+ * Deletes the retired token lists of a header cache. Must not be called while the cache is in use.
+ *
+ * @param cache The header cache to purge.
+ */
+void header_cache_purge(HeaderCache *cache) {
+    // Prefetches still running might be reading the lists
+    if (cache->prefetch_pool) {
+        thread_pool_wait(cache->prefetch_pool);
+    }
+
+    pthread_mutex_lock(&cache->lock);
+
+    for (unsigned int i = 0; i < cache->retired_count; i++) {
+        delete_token_list(cache->retired[i]);
+    }
+
+    free(cache->retired);
+    cache->retired = NULL;
+    cache->retired_count = 0;
+
+    pthread_mutex_unlock(&cache->lock);
+}
+
+/**
+ * Saves the tokens of all the headers which have not been loaded from the token store into it. Must not be called
+ * while the cache is in use.
+ *
+ * @param cache The header cache whose headers to save.
+ * @param directory The directory of the token store.
+ */
+void header_cache_store(HeaderCache *cache, const char *directory) {
+    if (cache->prefetch_pool) {
+        thread_pool_wait(cache->prefetch_pool);
+    }
+
+    for (unsigned int i = 0; i < cache->count; i++) {
+        Header *header = cache->headers[i];
+
+        if (!header->tokens || header->is_stored) {
+            continue;
+        }
+
+        if (store_save(directory, header)) {
+            header->is_stored = 1;
+            verbose_printf("Saved tokens of %s to the token store.\n", header->file_name);
+        } else {
+            fprintf(stderr, "Could not save tokens of %s to the token store.\n", header->file_name);
+        }
+    }
+}
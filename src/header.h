@@ -0,0 +1,109 @@
+#ifndef TCPP_HEADER_H
+#define TCPP_HEADER_H
+
+#include <sys/types.h>
+#include <time.h>
+#include <pthread.h>
+#include "hashmap.h"
+#include "token.h"
+#include "pool.h"
+#include "search.h"
+
+/**
+ * Stores a header file which has been read, together with its pristine (not preprocessed) tokens.
+ *
+ * FILE_NAME is the name from which the header was first opened and FILE its id in the file table, used in the tokens'
+ * locations. PATH is the canonical path of the header, which identifies it together with its device and inode. The size
+ * and modification time show if the header has to be read again.
+ *
+ * GUARD is the symbol of the header's include guard macro (SYMBOL_NONE if it has none) and IS_ONCE is set if the
+ * header contains '#pragma once'. Both are found while preprocessing the header and allow skipping it on inclusion
+ * without even opening it.
+ *
+ * The tokens are shared by all the translation units including the header. LOCK is held while their gaps are
+ * tokenized or skipped and while GUARD and IS_ONCE are accessed. IS_LOADING is set while the header's file is being
+ * opened and read by one thread, the other ones wait for it instead of opening the file as well.
+ *
+ * IS_STORED is set if the tokens have been loaded from the token store (or saved into it), so that they do not have to
+ * be saved again. EPOCH is the epoch of the cache in which the header's file was last checked for changes.
+ */
+typedef struct Header {
+    unsigned int id;
+
+    char *file_name;
+    char *path;
+    unsigned int file;
+
+    dev_t device;
+    ino_t inode;
+    off_t size;
+    struct timespec modified;
+
+    TokenList *tokens;
+
+    unsigned int guard;
+    int is_once;
+
+    int is_loading;
+    int is_stored;
+    unsigned int epoch;
+    pthread_mutex_t lock;
+} Header;
+
+/**
+ * Stores information about all the headers read so far, indexed by their canonical paths. NAMES indexes the same
+ * headers by the file names they have been opened from.
+ *
+ * The cache is shared by all the threads and LOCK is held while it is accessed, but not while files are read. LOADED is
+ * signalled whenever a header has finished loading. The old token lists of headers which have changed are RETIRED
+ * instead of deleted, as other translation units might still be reading them.
+ *
+ * If the cache has a PREFETCH_POOL, the includes of the files being preprocessed are found by scanning the files
+ * ahead, and their headers are resolved with SEARCH and loaded on the pool's threads in the meantime. PREFETCHED holds
+ * the includes requested so far.
+ *
+ * A cache kept between runs (see server.h) starts a new EPOCH for every run, after which every header is checked for
+ * changes again the first time it is retrieved.
+ */
+typedef struct HeaderCache {
+    HashMap *map;
+    HashMap *names;
+    Arena *arena;
+
+    Header **headers;
+    unsigned int count;
+    unsigned int capacity;
+
+    TokenList **retired;
+    unsigned int retired_count;
+
+    unsigned int hits;
+    unsigned int misses;
+
+    IncludeSearch *search;
+    ThreadPool *prefetch_pool;
+    HashMap *prefetched;
+
+    unsigned int epoch;
+
+    pthread_mutex_t lock;
+    pthread_cond_t loaded;
+} HeaderCache;
+
+HeaderCache *new_header_cache(IncludeSearch *search, int prefetch_threads);
+
+void delete_header_cache(HeaderCache *cache);
+
+Header *header_cache_find(HeaderCache *cache, const char *file_name);
+
+Header *header_cache_get(HeaderCache *cache, const char *file_name);
+
+void header_cache_prefetch(HeaderCache *cache, const TokenList *list);
+
+void header_cache_revalidate(HeaderCache *cache);
+
+void header_cache_purge(HeaderCache *cache);
+
+void header_cache_store(HeaderCache *cache, const char *directory);
+
+#endif //TCPP_HEADER_H
@@ -0,0 +1,157 @@
+#include <stdio.h>
+#include "layout.h"
+#include "args.h"
+#include "stats.h"
+
+/**
+ * The number of lines up to which line breaks move the output to a later line with '--line_markers', the same as
+ * GCC's. The output jumps further lines with a linemarker instead.
+ */
+static const int max_line_breaks = 8;
+
+/**
+ * Writes a GCC-style linemarker, which makes the next line of the output be a given line of a file.
+ *
+ * @param writer The writer through which to write.
+ * @param file The file.
+ * @param line The line.
+ * @param flag 1 if the file is entered by an include, 2 if it is returned to from one, 0 otherwise.
+ */
+static void write_line_marker(Writer *writer, unsigned int file, int line, int flag) {
+    char number[16];
+    int length = snprintf(number, sizeof number, "# %d \"", line);
+
+    writer_write(writer, number, (size_t) length);
+
+    for (const char *ch = file_table_name(file); *ch; ch++) {
+        if (*ch == '\\' || *ch == '\"') {
+            writer_fill(writer, '\\', 1);
+        }
+
+        writer_write(writer, ch, 1);
+    }
+
+    writer_write(writer, flag == 1 ? "\" 1\n" : flag == 2 ? "\" 2\n" : "\"\n", flag ? 4 : 2);
+}
+
+/**
+ * Writes the linemarker of a layout entering a file, telling whether an include has been entered or returned from.
+ *
+ * @param layout The layout through which to write.
+ * @param location The location in the file at which it is entered.
+ */
+static void enter_file(Layout *layout, Location location) {
+    FileList *includes = &layout->includes;
+    unsigned int depth = includes->count;
+
+    while (depth > 0 && includes->files[depth - 1] != location.file) {
+        depth--;
+    }
+
+    if (depth > 0) {
+        includes->count = depth;
+        write_line_marker(layout->writer, location.file, location.line, 2);
+    } else {
+        write_line_marker(layout->writer, location.file, location.line, includes->count ? 1 : 0);
+        file_list_append(includes, location.file);
+    }
+}
+
+/**
+ * Writes a token through a layout, preceded by the line breaks and spaces which move the output to its location.
+ *
+ * With '-P', blank lines are left out and the spaces between tokens are collapsed into one, dropping the indentation.
+ * A line break is only written once something has been written on the line, so includes leave no blank lines either.
+ * With '--line_markers', the spaces are collapsed after the indentation, and linemarkers follow the files and the long
+ * jumps between lines instead of line breaks.
+ *
+ * @param layout The layout through which to write.
+ * @param token The token to write.
+ */
+void layout_token(Layout *layout, const Token *token) {
+    Writer *writer = layout->writer;
+    Location *location = &layout->location;
+
+    // Linemarkers have to start a line of their own, unless nothing has been written on the current one yet
+    if (token->location.file != location->file) {
+        if (args->line_markers || args->compact ? location->column > 0 : location->line != 0) {
+            writer_fill(writer, '\n', 1);
+        }
+
+        *location = token->location;
+
+        if (args->line_markers) {
+            enter_file(layout, token->location);
+        }
+
+        if (args->compact || args->line_markers) {
+            location->column = 0;
+        }
+    }
+
+    if (token->location.line > location->line) {
+        int lines = token->location.line - location->line;
+
+        if (args->line_markers && lines > max_line_breaks) {
+            writer_fill(writer, '\n', (size_t) (location->column > 0));
+            write_line_marker(writer, token->location.file, token->location.line, 0);
+        } else {
+            writer_fill(writer, '\n', args->compact ? (size_t) (location->column > 0) : (size_t) lines);
+        }
+
+        location->line = token->location.line;
+        location->column = 0;
+    }
+
+    if (token->location.column > location->column) {
+        size_t spaces = (size_t) (token->location.column - location->column);
+
+        // Only the original layout keeps the spaces within lines, and only the linemarkers the indentation
+        if (location->column > 0 && (args->compact || args->line_markers)) {
+            spaces = 1;
+        } else if (args->compact) {
+            spaces = 0;
+        }
+
+        writer_fill(writer, ' ', spaces);
+
+        location->column = token->location.column;
+    } else if (token->has_space && location->column > 0) {
+        // Tokens of a macro expansion share their location, so only their own spacing separates them
+        writer_fill(writer, ' ', 1);
+    }
+
+    location->column += token->width;
+
+    if (token->length) {
+        writer_write(writer, token->string, (size_t) token->length);
+    }
+}
+
+/**
+ * Ends the output of a layout with a line break. The writer is not closed.
+ *
+ * @param layout The layout to finish.
+ */
+void layout_finish(Layout *layout) {
+    writer_fill(layout->writer, '\n', 1);
+    file_list_clear(&layout->includes);
+}
+
+/**
+ * Writes a token list through a writer, laying the tokens out at their locations in the source files.
+ *
+ * @param token_list A token list to write.
+ * @param writer The writer through which to write. Not closed.
+ */
+void write_token_list(const TokenList *token_list, Writer *writer) {
+    StatsPhase phase = stats_enter(PHASE_OUTPUT);
+    Layout layout = {writer};
+
+    for (Token *token = token_list->front_token; token; token = token->next) {
+        layout_token(&layout, token);
+    }
+
+    layout_finish(&layout);
+    stats_leave(phase);
+}
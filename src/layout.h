@@ -0,0 +1,27 @@
+#ifndef TCPP_LAYOUT_H
+#define TCPP_LAYOUT_H
+
+#include "token.h"
+#include "writer.h"
+#include "file.h"
+
+/**
+ * Stores the state of laying tokens out through a writer at their locations in the source files, one by one.
+ *
+ * LOCATION is the location in the source files up to which the output has been written, a zero location at the
+ * start. INCLUDES is the stack of files entered by the linemarkers ('--line_markers'). Layouts are initialized as
+ * {writer}.
+ */
+typedef struct Layout {
+    Writer *writer;
+    Location location;
+    FileList includes;
+} Layout;
+
+void layout_token(Layout *layout, const Token *token);
+
+void layout_finish(Layout *layout);
+
+void write_token_list(const TokenList *token_list, Writer *writer);
+
+#endif //TCPP_LAYOUT_H
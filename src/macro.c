@@ -0,0 +1,744 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "macro.h"
+#include "symbol.h"
+#include "file.h"
+
+/**
+ * Stores an argument of a function-like macro invocation.
+ *
+ * The argument is FRONT and the LENGTH - 1 tokens following it in the invocation. It is macro-expanded on its first
+ * use only, and EXPANDED reused by the further uses.
+ */
+typedef struct Argument {
+    Token *front;
+    int length;
+
+    Token *expanded;
+    int is_expanded;
+} Argument;
+
+/**
+ * Marks the base macros which a macro table has undefined.
+ */
+Macro undefined_macro;
+
+/**
+ * Deletes the memory allocated to the index of a macro table. The macros themselves are allocated from an arena.
+ *
+ * @param table A macro table to delete.
+ */
+void delete_macro_table(MacroTable *table) {
+    free(table->macros);
+
+    table->macros = NULL;
+    table->size = 0;
+}
+
+/**
+ * Maps a symbol to a macro.
+ *
+ * @param table A macro table into which to insert the macro.
+ * @param symbol The symbol id of the macro's name.
+ * @param macro The macro, NULL to undefine the symbol.
+ */
+void macro_table_set(MacroTable *table, unsigned int symbol, Macro *macro) {
+    // Base macros are shadowed instead
+    if (!macro && table->base && macro_table_get(table->base, symbol)) {
+        macro = &undefined_macro;
+    }
+
+    if (!macro && symbol >= table->size) {
+        return;
+    }
+
+    if (symbol >= table->size) {
+        unsigned int size = table->size ? table->size : 0x100;
+        while (size <= symbol) {
+            size *= 2;
+        }
+
+        table->macros = realloc(table->macros, size * sizeof *table->macros);
+
+        if (!table->macros) {
+            fprintf(stderr, "Could not allocate enough memory.");
+            exit(EXIT_FAILURE);
+        }
+
+        memset(&table->macros[table->size], 0, (size - table->size) * sizeof *table->macros);
+        table->size = size;
+    }
+
+    table->macros[symbol] = macro;
+}
+
+/**
+ * Generates a new, empty hide set with a given number of words.
+ *
+ * @param arena An arena from which to allocate the hide set.
+ * @param size The number of 64-bit words in the hide set.
+ * @return A newly generated hide set.
+ */
+static HideSet *new_hide_set(Arena *arena, unsigned int size) {
+    HideSet *hide_set = arena_alloc(arena, sizeof *hide_set + size * sizeof *hide_set->words);
+    hide_set->size = size;
+
+    return hide_set;
+}
+
+/**
+ * Generates a hide set with a symbol added to another hide set.
+ *
+ * @param arena An arena from which to allocate the hide set.
+ * @param hide_set The hide set to which to add the symbol.
+ * @param symbol The symbol id to add.
+ * @return The resulting hide set, HIDE_SET itself if it contains the symbol already.
+ */
+static HideSet *hide_set_add(Arena *arena, HideSet *hide_set, unsigned int symbol) {
+    if (hide_set_contains(hide_set, symbol)) {
+        return hide_set;
+    }
+
+    unsigned int size = hide_set ? hide_set->size : 0;
+    HideSet *result = new_hide_set(arena, size > symbol / 64 ? size : symbol / 64 + 1);
+
+    if (hide_set) {
+        memcpy(result->words, hide_set->words, size * sizeof *hide_set->words);
+    }
+
+    result->words[symbol / 64] |= 1ULL << (symbol % 64);
+
+    return result;
+}
+
+/**
+ * Generates the union of two hide sets.
+ *
+ * @param arena An arena from which to allocate the hide set.
+ * @param set1 The first hide set.
+ * @param set2 The second hide set.
+ * @return The resulting hide set, one of the given ones if the other one adds nothing to it.
+ */
+static HideSet *hide_set_union(Arena *arena, HideSet *set1, HideSet *set2) {
+    if (!set1 || set1 == set2) {
+        return set2;
+    }
+    if (!set2) {
+        return set1;
+    }
+
+    if (set1->size < set2->size) {
+        HideSet *set = set1;
+        set1 = set2;
+        set2 = set;
+    }
+
+    HideSet *result = new_hide_set(arena, set1->size);
+    memcpy(result->words, set1->words, set1->size * sizeof *set1->words);
+
+    for (unsigned int i = 0; i < set2->size; i++) {
+        result->words[i] |= set2->words[i];
+    }
+
+    return result;
+}
+
+/**
+ * Generates the intersection of two hide sets.
+ *
+ * @param arena An arena from which to allocate the hide set.
+ * @param set1 The first hide set.
+ * @param set2 The second hide set.
+ * @return The resulting hide set.
+ */
+static HideSet *hide_set_intersection(Arena *arena, HideSet *set1, HideSet *set2) {
+    if (!set1 || !set2 || set1 == set2) {
+        return set1 == set2 ? set1 : NULL;
+    }
+
+    unsigned int size = set1->size < set2->size ? set1->size : set2->size;
+
+    while (size && !(set1->words[size - 1] & set2->words[size - 1])) {
+        size--;
+    }
+
+    if (!size) {
+        return NULL;
+    }
+
+    HideSet *result = new_hide_set(arena, size);
+
+    for (unsigned int i = 0; i < size; i++) {
+        result->words[i] = set1->words[i] & set2->words[i];
+    }
+
+    return result;
+}
+
+/**
+ * Gets the token following a given one if it is on a given line.
+ *
+ * @param token The token.
+ * @param line A location on the line.
+ * @return The following token, NULL if there are no more tokens on the line.
+ */
+static Token *next_line_token(const Token *token, Location line) {
+    token = token_next(token);
+
+    return (token && !token->is_gap && is_on_line(token, line)) ? (Token *) token : NULL;
+}
+
+/**
+ * Checks if a token directly follows another one, with no whitespace in between.
+ *
+ * @param token The first token.
+ * @param next The token following it.
+ * @return 1 if it does, 0 otherwise.
+ */
+static int is_adjacent(const Token *token, const Token *next) {
+    return same_line(token->location, next->location) &&
+           next->location.column == token->location.column + token->width;
+}
+
+/**
+ * Checks if a token starts an ellipsis ('...'), which the tokenizer splits into separate '.' tokens.
+ *
+ * @param token The token to be checked.
+ * @param line A location on the line of the token.
+ * @return The last '.' of the ellipsis, NULL if there is none.
+ */
+static Token *read_ellipsis(Token *token, Location line) {
+    for (int i = 0; i < 2; i++) {
+        Token *next = next_line_token(token, line);
+
+        if (token->operator != '.' || !next || next->operator != '.' || !is_adjacent(token, next)) {
+            return NULL;
+        }
+
+        token = next;
+    }
+
+    return token;
+}
+
+/**
+ * Finds the index of a macro's parameter.
+ *
+ * @param macro The macro.
+ * @param parameters The symbol ids of the macro's parameters.
+ * @param token A token of the macro's replacement list.
+ * @return The index of the parameter the token names, -1 if it does not name one.
+ */
+static int parameter_index(const Macro *macro, const unsigned int *parameters, const Token *token) {
+    if (!macro->is_function || !token->is_identifier) {
+        return -1;
+    }
+
+    for (int i = 0; i < macro->parameter_count; i++) {
+        if (parameters[i] == token->symbol) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * Reports an error in a macro definition.
+ *
+ * @param token The token at which the error occurred.
+ * @param message The error's message.
+ * @return NULL.
+ */
+static Macro *macro_error(const Token *token, const char *message) {
+    fprintf(stderr, "%s:%d: %s.\n", file_table_name(token->location.file), token->location.line, message);
+
+    return NULL;
+}
+
+/**
+ * Generates a new macro from its definition, i.e. the tokens of a define directive following its '#' and 'define'.
+ *
+ * The parameter list is resolved and the replacement list copied into the arena, with the parameters, '#' and '##'
+ * operators classified in advance, so that expanding the macro needs no parsing.
+ *
+ * @param arena An arena from which to allocate the macro.
+ * @param name The name token of the macro.
+ * @param line A location on the line of the definition.
+ * @return A newly generated macro, NULL if the definition is invalid (the error is reported).
+ */
+Macro *new_macro(Arena *arena, Token *name, Location line) {
+    Macro *macro = arena_alloc(arena, sizeof *macro);
+    int capacity = 0;
+
+    for (Token *token = next_line_token(name, line); token; token = next_line_token(token, line)) {
+        capacity++;
+    }
+
+    unsigned int *parameters = arena_alloc(arena, (size_t) capacity * sizeof *parameters);
+    Token *token = next_line_token(name, line);
+
+    macro->name = name->symbol;
+    macro->location = name->location;
+
+    // Parameter list, only if '(' directly follows the name
+    if (token && token->operator == '(' && is_adjacent(name, token)) {
+        macro->is_function = 1;
+        token = next_line_token(token, line);
+
+        while (token && token->operator != ')') {
+            Token *ellipsis = read_ellipsis(token, line);
+
+            if (ellipsis) {
+                // Variable arguments ('...')
+                macro->is_variadic = 1;
+                parameters[macro->parameter_count++] = SYMBOL_VA_ARGS;
+                token = next_line_token(ellipsis, line);
+
+            } else if (token->is_identifier && token->symbol != SYMBOL_VA_ARGS) {
+                parameters[macro->parameter_count++] = token->symbol;
+                token = next_line_token(token, line);
+
+                // Named variable arguments ('name...')
+                if (token && (ellipsis = read_ellipsis(token, line))) {
+                    macro->is_variadic = 1;
+                    token = next_line_token(ellipsis, line);
+                }
+
+            } else {
+                return macro_error(token, "Expected parameter name in macro parameter list");
+            }
+
+            if (token && token->operator == ',' && !macro->is_variadic) {
+                token = next_line_token(token, line);
+            } else if (!token || token->operator != ')') {
+                return macro_error(name, "Missing ')' in macro parameter list");
+            }
+        }
+
+        if (!token) {
+            return macro_error(name, "Missing ')' in macro parameter list");
+        }
+
+        token = next_line_token(token, line);
+    }
+
+    // Replacement list
+    macro->body = arena_alloc(arena, (size_t) capacity * sizeof *macro->body);
+
+    for (; token; token = next_line_token(token, line)) {
+        Token *next = next_line_token(token, line);
+
+        if (token->operator == '#' && next && next->operator == '#' && is_adjacent(token, next)) {
+            // Token pasting ('##')
+            if (!macro->body_length || !next_line_token(next, line)) {
+                return macro_error(token, "'##' cannot appear at either end of a macro expansion");
+            }
+
+            macro->body[macro->body_length - 1].is_pasted = 1;
+            token = next;
+            continue;
+        }
+
+        MacroToken *entry = &macro->body[macro->body_length++];
+
+        if (macro->is_function && token->operator == '#') {
+            // Stringification ('#')
+            if (!next || parameter_index(macro, parameters, next) < 0) {
+                return macro_error(token, "'#' is not followed by a macro parameter");
+            }
+
+            entry->is_stringified = 1;
+            token = next;
+        }
+
+        // The token's string might not live as long as the macro (see start_chunk in preprocess.c)
+        entry->token = copy_token(arena, token);
+        entry->token->string = arena_strndup(arena, token->string, (size_t) token->length);
+        entry->token->is_directive = 0;
+        entry->parameter = parameter_index(macro, parameters, token);
+    }
+
+    return macro;
+}
+
+/**
+ * Finds the macro which a token invokes.
+ *
+ * @param table A macro table in which to search.
+ * @param token The token.
+ * @return The macro, NULL if the token is not a defined identifier or the macro is in the token's hide set.
+ */
+Macro *find_macro(const MacroTable *table, const Token *token) {
+    if (!token->is_identifier) {
+        return NULL;
+    }
+
+    Macro *macro = macro_table_get(table, token->symbol);
+
+    return (macro && !hide_set_contains(token->hide_set, token->symbol)) ? macro : NULL;
+}
+
+/**
+ * Copies a chain of tokens.
+ *
+ * @param arena An arena from which to allocate the copies.
+ * @param front The first token of the chain.
+ * @param length The number of tokens to copy, -1 to copy up to the end of the chain.
+ * @return The first token of the copied chain, NULL if it is empty.
+ */
+static Token *copy_tokens(Arena *arena, const Token *front, int length) {
+    Token head = {0};
+    Token *back = &head;
+
+    for (; front && length != 0; front = front->next, length--) {
+        back->next = copy_token(arena, front);
+        back = back->next;
+    }
+
+    return head.next;
+}
+
+/**
+ * Splits the arguments of a function-like macro invocation.
+ *
+ * @param macro The invoked macro.
+ * @param open_parenthesis The '(' token of the invocation.
+ * @param arguments An array into which to store the arguments (at least PARAMETER_COUNT + 1 long).
+ * @param count Into which to store the number of arguments.
+ * @return The ')' token of the invocation, NULL if there is none.
+ */
+static Token *split_arguments(const Macro *macro, Token *open_parenthesis, Argument *arguments, int *count) {
+    int depth = 0;
+    int index = 0;
+
+    for (Token *token = open_parenthesis->next; token; token = token->next) {
+        if (token->operator == '(') {
+            depth++;
+        } else if (token->operator == ')') {
+            if (depth == 0) {
+                *count = index + 1;
+                return token;
+            }
+
+            depth--;
+        } else if (token->operator == ',' && depth == 0 &&
+                   !(macro->is_variadic && index == macro->parameter_count - 1)) {
+            index++;
+            continue;
+        }
+
+        if (index <= macro->parameter_count) {
+            if (!arguments[index].front) {
+                arguments[index].front = token;
+            }
+
+            arguments[index].length++;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Turns an argument into a string literal. Whitespace between the argument's tokens becomes a single space, and '"'
+ * and '\' characters are escaped inside string and char literals.
+ *
+ * @param arena An arena from which to allocate the literal.
+ * @param argument The argument to be stringified.
+ * @param parameter The parameter token of the replacement list.
+ * @return A newly generated string literal token.
+ */
+static Token *stringify(Arena *arena, const Argument *argument, const Token *parameter) {
+    size_t length = 2;
+    const Token *token = argument->front;
+
+    for (int i = 0; i < argument->length; i++, token = token->next) {
+        length += 1 + 2 * (size_t) token->length;
+    }
+
+    char *string = arena_alloc(arena, length);
+    length = 0;
+    string[length++] = '\"';
+    token = argument->front;
+
+    for (int i = 0; i < argument->length; i++, token = token->next) {
+        int is_literal = token->string[0] == '\"' || token->string[0] == '\'';
+
+        if (i && token->has_space) {
+            string[length++] = ' ';
+        }
+
+        for (int j = 0; j < token->length; j++) {
+            if (is_literal && (token->string[j] == '\"' || token->string[j] == '\\')) {
+                string[length++] = '\\';
+            }
+
+            string[length++] = token->string[j];
+        }
+    }
+
+    string[length++] = '\"';
+
+    Token *result = copy_token(arena, parameter);
+    result->string = string;
+    result->length = (int) length;
+    result->hide_set = NULL;
+    set_token_flags(result);
+
+    return result;
+}
+
+/**
+ * Pastes two tokens together ('##').
+ *
+ * @param arena An arena from which to allocate the token.
+ * @param left The left token.
+ * @param right The right token.
+ * @return A newly generated token.
+ */
+static Token *paste_tokens(Arena *arena, const Token *left, const Token *right) {
+    char *string = arena_alloc(arena, (size_t) (left->length + right->length));
+
+    memcpy(string, left->string, (size_t) left->length);
+    memcpy(&string[left->length], right->string, (size_t) right->length);
+
+    Token *token = copy_token(arena, left);
+    token->string = string;
+    token->length = left->length + right->length;
+    token->hide_set = hide_set_intersection(arena, left->hide_set, right->hide_set);
+    set_token_flags(token);
+
+    return token;
+}
+
+/**
+ * Expands a single macro invocation.
+ *
+ * Arguments are macro-expanded before substitution unless they are stringified ('#') or pasted ('##'), and at most
+ * once no matter how often they are used. Every resulting token gets the macro's name added to its hide set, so that
+ * the macro is not expanded again when the result is rescanned. The result is placed at the location of the
+ * invocation and takes up its width.
+ *
+ * @param table The macro table of the translation unit.
+ * @param arena An arena from which to allocate the resulting tokens.
+ * @param macro The invoked macro.
+ * @param name The name token of the invocation.
+ * @param open_parenthesis The '(' token following the name of a function-like macro, NULL for object-like ones. The
+ *  arguments are the tokens following it up to the matching ')'.
+ * @return The first token of the resulting chain, NULL if it is empty or the invocation is invalid (the error is
+ *  reported).
+ */
+Token *expand_macro(const MacroTable *table, Arena *arena, Macro *macro, Token *name, Token *open_parenthesis) {
+    Argument *arguments = NULL;
+    Token *close_parenthesis = NULL;
+    HideSet *hide_set = name->hide_set;
+
+    if (macro->is_function) {
+        int count = 0;
+
+        arguments = arena_alloc(arena, (size_t) (macro->parameter_count + 1) * sizeof *arguments);
+        close_parenthesis = split_arguments(macro, open_parenthesis, arguments, &count);
+
+        if (!close_parenthesis) {
+            fprintf(stderr, "%s:%d: Unterminated argument list invoking macro '%.*s'.\n",
+                    file_table_name(name->location.file), name->location.line, name->length, name->string);
+            return NULL;
+        }
+
+        // A macro without parameters takes one empty argument, and the variable arguments may be left out
+        int is_valid = macro->parameter_count ? count == macro->parameter_count ||
+                                                (macro->is_variadic && count == macro->parameter_count - 1)
+                                              : count == 1 && !arguments[0].length;
+
+        if (!is_valid) {
+            fprintf(stderr, "%s:%d: Macro '%.*s' takes %d arguments, but %d given.\n",
+                    file_table_name(name->location.file), name->location.line, name->length, name->string,
+                    macro->parameter_count, count);
+            return NULL;
+        }
+
+        hide_set = hide_set_intersection(arena, hide_set, close_parenthesis->hide_set);
+    }
+
+    hide_set = hide_set_add(arena, hide_set, macro->name);
+
+    // Substitute the replacement list
+    Token head = {0};
+    Token *back = &head;
+    Token *before_back = NULL;
+    int can_paste = 0;
+    int is_space_left = 0;
+
+    for (int i = 0; i < macro->body_length; i++) {
+        MacroToken *entry = &macro->body[i];
+        int is_pasted_to = i > 0 && macro->body[i - 1].is_pasted;
+        Token *front;
+
+        if (entry->is_stringified) {
+            front = stringify(arena, &arguments[entry->parameter], entry->token);
+        } else if (entry->parameter >= 0) {
+            Argument *argument = &arguments[entry->parameter];
+
+            if (is_pasted_to || entry->is_pasted) {
+                front = copy_tokens(arena, argument->front, argument->length);
+            } else {
+                if (!argument->is_expanded) {
+                    argument->expanded = expand_tokens(table, arena,
+                                                       copy_tokens(arena, argument->front, argument->length));
+                    argument->is_expanded = 1;
+                }
+
+                front = copy_tokens(arena, argument->expanded, -1);
+            }
+
+            // Substituted arguments are spaced like their parameters
+            if (front) {
+                front->has_space = entry->token->has_space;
+            }
+
+            // GNU extension: ', ## __VA_ARGS__' drops the comma if there are no variable arguments
+            if (is_pasted_to && can_paste && macro->is_variadic && entry->parameter == macro->parameter_count - 1 &&
+                back->operator == ',') {
+                if (!front) {
+                    back = before_back;
+                    back->next = NULL;
+                    can_paste = 0;
+                    continue;
+                }
+
+                front->has_space = argument->front->has_space;
+                is_pasted_to = 0;
+            }
+        } else {
+            front = copy_token(arena, entry->token);
+        }
+
+        int is_produced = front != NULL;
+
+        // An empty argument leaves the space before its parameter to the next token, as in '"f(a, )"'
+        if (!is_produced && !is_pasted_to && !entry->is_pasted) {
+            is_space_left |= entry->token->has_space;
+        } else if (front && is_space_left) {
+            front->has_space = 1;
+            is_space_left = 0;
+        } else {
+            is_space_left = 0;
+        }
+
+        // Paste the first token onto the last one so far
+        if (is_pasted_to && can_paste && front) {
+            Token *pasted = paste_tokens(arena, back, front);
+
+            before_back->next = pasted;
+            back = pasted;
+            front = front->next;
+        }
+
+        for (; front; front = front->next) {
+            before_back = back;
+            back->next = front;
+            back = front;
+        }
+
+        back->next = NULL;
+
+        // An empty argument pasted onto the last token leaves it as the left side of a following '##'
+        can_paste = is_produced || (is_pasted_to && can_paste);
+    }
+
+    // Place the result at the invocation
+    int width = name->width;
+
+    if (close_parenthesis && same_line(close_parenthesis->location, name->location) &&
+        close_parenthesis->location.column + close_parenthesis->width - name->location.column > width) {
+        width = close_parenthesis->location.column + close_parenthesis->width - name->location.column;
+    }
+
+    HideSet *last_hide_set = NULL;
+    HideSet *last_union = hide_set;
+
+    for (Token *token = head.next; token; token = token->next) {
+        if (token->hide_set != last_hide_set) {
+            last_hide_set = token->hide_set;
+            last_union = hide_set_union(arena, last_hide_set, hide_set);
+        }
+
+        token->hide_set = last_union;
+        token->location = name->location;
+        token->width = 0;
+        token->is_directive = 0;
+        token->continues_line = name->continues_line;
+    }
+
+    if (head.next) {
+        head.next->width = width;
+        head.next->has_space = name->has_space;
+    }
+
+    return head.next;
+}
+
+/**
+ * Fully macro-expands a chain of tokens, e.g. an argument of a macro invocation. Function-like macros are only
+ * invoked if their arguments are part of the chain.
+ *
+ * @param table The macro table of the translation unit.
+ * @param arena An arena from which to allocate the resulting tokens.
+ * @param tokens The first token of the chain, which is expanded in place.
+ * @return The first token of the expanded chain, NULL if it is empty.
+ */
+Token *expand_tokens(const MacroTable *table, Arena *arena, Token *tokens) {
+    Token head = {0};
+    Token *prev = &head;
+    Token *token;
+
+    head.next = tokens;
+
+    while ((token = prev->next)) {
+        Macro *macro = find_macro(table, token);
+        Token *end = token->next;
+        Token *open_parenthesis = NULL;
+
+        if (macro && macro->is_function) {
+            if (!end || end->operator != '(') {
+                macro = NULL;
+            } else {
+                // Find the end of the invocation
+                int depth = 0;
+                open_parenthesis = end;
+
+                for (end = open_parenthesis->next; end && (end->operator != ')' || depth); end = end->next) {
+                    depth += (end->operator == '(') - (end->operator == ')');
+                }
+
+                if (end) {
+                    end = end->next;
+                }
+            }
+        }
+
+        if (!macro) {
+            prev = token;
+            continue;
+        }
+
+        // Replace the invocation with its expansion, which is rescanned together with the rest of the chain
+        Token *expansion = expand_macro(table, arena, macro, token, open_parenthesis);
+
+        if (expansion) {
+            prev->next = expansion;
+
+            while (expansion->next) {
+                expansion = expansion->next;
+            }
+
+            expansion->next = end;
+        } else {
+            prev->next = end;
+        }
+    }
+
+    return head.next;
+}
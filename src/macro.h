@@ -0,0 +1,104 @@
+#ifndef TCPP_MACRO_H
+#define TCPP_MACRO_H
+
+#include "token.h"
+#include "arena.h"
+
+/**
+ * Stores a set of symbols as a bitset over their ids. Used as the hide set of a token, i.e. the macros which must not
+ * be expanded from it again. Hide sets are never modified once created, so tokens share them. NULL is the empty set.
+ */
+typedef struct HideSet {
+    unsigned int size;
+    unsigned long long words[];
+} HideSet;
+
+/**
+ * Stores a token of a macro's replacement list.
+ *
+ * PARAMETER is the index of the parameter the token names, -1 if it is not a parameter. IS_STRINGIFIED is set for
+ * parameters preceded by '#' and IS_PASTED for tokens followed by '##', with both operators removed from the list.
+ */
+typedef struct MacroToken {
+    Token *token;
+
+    int parameter;
+    int is_stringified;
+    int is_pasted;
+} MacroToken;
+
+/**
+ * Stores a macro definition with its replacement list pre-tokenized and pre-classified.
+ *
+ * The last parameter of a variadic macro receives the variable arguments (named __VA_ARGS__ unless the GNU 'name...'
+ * form is used).
+ */
+typedef struct Macro {
+    unsigned int name;
+    Location location;
+
+    int is_function;
+    int is_variadic;
+    int parameter_count;
+
+    MacroToken *body;
+    int body_length;
+} Macro;
+
+/**
+ * Stores the macros of a translation unit, indexed by the symbol ids of their names.
+ *
+ * The table is layered over BASE, a read-only table shared with other translation units (the predefined macros, see
+ * predefined.h), whose macros it holds unless it defines or undefines them itself. Undefined base macros are shadowed
+ * with UNDEFINED_MACRO. BASE is NULL for tables of their own.
+ */
+typedef struct MacroTable {
+    Macro **macros;
+    unsigned int size;
+
+    const struct MacroTable *base;
+} MacroTable;
+
+extern Macro undefined_macro;
+
+void delete_macro_table(MacroTable *table);
+
+void macro_table_set(MacroTable *table, unsigned int symbol, Macro *macro);
+
+/**
+ * Retrieves a macro from a macro table.
+ *
+ * @param table A macro table from which to retrieve the macro.
+ * @param symbol The symbol id of a token, SYMBOL_NONE for tokens which are not identifiers.
+ * @return The macro, NULL if the symbol is not defined.
+ */
+static inline Macro *macro_table_get(const MacroTable *table, unsigned int symbol) {
+    Macro *macro = symbol < table->size ? table->macros[symbol] : NULL;
+
+    if (!macro && table->base) {
+        macro = symbol < table->base->size ? table->base->macros[symbol] : NULL;
+    }
+
+    return macro == &undefined_macro ? NULL : macro;
+}
+
+/**
+ * Checks if a symbol is in a hide set.
+ *
+ * @param hide_set The hide set to be checked.
+ * @param symbol The symbol id.
+ * @return 1 if it is, 0 otherwise.
+ */
+static inline int hide_set_contains(const HideSet *hide_set, unsigned int symbol) {
+    return hide_set && symbol / 64 < hide_set->size && (hide_set->words[symbol / 64] >> (symbol % 64)) & 1;
+}
+
+Macro *new_macro(Arena *arena, Token *name, Location line);
+
+Macro *find_macro(const MacroTable *table, const Token *token);
+
+Token *expand_macro(const MacroTable *table, Arena *arena, Macro *macro, Token *name, Token *open_parenthesis);
+
+Token *expand_tokens(const MacroTable *table, Arena *arena, Token *tokens);
+
+#endif //TCPP_MACRO_H
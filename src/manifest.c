@@ -0,0 +1,444 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "manifest.h"
+#include "args.h"
+#include "source.h"
+
+/**
+ * Identifies manifest files, followed by the version of their format.
+ */
+static const char manifest_magic[4] = {'T', 'C', 'P', 'M'};
+static const uint32_t manifest_version = 2;
+
+/**
+ * Stores the fixed-size header of a manifest file.
+ *
+ * A manifest file describes the run which last preprocessed a translation unit. The header is followed by FILE_COUNT
+ * ManifestFile entries, one for each file opened by the translation unit (starting with its input file), MISS_COUNT
+ * entries for the paths probed for its included headers without finding them, of which only the names are used, and
+ * NAMES_SIZE bytes of all their null-terminated names. A header appearing at one of the missed paths would be included
+ * instead, so they have to stay missing for the output to be up to date.
+ *
+ * OPTIONS_HASH covers the arguments which make a difference to the output. OUTPUT_SIZE and the output's modification
+ * time describe the output file written by the run, LINE_COUNT and COMMENT_COUNT are the counts reported for the input
+ * file.
+ */
+typedef struct ManifestHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t options_hash;
+
+    uint32_t file_count;
+    uint32_t miss_count;
+    uint32_t names_size;
+    int32_t line_count;
+    int32_t comment_count;
+
+    uint64_t output_size;
+    int64_t output_modified_sec;
+    int64_t output_modified_nsec;
+} ManifestHeader;
+
+/**
+ * Stores a file opened by a translation unit in a manifest file, as it was when the translation unit was preprocessed.
+ * The file only has to be hashed again if its modification time has changed.
+ */
+typedef struct ManifestFile {
+    uint32_t name_offset;
+    uint32_t name_length;
+
+    uint64_t size;
+    int64_t modified_sec;
+    int64_t modified_nsec;
+    uint64_t content_hash;
+} ManifestFile;
+
+/**
+ * Stores the status of a file as found in this run, and its content hash once it has been needed.
+ */
+typedef struct FileStatus {
+    int is_stated;
+    int is_hashed;
+    int is_missing;
+
+    uint64_t size;
+    struct timespec modified;
+    uint64_t hash;
+} FileStatus;
+
+/**
+ * The statuses of the files in the global file table, indexed by their ids. Most files are opened by many translation
+ * units, but are only looked at once per run.
+ */
+static pthread_mutex_t statuses_lock = PTHREAD_MUTEX_INITIALIZER;
+static FileStatus *statuses;
+static unsigned int status_capacity;
+
+/**
+ * Finds the status of a file, and its content hash if asked to. Safe to be called from multiple threads at once.
+ *
+ * @param file The id of the file.
+ * @param is_hashed Whether the content hash is needed.
+ * @param status The status into which to copy.
+ * @return 1 if successful, 0 if the file could not be read.
+ */
+static int file_status(unsigned int file, int is_hashed, FileStatus *status) {
+    pthread_mutex_lock(&statuses_lock);
+
+    if (file >= status_capacity) {
+        unsigned int capacity = status_capacity ? status_capacity : 0x100;
+        while (capacity <= file) {
+            capacity *= 2;
+        }
+
+        statuses = realloc(statuses, capacity * sizeof *statuses);
+
+        if (!statuses) {
+            fprintf(stderr, "Could not allocate enough memory.");
+            exit(EXIT_FAILURE);
+        }
+
+        memset(&statuses[status_capacity], 0, (capacity - status_capacity) * sizeof *statuses);
+        status_capacity = capacity;
+    }
+
+    *status = statuses[file];
+    pthread_mutex_unlock(&statuses_lock);
+
+    // Another thread finding the same status in the meantime only duplicates the work
+    const char *file_name = file_table_name(file);
+    struct stat info;
+
+    if (!status->is_stated) {
+        status->is_stated = 1;
+        status->is_missing = stat(file_name, &info) != 0 || !S_ISREG(info.st_mode);
+        status->size = status->is_missing ? 0 : (uint64_t) info.st_size;
+        status->modified = status->is_missing ? (struct timespec) {0} : info.st_mtim;
+    }
+
+    if (is_hashed && !status->is_hashed && !status->is_missing) {
+        Source *source = source_open((char *) file_name);
+
+        status->is_hashed = 1;
+        status->is_missing = !source;
+        status->hash = source ? source_hash(source->data, source->size) : 0;
+        source_close(source);
+    }
+
+    pthread_mutex_lock(&statuses_lock);
+    statuses[file] = *status;
+    pthread_mutex_unlock(&statuses_lock);
+
+    return !status->is_missing;
+}
+
+/**
+ * Hashes the arguments which make a difference to the output of a translation unit.
+ *
+ * @return The hash.
+ */
+static uint64_t options_hash(void) {
+    uint64_t hash = (uint64_t) (args->keep_comments | args->compact << 1 | args->line_markers << 2);
+
+    // The search directories are hashed with their terminators, so that the lists can not be confused
+    for (int i = 0; i < args->include_count; i++) {
+        hash = (hash ^ source_hash(args->include_dirs[i], strlen(args->include_dirs[i]) + 1)) * 0x100000001b3ULL;
+    }
+
+    hash = (hash ^ (uint64_t) args->include_count) * 0x100000001b3ULL;
+
+    for (int i = 0; i < args->system_count; i++) {
+        hash = (hash ^ source_hash(args->system_dirs[i], strlen(args->system_dirs[i]) + 1)) * 0x100000001b3ULL;
+    }
+
+    hash = (hash ^ (uint64_t) args->system_count) * 0x100000001b3ULL;
+
+    for (int i = 0; i < args->macro_count; i++) {
+        hash = (hash ^ source_hash(args->macros[i], strlen(args->macros[i]) + 1)) * 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+/**
+ * Makes the location of the manifest file of a translation unit. The name of the file is the hash of the working
+ * directory and the names of the translation unit's input and output files, which the names of the files opened by it
+ * are relative to.
+ *
+ * @param directory The directory of the manifests.
+ * @param unit The translation unit.
+ * @return A newly allocated path.
+ */
+static char *manifest_path(const char *directory, const TranslationUnit *unit) {
+    char *working_directory = getcwd(NULL, 0);
+    uint64_t hash = working_directory ? source_hash(working_directory, strlen(working_directory)) : 0;
+
+    hash = (hash ^ source_hash(unit->input_file, strlen(unit->input_file) + 1)) * 0x100000001b3ULL;
+    hash = (hash ^ source_hash(unit->output_file, strlen(unit->output_file) + 1)) * 0x100000001b3ULL;
+    free(working_directory);
+
+    size_t length = strlen(directory) + 22;
+    char *path = malloc(length * sizeof *path);
+
+    if (!path) {
+        fprintf(stderr, "Could not allocate enough memory.");
+        exit(EXIT_FAILURE);
+    }
+
+    snprintf(path, length, "%s/%016llx.tcm", directory, (unsigned long long) hash);
+
+    return path;
+}
+
+/**
+ * Checks if a file is still the same as when it was recorded in a manifest. It is only hashed if its modification time
+ * differs from the recorded one.
+ *
+ * @param recorded The file's entry in the manifest.
+ * @param file The id of the file.
+ * @return 1 if it is, 0 otherwise.
+ */
+static int is_file_current(const ManifestFile *recorded, unsigned int file) {
+    FileStatus status;
+
+    if (!file_status(file, 0, &status) || status.size != recorded->size) {
+        return 0;
+    }
+
+    if (status.modified.tv_sec == recorded->modified_sec && status.modified.tv_nsec == recorded->modified_nsec) {
+        return 1;
+    }
+
+    return file_status(file, 1, &status) && status.hash == recorded->content_hash;
+}
+
+/**
+ * Compares two file ids, for sorting them with qsort.
+ *
+ * @param a A pointer to the first id.
+ * @param b A pointer to the second id.
+ * @return A negative number, zero or a positive number if the first id is smaller, equal or greater.
+ */
+static int compare_files(const void *a, const void *b) {
+    unsigned int file_a = *(const unsigned int *) a;
+    unsigned int file_b = *(const unsigned int *) b;
+
+    return (file_a > file_b) - (file_a < file_b);
+}
+
+/**
+ * Checks if the output file of a translation unit is still up to date according to its manifest, i.e. none of the files
+ * it opened has changed since, none of the paths it missed has appeared and the output file has not been touched. If it is, the translation unit's file list and
+ * counts are filled in from the manifest, as if it had been preprocessed.
+ *
+ * Standard output can not be reused, so output written to it is never up to date.
+ *
+ * @param directory The directory of the manifests.
+ * @param unit The translation unit.
+ * @return 1 if the output is up to date, 0 otherwise.
+ */
+int manifest_load(const char *directory, TranslationUnit *unit) {
+    struct stat info;
+
+    if (strcmp(unit->output_file, "-") == 0 || stat(unit->output_file, &info) != 0) {
+        return 0;
+    }
+
+    char *path = manifest_path(directory, unit);
+    Source *source = source_open(path);
+    free(path);
+
+    if (!source) {
+        return 0;
+    }
+
+    const ManifestHeader *manifest = (const ManifestHeader *) source->data;
+    const ManifestFile *files = (const ManifestFile *) (manifest + 1);
+
+    int is_current = source->size >= sizeof *manifest &&
+                     memcmp(manifest->magic, manifest_magic, sizeof manifest_magic) == 0 &&
+                     manifest->version == manifest_version && manifest->options_hash == options_hash() &&
+                     source->size == sizeof *manifest + ((uint64_t) manifest->file_count + manifest->miss_count) *
+                                                        sizeof *files + manifest->names_size &&
+                     manifest->output_size == (uint64_t) info.st_size &&
+                     manifest->output_modified_sec == info.st_mtim.tv_sec &&
+                     manifest->output_modified_nsec == info.st_mtim.tv_nsec;
+    const char *names = is_current ? (const char *) (files + manifest->file_count + manifest->miss_count) : NULL;
+
+    for (uint32_t i = 0; is_current && i < manifest->file_count + manifest->miss_count; i++) {
+        const ManifestFile *recorded = &files[i];
+
+        if ((uint64_t) recorded->name_offset + recorded->name_length >= manifest->names_size ||
+            names[recorded->name_offset + recorded->name_length] != '\0') {
+            is_current = 0;
+            break;
+        }
+
+        unsigned int file = file_table_add(&names[recorded->name_offset]);
+        FileStatus status;
+
+        if (i >= manifest->file_count) {
+            is_current = !file_status(file, 0, &status);
+            continue;
+        }
+
+        file_list_append(&unit->files, file);
+        is_current = is_file_current(recorded, file);
+    }
+
+    if (is_current) {
+        unit->line_count = manifest->line_count;
+        unit->comment_count = manifest->comment_count;
+    } else {
+        file_list_clear(&unit->files);
+    }
+
+    source_close(source);
+
+    return is_current;
+}
+
+/**
+ * Writes a block of memory into a file.
+ *
+ * @param file The file into which to write.
+ * @param data The memory.
+ * @param size The size of the memory.
+ * @return 1 if successful, 0 otherwise.
+ */
+static int write_block(FILE *file, const void *data, size_t size) {
+    return size == 0 || fwrite(data, size, 1, file) == 1;
+}
+
+/**
+ * Saves the manifest of a translation unit which has just been preprocessed and written to its output file, so that
+ * later runs can find out with manifest_load whether the output is still up to date. The file is written under a
+ * temporary name first, so readers never see it incomplete. Output written to stdout has no manifest.
+ *
+ * @param directory The directory of the manifests.
+ * @param unit The translation unit.
+ * @return 1 if successful, 0 otherwise.
+ */
+int manifest_save(const char *directory, const TranslationUnit *unit) {
+    struct stat info;
+
+    if (strcmp(unit->output_file, "-") == 0) {
+        return 1;
+    } else if (stat(unit->output_file, &info) != 0) {
+        return 0;
+    }
+
+    // The same paths are missed by every include of a header, they are only recorded once
+    unsigned int *misses = malloc((unit->misses.count + 1) * sizeof *misses);
+    unsigned int miss_count = 0;
+
+    if (!misses) {
+        fprintf(stderr, "Could not allocate enough memory.");
+        exit(EXIT_FAILURE);
+    }
+
+    if (unit->misses.count) {
+        memcpy(misses, unit->misses.files, unit->misses.count * sizeof *misses);
+        qsort(misses, unit->misses.count, sizeof *misses, compare_files);
+    }
+
+    for (unsigned int i = 0; i < unit->misses.count; i++) {
+        if (!miss_count || misses[i] != misses[miss_count - 1]) {
+            misses[miss_count++] = misses[i];
+        }
+    }
+
+    // The header is cleared as a whole, so that its padding is written as zeros
+    ManifestHeader manifest;
+    memset(&manifest, 0, sizeof manifest);
+    memcpy(manifest.magic, manifest_magic, sizeof manifest_magic);
+    manifest.version = manifest_version;
+    manifest.options_hash = options_hash();
+    manifest.file_count = unit->files.count;
+    manifest.miss_count = miss_count;
+    manifest.line_count = unit->line_count;
+    manifest.comment_count = unit->comment_count;
+    manifest.output_size = (uint64_t) info.st_size;
+    manifest.output_modified_sec = info.st_mtim.tv_sec;
+    manifest.output_modified_nsec = info.st_mtim.tv_nsec;
+
+    unsigned int entry_count = unit->files.count + miss_count;
+    ManifestFile *files = calloc(entry_count + 1, sizeof *files);
+
+    if (!files) {
+        fprintf(stderr, "Could not allocate enough memory.");
+        exit(EXIT_FAILURE);
+    }
+
+    int is_saved = 1;
+
+    for (unsigned int i = 0; i < unit->files.count; i++) {
+        FileStatus status;
+
+        if (!file_status(unit->files.files[i], 1, &status)) {
+            is_saved = 0;
+            break;
+        }
+
+        files[i].name_offset = manifest.names_size;
+        files[i].name_length = (uint32_t) strlen(file_table_name(unit->files.files[i]));
+        files[i].size = status.size;
+        files[i].modified_sec = status.modified.tv_sec;
+        files[i].modified_nsec = status.modified.tv_nsec;
+        files[i].content_hash = status.hash;
+
+        manifest.names_size += files[i].name_length + 1;
+    }
+
+    for (unsigned int i = 0; i < miss_count; i++) {
+        ManifestFile *miss = &files[unit->files.count + i];
+
+        miss->name_offset = manifest.names_size;
+        miss->name_length = (uint32_t) strlen(file_table_name(misses[i]));
+        manifest.names_size += miss->name_length + 1;
+    }
+
+    char *path = manifest_path(directory, unit);
+    size_t temporary_length = strlen(path) + 24;
+    char *temporary = malloc(temporary_length * sizeof *temporary);
+
+    if (!temporary) {
+        fprintf(stderr, "Could not allocate enough memory.");
+        exit(EXIT_FAILURE);
+    }
+
+    snprintf(temporary, temporary_length, "%s.%ld", path, (long) getpid());
+
+    FILE *file = is_saved ? fopen(temporary, "wb") : NULL;
+    is_saved = file && write_block(file, &manifest, sizeof manifest) &&
+               write_block(file, files, entry_count * sizeof *files);
+
+    for (unsigned int i = 0; is_saved && i < entry_count; i++) {
+        unsigned int id = i < unit->files.count ? unit->files.files[i] : misses[i - unit->files.count];
+        is_saved = write_block(file, file_table_name(id), files[i].name_length + 1);
+    }
+
+    if (file && fclose(file) != 0) {
+        is_saved = 0;
+    }
+
+    if (is_saved && rename(temporary, path) != 0) {
+        is_saved = 0;
+    }
+
+    if (file && !is_saved) {
+        remove(temporary);
+    }
+
+    free(temporary);
+    free(path);
+    free(files);
+    free(misses);
+
+    return is_saved;
+}
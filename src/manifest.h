@@ -0,0 +1,10 @@
+#ifndef TCPP_MANIFEST_H
+#define TCPP_MANIFEST_H
+
+#include "unit.h"
+
+int manifest_load(const char *directory, TranslationUnit *unit);
+
+int manifest_save(const char *directory, const TranslationUnit *unit);
+
+#endif //TCPP_MANIFEST_H
@@ -0,0 +1,186 @@
+#include "plain.h"
+#include "args.h"
+#include "predefined.h"
+#include "scan.h"
+#include "stats.h"
+
+/**
+ * Checks if a character is a blank within a line, which separates tokens.
+ *
+ * @param ch The character.
+ * @return 1 if it is, 0 otherwise.
+ */
+static int is_blank(char ch) {
+    return ch == ' ' || ch == '\t' || ch == '\v' || ch == '\f';
+}
+
+/**
+ * Checks if a character belongs to a name or number, which the tokenizer reads as one token.
+ *
+ * @param ch The character.
+ * @return 1 if it does, 0 otherwise.
+ */
+static int is_name(char ch) {
+    return (unsigned char) ((ch | 0x20) - 'a') < 26 || (unsigned char) (ch - '0') < 10 || ch == '_' || ch == '$';
+}
+
+/**
+ * Scans a source file for whether it is plain, i.e. whether preprocessing could only remove its comments: it has no
+ * directives, no identifiers naming predefined macros, and no line continuations or unterminated literals which would
+ * make the tokens differ from its text.
+ *
+ * If it is, and a layout is given, the file is written through the layout with the comments removed. No token list is
+ * built: every run of characters between blanks and comments is written as a single token, which lays the output out
+ * the same way as the run's tokens would.
+ *
+ * @param source The source of the file.
+ * @param file The id of the file.
+ * @param layout The layout through which to write the file, NULL to only check it.
+ * @param line_count Set to the number of lines with tokens or comments (see TokenList), if the file is written.
+ * @param comment_count Set to the number of comments, if the file is written.
+ * @return 1 if the file is plain, 0 otherwise.
+ */
+int plain_scan(const Source *source, unsigned int file, Layout *layout, int *line_count, int *comment_count) {
+    const char *cursor = source->data;
+    const char *end = source->data + source->size;
+    Location location = {file, 1, 0};
+    int lines = 0, comments = 0, last_line = 0;
+    int is_line_start = 1;
+
+    // The linemarkers start with the file, as they do for preprocessed files (which are empty if the file is)
+    if (layout && args->line_markers && source->size) {
+        Token spacer = {.location = location};
+        layout_token(layout, &spacer);
+    }
+
+    while (cursor < end) {
+        char ch = *cursor;
+
+        if (ch == '\n' || ch == '\r') {
+            if (cursor > source->data && cursor[-1] == '\\') {
+                return 0;
+            }
+
+            cursor += (ch == '\r' && cursor + 1 < end && cursor[1] == '\n') ? 2 : 1;
+            location.line++;
+            location.column = 0;
+            is_line_start = 1;
+            continue;
+        }
+
+        if (is_blank(ch)) {
+            cursor++;
+            location.column++;
+            continue;
+        }
+
+        if (ch == '/' && cursor + 1 < end && (cursor[1] == '/' || cursor[1] == '*')) {
+            // Comments are left out of the output, only their line breaks move it on
+            if (cursor[1] == '/') {
+                const char *line_end = scan_find_any(cursor, end, '\n', '\r', '\n', '\r');
+
+                location.column += (int) (line_end - cursor);
+                cursor = line_end;
+            } else {
+                for (cursor += 2, location.column += 2; cursor < end; cursor++, location.column++) {
+                    if (*cursor == '*' && cursor + 1 < end && cursor[1] == '/') {
+                        cursor += 2;
+                        location.column += 2;
+                        break;
+                    }
+
+                    if (*cursor == '\n' || *cursor == '\r') {
+                        if (cursor[-1] == '\\') {
+                            return 0;
+                        }
+
+                        if (*cursor == '\r' && cursor + 1 < end && cursor[1] == '\n') {
+                            cursor++;
+                        }
+
+                        location.line++;
+                        location.column = -1;
+                        is_line_start = 1;
+                    }
+                }
+            }
+
+            comments++;
+
+            if (location.line > last_line) {
+                last_line = location.line;
+                lines++;
+            }
+
+            continue;
+        }
+
+        if (ch == '#' && is_line_start) {
+            return 0;
+        }
+
+        // A run of token characters, ending at a blank, a comment or the end of the line
+        const char *start = cursor;
+
+        while (cursor < end && !is_blank(*cursor) && *cursor != '\n' && *cursor != '\r' &&
+               !(*cursor == '/' && cursor + 1 < end && (cursor[1] == '/' || cursor[1] == '*'))) {
+            // Names are only checked for predefined macros before the file is written (numbers are no names)
+            if (!layout && is_name(*cursor)) {
+                const char *name = cursor;
+
+                while (cursor < end && is_name(*cursor)) {
+                    cursor++;
+                }
+
+                if ((unsigned char) (*name - '0') >= 10 && is_predefined(name, (unsigned int) (cursor - name))) {
+                    return 0;
+                }
+
+                continue;
+            }
+
+            char quote = *cursor++;
+
+            if (quote != '\"' && quote != '\'') {
+                continue;
+            }
+
+            // Literals keep their blanks and comments, but must end on their line
+            while (cursor < end && *cursor != quote) {
+                if (*cursor == '\n' || *cursor == '\r' ||
+                    (*cursor == '\\' && cursor + 1 < end && (cursor[1] == '\n' || cursor[1] == '\r'))) {
+                    return 0;
+                }
+
+                cursor += (*cursor == '\\' && cursor + 1 < end) ? 2 : 1;
+            }
+
+            if (cursor < end) {
+                cursor++;
+            }
+        }
+
+        // Runs always follow a blank, a comment or a line break, so they are spaced like the first token of a line
+        if (layout) {
+            Token run = {.string = start, .length = (int) (cursor - start), .width = (int) (cursor - start),
+                         .location = location, .has_space = 1};
+            layout_token(layout, &run);
+        }
+
+        location.column += (int) (cursor - start);
+        is_line_start = 0;
+
+        if (location.line > last_line) {
+            last_line = location.line;
+            lines++;
+        }
+    }
+
+    if (layout) {
+        *line_count = lines;
+        *comment_count = comments;
+        stats_add(COUNTER_COMMENTS_REMOVED, (uint64_t) comments);
+    }
+
+    return 1;
+}
@@ -0,0 +1,9 @@
+#ifndef TCPP_PLAIN_H
+#define TCPP_PLAIN_H
+
+#include "source.h"
+#include "layout.h"
+
+int plain_scan(const Source *source, unsigned int file, Layout *layout, int *line_count, int *comment_count);
+
+#endif //TCPP_PLAIN_H
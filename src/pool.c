@@ -0,0 +1,266 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include "pool.h"
+
+/**
+ * Stores what a worker thread needs to know about itself.
+ */
+typedef struct Worker {
+    ThreadPool *pool;
+    int index;
+} Worker;
+
+/**
+ * The worker the current thread is, NULL for threads which are not in a pool.
+ */
+static __thread const Worker *current_worker;
+
+/**
+ * Adds a task to the back of a queue.
+ *
+ * @param queue The queue to which to add the task.
+ * @param task The task to be added.
+ */
+static void queue_push(PoolQueue *queue, PoolTask task) {
+    pthread_mutex_lock(&queue->lock);
+
+    if (queue->count == queue->capacity) {
+        unsigned int capacity = queue->capacity ? queue->capacity * 2 : 16;
+        PoolTask *tasks = malloc(capacity * sizeof *tasks);
+
+        if (!tasks) {
+            fprintf(stderr, "Could not allocate enough memory.");
+            exit(EXIT_FAILURE);
+        }
+
+        for (unsigned int i = 0; i < queue->count; i++) {
+            tasks[i] = queue->tasks[(queue->head + i) % queue->capacity];
+        }
+
+        free(queue->tasks);
+        queue->tasks = tasks;
+        queue->head = 0;
+        queue->capacity = capacity;
+    }
+
+    queue->tasks[(queue->head + queue->count++) % queue->capacity] = task;
+
+    pthread_mutex_unlock(&queue->lock);
+}
+
+/**
+ * Takes a task from a queue.
+ *
+ * @param queue The queue from which to take the task.
+ * @param is_stealing 1 to take the oldest task (from the front), 0 to take the newest one (from the back).
+ * @param task Set to the taken task.
+ * @return 1 if a task was taken, 0 if the queue is empty.
+ */
+static int queue_pop(PoolQueue *queue, int is_stealing, PoolTask *task) {
+    pthread_mutex_lock(&queue->lock);
+
+    int is_taken = queue->count != 0;
+
+    if (is_taken && is_stealing) {
+        *task = queue->tasks[queue->head];
+        queue->head = (queue->head + 1) % queue->capacity;
+        queue->count--;
+    } else if (is_taken) {
+        *task = queue->tasks[(queue->head + --queue->count) % queue->capacity];
+    }
+
+    pthread_mutex_unlock(&queue->lock);
+
+    return is_taken;
+}
+
+/**
+ * Takes the next task for a worker, from its own queue if possible, otherwise from another worker's queue.
+ *
+ * @param worker The worker for which to take the task.
+ * @param task Set to the taken task.
+ * @return 1 if a task was taken, 0 if all the queues are empty.
+ */
+static int take_task(const Worker *worker, PoolTask *task) {
+    ThreadPool *pool = worker->pool;
+
+    if (queue_pop(&pool->queues[worker->index], 0, task)) {
+        return 1;
+    }
+
+    for (int i = 1; i < pool->size; i++) {
+        if (queue_pop(&pool->queues[(worker->index + i) % pool->size], 1, task)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Runs the tasks of a thread pool until the pool is stopped.
+ *
+ * @param argument The worker which runs the tasks.
+ * @return NULL.
+ */
+static void *run_worker(void *argument) {
+    const Worker *worker = argument;
+    ThreadPool *pool = worker->pool;
+    current_worker = worker;
+
+    for (;;) {
+        PoolTask task;
+
+        if (take_task(worker, &task)) {
+            pthread_mutex_lock(&pool->lock);
+            pool->available--;
+            pthread_mutex_unlock(&pool->lock);
+
+            task.function(task.argument);
+
+            pthread_mutex_lock(&pool->lock);
+            if (--pool->pending == 0) {
+                pthread_cond_broadcast(&pool->idle);
+            }
+            pthread_mutex_unlock(&pool->lock);
+
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->lock);
+
+        while (pool->available <= 0 && !pool->is_stopping) {
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        }
+
+        int is_stopping = pool->available <= 0 && pool->is_stopping;
+        pthread_mutex_unlock(&pool->lock);
+
+        if (is_stopping) {
+            break;
+        }
+    }
+
+    free(argument);
+
+    return NULL;
+}
+
+/**
+ * Generates a new thread pool and starts its worker threads.
+ *
+ * @param size The number of worker threads.
+ * @return A newly generated thread pool.
+ */
+ThreadPool *new_thread_pool(int size) {
+    ThreadPool *pool = calloc(1, sizeof *pool);
+
+    if (!pool || !(pool->threads = calloc((size_t) size, sizeof *pool->threads)) ||
+        !(pool->queues = calloc((size_t) size, sizeof *pool->queues))) {
+        fprintf(stderr, "Could not allocate enough memory.");
+        exit(EXIT_FAILURE);
+    }
+
+    pool->size = size;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_cond_init(&pool->idle, NULL);
+
+    for (int i = 0; i < size; i++) {
+        pthread_mutex_init(&pool->queues[i].lock, NULL);
+    }
+
+    for (int i = 0; i < size; i++) {
+        Worker *worker = malloc(sizeof *worker);
+
+        if (!worker) {
+            fprintf(stderr, "Could not allocate enough memory.");
+            exit(EXIT_FAILURE);
+        }
+
+        worker->pool = pool;
+        worker->index = i;
+
+        if (pthread_create(&pool->threads[i], NULL, run_worker, worker) != 0) {
+            fprintf(stderr, "Could not start a worker thread.");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    return pool;
+}
+
+/**
+ * Stops a thread pool after all its tasks have finished and deletes it.
+ *
+ * @param pool A thread pool to delete.
+ */
+void delete_thread_pool(ThreadPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->is_stopping = 1;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->size; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    for (int i = 0; i < pool->size; i++) {
+        pthread_mutex_destroy(&pool->queues[i].lock);
+        free(pool->queues[i].tasks);
+    }
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wake);
+    pthread_cond_destroy(&pool->idle);
+
+    free(pool->queues);
+    free(pool->threads);
+    free(pool);
+}
+
+/**
+ * Submits a task to a thread pool. Tasks submitted by the pool's own workers are queued on the submitting worker, so
+ * that it runs them next unless they are stolen.
+ *
+ * @param pool The thread pool to which to submit.
+ * @param function The function to be run.
+ * @param argument The argument with which to run the function.
+ */
+void thread_pool_submit(ThreadPool *pool, void (*function)(void *argument), void *argument) {
+    PoolTask task = {function, argument};
+    unsigned int index;
+
+    pthread_mutex_lock(&pool->lock);
+
+    if (current_worker && current_worker->pool == pool) {
+        index = (unsigned int) current_worker->index;
+    } else {
+        index = pool->next_queue++ % (unsigned int) pool->size;
+    }
+
+    pool->pending++;
+    pthread_mutex_unlock(&pool->lock);
+
+    queue_push(&pool->queues[index], task);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->available++;
+    pthread_cond_signal(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * Waits until all the tasks submitted to a thread pool have finished.
+ *
+ * @param pool The thread pool to wait for.
+ */
+void thread_pool_wait(ThreadPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+
+    while (pool->pending) {
+        pthread_cond_wait(&pool->idle, &pool->lock);
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+}
@@ -0,0 +1,58 @@
+#ifndef TCPP_POOL_H
+#define TCPP_POOL_H
+
+#include <pthread.h>
+
+/**
+ * Stores a function to be run by a thread pool, together with its argument.
+ */
+typedef struct PoolTask {
+    void (*function)(void *argument);
+    void *argument;
+} PoolTask;
+
+/**
+ * Stores the tasks of a single worker thread in a growable ring buffer. The worker takes its own tasks from the back
+ * (newest first), while the other workers steal them from the front (oldest first).
+ */
+typedef struct PoolQueue {
+    PoolTask *tasks;
+    unsigned int head;
+    unsigned int count;
+    unsigned int capacity;
+
+    pthread_mutex_t lock;
+} PoolQueue;
+
+/**
+ * Stores information about a work-stealing thread pool.
+ *
+ * AVAILABLE is the number of queued tasks which have not been taken by a worker yet (briefly negative when a task is
+ * taken before its submission is counted) and PENDING the number of tasks which have not finished yet. Both are
+ * protected by LOCK. Tasks submitted from outside of the pool are distributed
+ * over the workers' queues in turn, starting at NEXT_QUEUE.
+ */
+typedef struct ThreadPool {
+    pthread_t *threads;
+    PoolQueue *queues;
+    int size;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t idle;
+
+    int available;
+    unsigned int pending;
+    unsigned int next_queue;
+    int is_stopping;
+} ThreadPool;
+
+ThreadPool *new_thread_pool(int size);
+
+void delete_thread_pool(ThreadPool *pool);
+
+void thread_pool_submit(ThreadPool *pool, void (*function)(void *argument), void *argument);
+
+void thread_pool_wait(ThreadPool *pool);
+
+#endif //TCPP_POOL_H
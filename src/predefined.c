@@ -0,0 +1,206 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "predefined.h"
+#include "args.h"
+#include "symbol.h"
+#include "tokenizer.h"
+
+/**
+ * The definitions of the macros which are predefined before the '-D' and '-U' options are applied, one per line.
+ */
+static const char builtin_definitions[] =
+        "__STDC__ 1\n"
+        "__STDC_VERSION__ 199901L\n"
+        "__STDC_HOSTED__ 1\n";
+
+/**
+ * Stores the predefined macros. They are built once, before any translation unit is preprocessed, and only read
+ * afterwards, so that all the threads share them without locking.
+ *
+ * TABLE is the base of the macro tables of the translation units. TOKENS holds the definitions the macros are built
+ * from, as if they were the lines of a file named "<command-line>".
+ *
+ * NAMES maps the names of the macros to them, so that their names can be looked up without interning them (see
+ * plain.h). FIRST_CHARS and LENGTHS are bitsets of the names' first characters and lengths (the last bit standing for
+ * all the longer ones), which rule most other identifiers out without a lookup.
+ */
+typedef struct PredefinedMacros {
+    MacroTable table;
+    TokenList *tokens;
+
+    HashMap *names;
+    unsigned long long first_chars[4];
+    unsigned long long lengths;
+} PredefinedMacros;
+
+static PredefinedMacros predefined;
+
+const MacroTable *predefined_macros = &predefined.table;
+
+/**
+ * Writes the definitions of the predefined macros into a newly allocated buffer, one per line: the builtin ones, then
+ * a line for each '-D' and '-U' option. '-D<macro>=<value>' is written as "<macro> <value>" and '-D<macro>' as
+ * "<macro> 1", like a define directive. The lines of '-U' options are left empty.
+ *
+ * @param size A pointer into which to store the size of the definitions.
+ * @return The newly allocated definitions.
+ */
+static char *write_definitions(size_t *size) {
+    size_t capacity = sizeof builtin_definitions;
+
+    for (int i = 0; i < args->macro_count; i++) {
+        capacity += strlen(args->macros[i]) + 1;
+    }
+
+    char *definitions = malloc(capacity);
+
+    if (!definitions) {
+        fprintf(stderr, "Could not allocate enough memory.");
+        exit(EXIT_FAILURE);
+    }
+
+    char *cursor = definitions + sizeof builtin_definitions - 1;
+
+    memcpy(definitions, builtin_definitions, sizeof builtin_definitions - 1);
+
+    for (int i = 0; i < args->macro_count; i++) {
+        const char *option = args->macros[i];
+
+        if (option[1] == 'D') {
+            const char *value = strchr(option, '=');
+            size_t length = value ? (size_t) (value - option - 2) : strlen(option + 2);
+
+            memcpy(cursor, option + 2, length);
+            cursor += length;
+            *cursor++ = ' ';
+
+            // The definition must stay on its line
+            for (value = value ? value + 1 : "1"; *value; value++) {
+                *cursor++ = (*value == '\n' || *value == '\r') ? ' ' : *value;
+            }
+        }
+
+        *cursor++ = '\n';
+    }
+
+    *size = (size_t) (cursor - definitions);
+
+    return definitions;
+}
+
+/**
+ * Retrieves the next token of the predefined definitions.
+ *
+ * @param token The current token.
+ * @return The next token which is not a gap, NULL at the end.
+ */
+static Token *next_definition_token(Token *token) {
+    for (token = token->next; token && token->is_gap; token = token->next) {
+    }
+
+    return token;
+}
+
+/**
+ * Builds the predefined macros from the builtin definitions and the '-D' and '-U' options, in order. Must be called
+ * once the symbol and file tables are initialized, before any translation unit is preprocessed.
+ *
+ * The definitions are tokenized and parsed once, like define directives, so that the translation units only look
+ * their macros up in the table, whichever number of them there is.
+ */
+void predefined_macros_init(void) {
+    size_t size;
+    char *definitions = write_definitions(&size);
+    int builtin_count = 0;
+
+    for (const char *ch = builtin_definitions; *ch; ch++) {
+        builtin_count += *ch == '\n';
+    }
+
+    predefined.tokens = tokenize_source(source_open_memory("<command-line>", definitions, size), new_arena());
+
+    // Tokenize the definitions completely, the macros keep pointers to their tokens
+    for (Token *token = predefined.tokens->front_token; token;) {
+        token = token->is_gap ? tokenize_gap(predefined.tokens, token) : token->next;
+    }
+
+    Token *token = predefined.tokens->front_token;
+
+    if (token && token->is_gap) {
+        token = next_definition_token(token);
+    }
+
+    for (int line = 1; line <= builtin_count + args->macro_count; line++) {
+        const char *option = line > builtin_count ? args->macros[line - builtin_count - 1] : NULL;
+
+        while (token && token->location.line < line) {
+            token = next_definition_token(token);
+        }
+
+        if (option && option[1] == 'U') {
+            macro_table_set(&predefined.table, intern(option + 2, (unsigned int) strlen(option + 2)), NULL);
+            continue;
+        }
+
+        // Only the options can be invalid
+        if (!token || token->location.line != line || !token->is_identifier) {
+            fprintf(stderr, "Invalid macro definition %s.\n", option);
+            continue;
+        }
+
+        Macro *macro = new_macro(predefined.tokens->arena, token, token->location);
+
+        if (macro) {
+            macro_table_set(&predefined.table, token->symbol, macro);
+        }
+    }
+
+    // Index the names of the macros that are left
+    predefined.names = new_hash_map(64, 0xcc9e2d51);
+
+    if (!predefined.names) {
+        fprintf(stderr, "Could not allocate enough memory.");
+        exit(EXIT_FAILURE);
+    }
+
+    for (unsigned int symbol = 0; symbol < predefined.table.size; symbol++) {
+        Macro *macro = predefined.table.macros[symbol];
+        const Symbol *name = &symbol_table->symbols[symbol];
+
+        if (macro) {
+            unsigned char first = (unsigned char) name->string[0];
+
+            hash_map_insert_key(predefined.names, name->string, name->length, macro);
+            predefined.first_chars[first / 64] |= 1ULL << (first % 64);
+            predefined.lengths |= 1ULL << (name->length < 63 ? name->length : 63);
+        }
+    }
+}
+
+/**
+ * Deletes the memory allocated to the predefined macros.
+ */
+void delete_predefined_macros(void) {
+    delete_macro_table(&predefined.table);
+    delete_hash_map(predefined.names);
+    delete_token_list(predefined.tokens);
+}
+
+/**
+ * Checks if an identifier names a predefined macro.
+ *
+ * @param name The identifier.
+ * @param length The length of the identifier (at least 1).
+ * @return 1 if it does, 0 otherwise.
+ */
+int is_predefined(const char *name, unsigned int length) {
+    unsigned char first = (unsigned char) name[0];
+
+    if (!((predefined.first_chars[first / 64] >> (first % 64)) & 1) ||
+        !((predefined.lengths >> (length < 63 ? length : 63)) & 1)) {
+        return 0;
+    }
+
+    return hash_map_get_key(predefined.names, name, length) != NULL;
+}
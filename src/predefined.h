@@ -0,0 +1,14 @@
+#ifndef TCPP_PREDEFINED_H
+#define TCPP_PREDEFINED_H
+
+#include "macro.h"
+
+extern const MacroTable *predefined_macros;
+
+void predefined_macros_init(void);
+
+void delete_predefined_macros(void);
+
+int is_predefined(const char *name, unsigned int length);
+
+#endif //TCPP_PREDEFINED_H
@@ -0,0 +1,1167 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "preprocess.h"
+#include "args.h"
+#include "symbol.h"
+#include "file.h"
+#include "stats.h"
+#include "trace.h"
+#include "tokenizer.h"
+#include "expression.h"
+#include "macro.h"
+#include "predefined.h"
+#include "layout.h"
+
+/**
+ * The maximum depth of nested includes, the same as GCC's.
+ */
+static const int max_include_depth = 200;
+
+/**
+ * The size up to which a streaming preprocessor's arena grows before it is replaced (see start_chunk).
+ */
+static const size_t stream_chunk_size = 0x100000;
+
+/**
+ * Stores information about an open conditional directive (#ifdef, #ifndef, etc.).
+ *
+ * IS_TAKEN is set once one of the conditional's groups has been taken, so that the following ones are skipped.
+ */
+typedef struct Conditional {
+    Location location;
+
+    int is_taken;
+    int has_else;
+    int is_guard;
+
+    struct Conditional *parent;
+} Conditional;
+
+/**
+ * The states of detecting whether a file is wrapped in an include guard.
+ */
+typedef enum GuardState {
+    GUARD_NONE,
+    GUARD_EXPECTED,
+    GUARD_OPEN,
+    GUARD_CLOSED
+} GuardState;
+
+/**
+ * Stores the position of reading in one of the files on the include stack.
+ *
+ * Tokens of a shared reader belong to the header cache and are copied into the output. Tokens of the main file are
+ * moved into the output instead. Gap tokens are tokenized as they are reached, leaving the lists of headers tokenized
+ * for the translation units which include them later.
+ *
+ * LAST is the token read before TOKEN. Other translation units might tokenize the gaps of a shared list at the same
+ * time, so a reader which reaches a gap continues with whatever follows LAST once it holds the header's lock.
+ *
+ * Expansion readers read the result of a macro expansion instead of a file, so that it is rescanned for further
+ * macros together with the rest of the file.
+ *
+ * GUARD is the macro of the '#ifndef' which opens the file, if that is the first thing in it. It becomes the header's
+ * include guard if the matching '#endif' is the last thing in the file.
+ *
+ * TRACED is the start of the trace span of reading a header (see trace.h).
+ */
+typedef struct Reader {
+    TokenList *list;
+    Token *token;
+    Token *last;
+    int is_shared;
+    int is_expansion;
+
+    Header *header;
+    Location include_location;
+    int depth;
+
+    Conditional *conditional;
+    GuardState guard_state;
+    unsigned int guard;
+
+    uint64_t traced;
+
+    struct Reader *parent;
+} Reader;
+
+/**
+ * Stores the state of preprocessing a single translation unit. IS_ABORTED is set by errors which stop it.
+ *
+ * The output is collected in OUTPUT, unless STREAM has a writer, in which case it is laid out through the writer as it
+ * is produced. Macros are allocated from MACRO_ARENA and everything else from ARENA. When streaming, ARENA only holds
+ * the current chunk of the translation unit and is replaced once it has grown large enough.
+ */
+typedef struct Preprocessor {
+    TokenList *output;
+    Layout stream;
+
+    Arena *arena;
+    Arena *macro_arena;
+
+    Reader *reader;
+    MacroTable macro_table;
+
+    HeaderCache *cache;
+    FileList *files;
+    FileList *misses;
+
+    unsigned char *included;
+    unsigned int included_size;
+
+    int is_aborted;
+} Preprocessor;
+
+/**
+ * Starts reading a token list on top of the include stack.
+ *
+ * @param preprocessor The preprocessor which reads the list.
+ * @param list The token list to read.
+ * @param header The header to which the list belongs (its tokens are shared), NULL for the main file.
+ * @param include_location The location of the directive which included the list.
+ */
+static void push_reader(Preprocessor *preprocessor, TokenList *list, Header *header, Location include_location) {
+    Reader *reader = arena_alloc(preprocessor->arena, sizeof *reader);
+
+    reader->list = list;
+    reader->token = __atomic_load_n(&list->front_token, __ATOMIC_ACQUIRE);
+    reader->is_shared = header != NULL;
+    reader->header = header;
+    reader->include_location = include_location;
+    reader->guard_state = header ? GUARD_EXPECTED : GUARD_NONE;
+    reader->parent = preprocessor->reader;
+    reader->depth = reader->parent ? reader->parent->depth + 1 : 0;
+    reader->traced = header ? trace_begin() : 0;
+
+    preprocessor->reader = reader;
+}
+
+/**
+ * Tokenizes the gap a reader has reached, or skips in it (see skip_gap) if DEPTH is given. Only the directive lines are
+ * tokenized if just the dependencies are needed ('-M').
+ *
+ * Gaps of shared lists are only touched with the header's lock held. If another translation unit has tokenized the
+ * gap in the meantime, the reader continues with the tokens which now follow its previous token instead.
+ *
+ * @param reader The reader which has reached the gap.
+ * @param prev The token read before the gap (NULL at the front of the list), set to the predecessor of the returned
+ *  token.
+ * @param gap The gap.
+ * @param depth The nesting depth of conditionals to skip in, NULL to tokenize the gap.
+ * @return The first token following the gap, or the '#' token ending the skipped group.
+ */
+static Token *resolve_gap(Reader *reader, Token **prev, Token *gap, int *depth) {
+    int is_skipped = depth || args->dependencies_only;
+
+    if (!reader->is_shared) {
+        return is_skipped ? skip_gap(reader->list, gap, depth) : tokenize_gap(reader->list, gap);
+    }
+
+    pthread_mutex_lock(&reader->header->lock);
+
+    Token *token = *prev ? (*prev)->next : reader->list->front_token;
+
+    if (token && token->is_gap) {
+        token = is_skipped ? skip_gap(reader->list, token, depth) : tokenize_gap(reader->list, token);
+
+        if (token) {
+            *prev = token->prev;
+        }
+    }
+
+    pthread_mutex_unlock(&reader->header->lock);
+
+    return token;
+}
+
+/**
+ * Finishes reading the file on top of the include stack.
+ *
+ * @param preprocessor The preprocessor which reads the file.
+ */
+static void pop_reader(Preprocessor *preprocessor) {
+    Reader *reader = preprocessor->reader;
+
+    for (Conditional *conditional = reader->conditional; conditional; conditional = conditional->parent) {
+        fprintf(stderr, "%s:%d: Unterminated conditional directive.\n",
+                file_table_name(conditional->location.file), conditional->location.line);
+    }
+
+    if (reader->header && reader->guard_state == GUARD_CLOSED) {
+        pthread_mutex_lock(&reader->header->lock);
+        reader->header->guard = reader->guard;
+        pthread_mutex_unlock(&reader->header->lock);
+    }
+
+    if (reader->header) {
+        trace_end(TRACE_INCLUDE, reader->traced, reader->header->file, SYMBOL_NONE, (uint64_t) reader->depth);
+    }
+
+    preprocessor->reader = reader->parent;
+}
+
+/**
+ * Writes an empty token to the output of a preprocessor, which only moves the output to a location.
+ *
+ * @param preprocessor The preprocessor to which to write.
+ * @param location The location.
+ */
+static void emit_spacer(Preprocessor *preprocessor, Location location) {
+    if (preprocessor->stream.writer) {
+        Token spacer = {.location = location};
+        layout_token(&preprocessor->stream, &spacer);
+        return;
+    }
+
+    Token *spacer = arena_alloc(preprocessor->arena, sizeof *spacer);
+    spacer->location = location;
+
+    append_token(preprocessor->output, spacer);
+}
+
+/**
+ * Reads the next token from the include stack. Finished files are popped from the stack, inserting a spacer token
+ * which moves the output back to the line after the include directive.
+ *
+ * @param preprocessor The preprocessor from which to read.
+ * @return The next token, NULL at the end of the translation unit.
+ */
+static Token *next_token(Preprocessor *preprocessor) {
+    Reader *reader;
+
+    while ((reader = preprocessor->reader) && (!reader->token || reader->token->is_gap)) {
+        if (reader->token) {
+            reader->token = resolve_gap(reader, &reader->last, reader->token, NULL);
+            continue;
+        }
+
+        if (reader->is_expansion) {
+            preprocessor->reader = reader->parent;
+            continue;
+        }
+
+        pop_reader(preprocessor);
+
+        if (reader->parent) {
+            emit_spacer(preprocessor, (Location) {reader->include_location.file, reader->include_location.line + 1});
+        }
+    }
+
+    if (!reader) {
+        return NULL;
+    }
+
+    Token *token = reader->token;
+    reader->token = token_next(token);
+    reader->last = token;
+
+    return token;
+}
+
+/**
+ * Reads the next token from the include stack if it is on a given line. Gaps always start on a new line, so the rest
+ * of the line has been tokenized already.
+ *
+ * @param preprocessor The preprocessor from which to read.
+ * @param line A location on the line.
+ * @return The next token, NULL if there are no more tokens on the line.
+ */
+static Token *next_line_token(Preprocessor *preprocessor, Location line) {
+    Reader *reader = preprocessor->reader;
+
+    if (!reader->token || reader->token->is_gap || !is_on_line(reader->token, line)) {
+        return NULL;
+    }
+
+    Token *token = reader->token;
+    reader->token = token_next(token);
+    reader->last = token;
+
+    return token;
+}
+
+/**
+ * Skips all the remaining tokens on a given line.
+ *
+ * @param preprocessor The preprocessor in which to skip.
+ * @param line A location on the line.
+ */
+static void skip_line(Preprocessor *preprocessor, Location line) {
+    while (next_line_token(preprocessor, line)) {}
+}
+
+/**
+ * Starts reading the result of a macro expansion on top of the include stack.
+ *
+ * @param preprocessor The preprocessor which reads the result.
+ * @param tokens The first token of the result.
+ */
+static void push_expansion(Preprocessor *preprocessor, Token *tokens) {
+    Reader *reader = arena_alloc(preprocessor->arena, sizeof *reader);
+
+    reader->token = tokens;
+    reader->is_expansion = 1;
+    reader->parent = preprocessor->reader;
+    reader->depth = reader->parent->depth;
+
+    preprocessor->reader = reader;
+}
+
+/**
+ * Peeks the next token of the current file, including the results of macro expansions on top of it.
+ *
+ * @param preprocessor The preprocessor from which to peek.
+ * @return The next token, NULL at the end of the file.
+ */
+static Token *peek_token(Preprocessor *preprocessor) {
+    for (Reader *reader = preprocessor->reader; reader; reader = reader->parent) {
+        while (reader->token && reader->token->is_gap) {
+            reader->token = resolve_gap(reader, &reader->last, reader->token, NULL);
+        }
+
+        if (reader->token || !reader->is_expansion) {
+            return reader->token;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Expands a macro invocation, and starts reading the result of the expansion. The arguments of a function-like
+ * macro are read from the current file, and the results of expansions on top of it.
+ *
+ * @param preprocessor The preprocessor in which to expand.
+ * @param name The name token of the invocation.
+ * @param macro The invoked macro.
+ * @return 1 if the macro was invoked, 0 if it is a function-like macro whose name is not followed by '('.
+ */
+static int expand_invocation(Preprocessor *preprocessor, Token *name, Macro *macro) {
+    StatsPhase phase = stats_enter(PHASE_MACRO);
+    uint64_t start = trace_begin();
+    Token head = {0};
+
+    if (macro->is_function) {
+        Token *token = peek_token(preprocessor);
+        Token *back = &head;
+        int depth = 0;
+
+        if (!token || token->operator != '(') {
+            stats_leave(phase);
+            return 0;
+        }
+
+        // Copy the invocation up to its ')', the copies get linked into the expansion
+        while (peek_token(preprocessor) && (token = next_token(preprocessor))) {
+            back->next = copy_token(preprocessor->arena, token);
+            back = back->next;
+
+            depth += (token->operator == '(') - (token->operator == ')');
+            if (depth == 0) {
+                break;
+            }
+        }
+    }
+
+    Token *expansion = expand_macro(&preprocessor->macro_table, preprocessor->arena, macro, name, head.next);
+
+    if (expansion) {
+        push_expansion(preprocessor, expansion);
+    }
+
+    trace_end(TRACE_MACRO, start, name->location.file, name->symbol, 0);
+    stats_add(COUNTER_MACRO_EXPANSIONS, 1);
+    stats_leave(phase);
+
+    return 1;
+}
+
+/**
+ * Checks if a token starts a directive, i.e. it is a '#' followed by a directive's name. Comments between them (with
+ * 'keep_comments') are skipped.
+ *
+ * @param token The token to be checked.
+ * @return The directive's name token, NULL if the token does not start a directive.
+ */
+static Token *directive_name(const Token *token) {
+    Token *next = token->operator == '#' ? token_next(token) : NULL;
+
+    while (next && next->is_comment) {
+        next = token_next(next);
+    }
+
+    return (next && next->is_directive) ? next : NULL;
+}
+
+/**
+ * Opens a new conditional in the file on top of the include stack.
+ *
+ * @param preprocessor The preprocessor in which to open the conditional.
+ * @param hash The '#' token of the conditional directive.
+ * @return The newly opened conditional.
+ */
+static Conditional *push_conditional(Preprocessor *preprocessor, Token *hash) {
+    Reader *reader = preprocessor->reader;
+    Conditional *conditional = arena_alloc(preprocessor->arena, sizeof *conditional);
+
+    conditional->location = hash->location;
+    conditional->parent = reader->conditional;
+    reader->conditional = conditional;
+
+    return conditional;
+}
+
+/**
+ * Closes the innermost conditional of the file on top of the include stack.
+ *
+ * @param preprocessor The preprocessor in which to close the conditional.
+ */
+static void pop_conditional(Preprocessor *preprocessor) {
+    Reader *reader = preprocessor->reader;
+
+    // Only a guard without '#else' or '#elif' guards the file
+    if (reader->conditional->is_guard && reader->guard_state == GUARD_OPEN) {
+        reader->guard_state = GUARD_CLOSED;
+    }
+
+    reader->conditional = reader->conditional->parent;
+}
+
+/**
+ * Skips the tokens of an inactive group, up to the conditional directive which ends it. Nested conditionals are
+ * skipped as a whole.
+ *
+ * Parts of the file which have not been tokenized yet are skipped by scanning for directives at the start of lines,
+ * without generating any tokens for them.
+ *
+ * @param preprocessor The preprocessor in which to skip.
+ * @return The '#' token of the directive which ends the group, NULL if the file ends first. The directive's name has
+ *  been read already.
+ */
+static Token *skip_group(Preprocessor *preprocessor) {
+    Reader *reader = preprocessor->reader;
+    Token *prev = reader->last;
+    int depth = 0;
+
+    for (Token *token = reader->token; token;) {
+        if (token->is_gap) {
+            token = resolve_gap(reader, &prev, token, &depth);
+            continue;
+        }
+
+        Token *hash = token;
+        Token *name = directive_name(hash);
+        prev = token;
+        token = token_next(token);
+
+        if (!name) {
+            continue;
+        }
+
+        if (name->symbol == SYMBOL_IF || name->symbol == SYMBOL_IFDEF || name->symbol == SYMBOL_IFNDEF) {
+            depth++;
+        } else if (name->symbol == SYMBOL_ELIF || name->symbol == SYMBOL_ELSE || name->symbol == SYMBOL_ENDIF) {
+            if (depth == 0) {
+                reader->token = token_next(name);
+                reader->last = name;
+                return hash;
+            }
+
+            if (name->symbol == SYMBOL_ENDIF) {
+                depth--;
+            }
+        }
+    }
+
+    reader->token = NULL;
+    return NULL;
+}
+
+/**
+ * Reads the next token of a condition's line, skipping the comments kept by '-c'.
+ *
+ * @param preprocessor The preprocessor from which to read.
+ * @param hash The '#' token of the directive.
+ * @return The token, or NULL at the end of the line.
+ */
+static Token *next_condition_token(Preprocessor *preprocessor, Token *hash) {
+    Token *token;
+
+    while ((token = next_line_token(preprocessor, hash->location)) && token->is_comment) {}
+
+    return token;
+}
+
+/**
+ * Evaluates the condition of an #if or #elif directive, reading the rest of its line.
+ *
+ * 'defined' operators are replaced with 1 or 0 before the line is macro-expanded. Errors abort preprocessing.
+ *
+ * @param preprocessor The preprocessor in which to evaluate.
+ * @param hash The '#' token of the directive.
+ * @return 1 if the condition is true, 0 otherwise.
+ */
+static int evaluate_condition(Preprocessor *preprocessor, Token *hash) {
+    Token head = {0};
+    Token *back = &head;
+
+    for (Token *token; (token = next_condition_token(preprocessor, hash));) {
+        Token *copy = copy_token(preprocessor->arena, token);
+
+        if (token->symbol == SYMBOL_DEFINED) {
+            // defined X or defined(X)
+            Token *name = next_condition_token(preprocessor, hash);
+            int has_parenthesis = name && name->operator == '(';
+
+            if (has_parenthesis) {
+                name = next_condition_token(preprocessor, hash);
+            }
+
+            Token *parenthesis = has_parenthesis ? next_condition_token(preprocessor, hash) : NULL;
+
+            if (!name || !name->is_identifier || (has_parenthesis && !(parenthesis && parenthesis->operator == ')'))) {
+                fprintf(stderr, "%s:%d: Operator 'defined' requires an identifier.\n",
+                        file_table_name(hash->location.file), hash->location.line);
+                skip_line(preprocessor, hash->location);
+                preprocessor->is_aborted = 1;
+                return 0;
+            }
+
+            copy->string = macro_table_get(&preprocessor->macro_table, name->symbol) ? "1" : "0";
+            copy->length = 1;
+            copy->is_identifier = 0;
+            copy->is_number = 1;
+            copy->symbol = SYMBOL_NONE;
+        }
+
+        back->next = copy;
+        back = copy;
+    }
+
+    Token *tokens = expand_tokens(&preprocessor->macro_table, preprocessor->arena, head.next);
+    int is_true;
+
+    if (!evaluate_expression(tokens, hash->location, &is_true)) {
+        preprocessor->is_aborted = 1;
+    }
+
+    return is_true;
+}
+
+/**
+ * Skips inactive groups of the innermost conditional until one is taken or the conditional is closed.
+ *
+ * @param preprocessor The preprocessor in which to skip.
+ */
+static void skip_inactive_groups(Preprocessor *preprocessor) {
+    Token *hash;
+
+    while ((hash = skip_group(preprocessor))) {
+        Conditional *conditional = preprocessor->reader->conditional;
+        unsigned int symbol = directive_name(hash)->symbol;
+
+        if (symbol == SYMBOL_ENDIF) {
+            skip_line(preprocessor, hash->location);
+            pop_conditional(preprocessor);
+            return;
+        }
+
+        if (conditional->has_else) {
+            fprintf(stderr, "%s:%d: #%s after #else.\n", file_table_name(hash->location.file), hash->location.line,
+                    symbol == SYMBOL_ELSE ? "else" : "elif");
+        }
+
+        if (conditional->is_guard) {
+            preprocessor->reader->guard_state = GUARD_NONE;
+        }
+
+        if (symbol == SYMBOL_ELSE) {
+            conditional->has_else = 1;
+            skip_line(preprocessor, hash->location);
+
+            if (!conditional->is_taken) {
+                conditional->is_taken = 1;
+                return;
+            }
+
+            continue;
+        }
+
+        // SYMBOL_ELIF, its condition is only evaluated if no group has been taken yet
+        if (conditional->is_taken) {
+            skip_line(preprocessor, hash->location);
+        } else if (evaluate_condition(preprocessor, hash)) {
+            conditional->is_taken = 1;
+            return;
+        }
+    }
+}
+
+/**
+ * Processes an if directive.
+ *
+ * @param preprocessor The preprocessor in which to process.
+ * @param hash The '#' token of the directive.
+ */
+static void process_if(Preprocessor *preprocessor, Token *hash) {
+    int is_true = evaluate_condition(preprocessor, hash);
+    Conditional *conditional = push_conditional(preprocessor, hash);
+
+    conditional->is_taken = is_true;
+
+    if (!conditional->is_taken) {
+        skip_inactive_groups(preprocessor);
+    }
+}
+
+/**
+ * Processes an ifdef or an ifndef directive.
+ *
+ * @param preprocessor The preprocessor in which to process.
+ * @param hash The '#' token of the directive.
+ * @param is_ifndef Non-zero for an ifndef directive.
+ */
+static void process_ifdef(Preprocessor *preprocessor, Token *hash, int is_ifndef) {
+    Reader *reader = preprocessor->reader;
+    Token *name = next_line_token(preprocessor, hash->location);
+    skip_line(preprocessor, hash->location);
+
+    Conditional *conditional = push_conditional(preprocessor, hash);
+
+    if (!name || !name->is_identifier) {
+        fprintf(stderr, "%s:%d: No macro name given in #%s directive.\n", file_table_name(hash->location.file),
+                hash->location.line, is_ifndef ? "ifndef" : "ifdef");
+    } else {
+        conditional->is_taken = (macro_table_get(&preprocessor->macro_table, name->symbol) != NULL) != is_ifndef;
+
+        // An '#ifndef' at the very beginning of a file might be its include guard
+        if (is_ifndef && reader->guard_state == GUARD_EXPECTED && !conditional->parent) {
+            conditional->is_guard = 1;
+            reader->guard_state = GUARD_OPEN;
+            reader->guard = name->symbol;
+        }
+    }
+
+    if (!conditional->is_taken) {
+        skip_inactive_groups(preprocessor);
+    }
+}
+
+/**
+ * Processes an else or an elif directive in a taken group. The rest of the conditional is skipped.
+ *
+ * @param preprocessor The preprocessor in which to process.
+ * @param hash The '#' token of the directive.
+ * @param is_elif Non-zero for an elif directive.
+ */
+static void process_else(Preprocessor *preprocessor, Token *hash, int is_elif) {
+    Conditional *conditional = preprocessor->reader->conditional;
+    const char *name = is_elif ? "elif" : "else";
+    skip_line(preprocessor, hash->location);
+
+    if (!conditional) {
+        fprintf(stderr, "%s:%d: #%s without #if.\n", file_table_name(hash->location.file), hash->location.line, name);
+        return;
+    }
+
+    if (conditional->has_else) {
+        fprintf(stderr, "%s:%d: #%s after #else.\n", file_table_name(hash->location.file), hash->location.line, name);
+    }
+
+    conditional->has_else |= !is_elif;
+
+    if (conditional->is_guard) {
+        preprocessor->reader->guard_state = GUARD_NONE;
+    }
+
+    skip_inactive_groups(preprocessor);
+}
+
+/**
+ * Processes an endif directive in a taken group.
+ *
+ * @param preprocessor The preprocessor in which to process.
+ * @param hash The '#' token of the directive.
+ */
+static void process_endif(Preprocessor *preprocessor, Token *hash) {
+    skip_line(preprocessor, hash->location);
+
+    if (!preprocessor->reader->conditional) {
+        fprintf(stderr, "%s:%d: #endif without #if.\n", file_table_name(hash->location.file), hash->location.line);
+        return;
+    }
+
+    pop_conditional(preprocessor);
+}
+
+/**
+ * Processes an undef directive.
+ *
+ * @param preprocessor The preprocessor in which to process.
+ * @param hash The '#' token of the directive.
+ */
+static void process_undef(Preprocessor *preprocessor, Token *hash) {
+    StatsPhase phase = stats_enter(PHASE_MACRO);
+    Token *name = next_line_token(preprocessor, hash->location);
+    skip_line(preprocessor, hash->location);
+
+    if (name && name->is_identifier) {
+        macro_table_set(&preprocessor->macro_table, name->symbol, NULL);
+    }
+
+    stats_leave(phase);
+}
+
+/**
+ * Processes a pragma directive. Only '#pragma once' is processed, other pragmas are left in the output.
+ *
+ * @param preprocessor The preprocessor in which to process.
+ * @param hash The '#' token of the directive.
+ * @return 1 if the directive was processed, 0 otherwise.
+ */
+static int process_pragma(Preprocessor *preprocessor, Token *hash) {
+    Reader *reader = preprocessor->reader;
+    Token *name = reader->token;
+    Token *next = name ? token_next(name) : NULL;
+
+    if (!name || !is_on_line(name, hash->location) || name->symbol != SYMBOL_ONCE ||
+        (next && !next->is_gap && is_on_line(next, hash->location))) {
+        return 0;
+    }
+
+    skip_line(preprocessor, hash->location);
+
+    if (reader->header) {
+        pthread_mutex_lock(&reader->header->lock);
+        reader->header->is_once = 1;
+        pthread_mutex_unlock(&reader->header->lock);
+    }
+
+    return 1;
+}
+
+/**
+ * Checks if a header has been included in the current translation unit.
+ *
+ * @param preprocessor The preprocessor in which the header is included.
+ * @param header The header to be checked.
+ * @return 1 if it has, 0 otherwise.
+ */
+static int is_included(const Preprocessor *preprocessor, const Header *header) {
+    return header->id < preprocessor->included_size && preprocessor->included[header->id];
+}
+
+/**
+ * Checks if including a header would have no effect, because it has '#pragma once' and has been included already,
+ * or because its include guard is defined.
+ *
+ * @param preprocessor The preprocessor in which the header is included.
+ * @param header The header to be checked.
+ * @return 1 if it can be skipped, 0 otherwise.
+ */
+static int is_header_skippable(const Preprocessor *preprocessor, Header *header) {
+    pthread_mutex_lock(&header->lock);
+    int is_once = header->is_once;
+    unsigned int guard = header->guard;
+    pthread_mutex_unlock(&header->lock);
+
+    if (is_once && is_included(preprocessor, header)) {
+        return 1;
+    }
+
+    return guard != SYMBOL_NONE && macro_table_get(&preprocessor->macro_table, guard) != NULL;
+}
+
+/**
+ * Adds a header to the files opened in the current translation unit if it has not been included in it yet. Headers
+ * skipped because of their include guard are added too, they are dependencies all the same.
+ *
+ * @param preprocessor The preprocessor in which the header is included.
+ * @param header The header to add.
+ */
+static void add_file(Preprocessor *preprocessor, const Header *header) {
+    if (!is_included(preprocessor, header)) {
+        file_list_append(preprocessor->files, header->file);
+    }
+}
+
+/**
+ * Remembers that a header has been included in the current translation unit.
+ *
+ * @param preprocessor The preprocessor in which the header is included.
+ * @param header The included header.
+ */
+static void mark_included(Preprocessor *preprocessor, const Header *header) {
+    if (header->id >= preprocessor->included_size) {
+        unsigned int size = preprocessor->included_size ? preprocessor->included_size : 0x40;
+        while (size <= header->id) {
+            size *= 2;
+        }
+
+        preprocessor->included = realloc(preprocessor->included, size * sizeof *preprocessor->included);
+
+        if (!preprocessor->included) {
+            fprintf(stderr, "Could not allocate enough memory.");
+            exit(EXIT_FAILURE);
+        }
+
+        memset(&preprocessor->included[preprocessor->included_size], 0, size - preprocessor->included_size);
+        preprocessor->included_size = size;
+    }
+
+    preprocessor->included[header->id] = 1;
+}
+
+/**
+ * Writes a token to the output of a preprocessor.
+ *
+ * @param preprocessor The preprocessor to which to write.
+ * @param token A token read from the preprocessor's current reader.
+ * @return The written token.
+ */
+static Token *emit_token(Preprocessor *preprocessor, Token *token) {
+    stats_add(COUNTER_TOKENS_EMITTED, 1);
+
+    if (preprocessor->stream.writer) {
+        layout_token(&preprocessor->stream, token);
+        return token;
+    }
+
+    if (preprocessor->reader->is_shared) {
+        token = copy_token(preprocessor->arena, token);
+    }
+
+    append_token(preprocessor->output, token);
+
+    return token;
+}
+
+/**
+ * Processes an include directive. The included header's tokens are read next.
+ *
+ * @param preprocessor The preprocessor in which to process.
+ * @param hash The '#' token of the directive.
+ */
+static void process_include(Preprocessor *preprocessor, Token *hash) {
+    Token *name = next_line_token(preprocessor, hash->location);
+    skip_line(preprocessor, hash->location);
+
+    int is_system = name && name->string[0] == '<';
+
+    if (!name || name->length < 2 || name->string[name->length - 1] != (is_system ? '>' : '"') ||
+        (!is_system && name->string[0] != '"')) {
+        if (name) {
+            fprintf(stderr, "Could not find '%.*s'.\n", name->length, name->string);
+        }
+
+        return;
+    }
+
+    if (preprocessor->reader->depth >= max_include_depth) {
+        fprintf(stderr, "Could not include '%.*s', includes nested too deeply.\n", name->length, name->string);
+        return;
+    }
+
+    char *file_name = include_search_resolve(preprocessor->cache->search, file_table_name(name->location.file),
+                                             &name->string[1], (size_t) name->length - 2, is_system,
+                                             preprocessor->misses);
+
+    // Missing system headers are left out, as the standard library is not preprocessed without '-I' directories
+    if (!file_name) {
+        fprintf(stderr, "Could not find '%.*s'.\n", name->length, name->string);
+        preprocessor->is_aborted = !is_system;
+        return;
+    }
+
+    // Headers retrieved in the current epoch are used without accessing the file system again
+    Header *header = header_cache_find(preprocessor->cache, file_name);
+
+    if (!header && !(header = header_cache_get(preprocessor->cache, file_name))) {
+        fprintf(stderr, "Could not open file %s.\n", file_name);
+        free(file_name);
+        preprocessor->is_aborted = 1;
+        return;
+    }
+
+    free(file_name);
+
+    // Add files newly opened in this translation unit to the file list
+    add_file(preprocessor, header);
+
+    if (is_header_skippable(preprocessor, header)) {
+        return;
+    }
+
+    mark_included(preprocessor, header);
+    push_reader(preprocessor, header->tokens, header, hash->location);
+}
+
+/**
+ * Processes a define directive.
+ *
+ * @param preprocessor The preprocessor in which to process.
+ * @param hash The '#' token of the directive.
+ */
+static void process_define(Preprocessor *preprocessor, Token *hash) {
+    StatsPhase phase = stats_enter(PHASE_MACRO);
+    Token *name = next_line_token(preprocessor, hash->location);
+
+    if (!name || !name->is_identifier) {
+        skip_line(preprocessor, hash->location);
+        stats_leave(phase);
+        return;
+    }
+
+    Macro *macro = new_macro(preprocessor->macro_arena, name, hash->location);
+    skip_line(preprocessor, hash->location);
+
+    if (macro) {
+        macro_table_set(&preprocessor->macro_table, name->symbol, macro);
+    }
+
+    stats_leave(phase);
+}
+
+/**
+ * Moves the state of a streaming preprocessor into a new arena and deletes the old one, together with all the tokens
+ * which have been written out of it. Everything read from the old arena must be done with by then, so this is only
+ * done between lines, while no macro expansion is being read and the main file is down to the gap covering its rest.
+ * The include stack, with its open conditionals, is copied over.
+ *
+ * @param preprocessor The preprocessor whose arena to replace.
+ */
+static void start_chunk(Preprocessor *preprocessor) {
+    Reader *main_reader = NULL;
+
+    // Expansions which have been read in full would only be popped by next_token
+    while (preprocessor->reader && preprocessor->reader->is_expansion && !preprocessor->reader->token) {
+        preprocessor->reader = preprocessor->reader->parent;
+    }
+
+    for (Reader *reader = preprocessor->reader; reader; reader = reader->parent) {
+        if (reader->is_expansion) {
+            return;
+        }
+
+        main_reader = reader;
+    }
+
+    Token *gap = main_reader ? main_reader->token : NULL;
+
+    if (!main_reader || (gap && (!gap->is_gap || gap->next))) {
+        return;
+    }
+
+    Arena *arena = new_arena();
+    Reader **link = &preprocessor->reader;
+
+    for (Reader *reader = preprocessor->reader; reader; reader = reader->parent) {
+        Reader *copy = arena_alloc(arena, sizeof *copy);
+        *copy = *reader;
+
+        Conditional **conditional_link = &copy->conditional;
+
+        for (Conditional *conditional = reader->conditional; conditional; conditional = conditional->parent) {
+            *conditional_link = arena_alloc(arena, sizeof **conditional_link);
+            **conditional_link = *conditional;
+            conditional_link = &(*conditional_link)->parent;
+        }
+
+        *link = copy;
+        link = &copy->parent;
+        main_reader = copy;
+    }
+
+    // The new first token of the main file has no predecessor, which means that it starts a line
+    TokenList *list = main_reader->list;
+    main_reader->token = gap ? copy_token(arena, gap) : NULL;
+    main_reader->last = NULL;
+    list->front_token = list->back_token = main_reader->token;
+    list->arena = arena;
+
+    // The first arena holds the token lists themselves, it is only deleted together with them
+    if (preprocessor->arena != preprocessor->output->arena) {
+        delete_arena(preprocessor->arena);
+    }
+
+    preprocessor->arena = arena;
+}
+
+/**
+ * Reads the next token from the include stack like next_token, but starts a new chunk first if the arena of a
+ * streaming preprocessor has grown large enough. Only to be called between the tokens of the main loop.
+ *
+ * @param preprocessor The preprocessor from which to read.
+ * @return The next token, NULL at the end of the translation unit.
+ */
+static Token *next_chunked_token(Preprocessor *preprocessor) {
+    if (preprocessor->stream.writer && preprocessor->arena->size >= stream_chunk_size) {
+        start_chunk(preprocessor);
+    }
+
+    return next_token(preprocessor);
+}
+
+/**
+ * Preprocesses a list of raw tokens.
+ *
+ * TODO: Line control
+ * TODO: Other directives
+ *
+ * With a STREAM writer, the output is written through it while the tokens are read, instead of being collected into
+ * the preprocessed list, and the consumed tokens are freed as preprocessing goes on. Memory then only grows with the
+ * nesting of includes, conditionals and macros, not with the size of the translation unit.
+ *
+ * If only the dependencies are needed ('-M'), just the directives are tokenized and processed, so that FILES gets
+ * filled, while the output stays empty.
+ *
+ * @param token_list A token list to preprocess. Its tokens are moved into the preprocessed list.
+ * @param cache A header cache from which to read included headers.
+ * @param files A list to which to append the files opened while preprocessing.
+ * @param misses A list to which to append the paths probed for included headers without finding them, NULL to leave
+ *  them out.
+ * @param stream A writer through which to stream the output (not closed), NULL to collect it.
+ * @return A newly generated, preprocessed token list, allocated from the arena of TOKEN_LIST (empty when streaming).
+ *  NULL if preprocessing was stopped by an error, like a missing header. The output streamed until then is left as it
+ *  is.
+ */
+TokenList *preprocess_token_list(TokenList *token_list, HeaderCache *cache, FileList *files, FileList *misses,
+                                 Writer *stream) {
+    Preprocessor preprocessor = {new_token_list(token_list->arena), {stream}, token_list->arena,
+                                 stream ? new_arena() : token_list->arena, NULL, {NULL, 0, predefined_macros},
+                                 cache, files, misses, NULL, 0, 0};
+
+    if (!token_list->front_token) {
+        if (stream) {
+            delete_arena(preprocessor.macro_arena);
+        }
+
+        return preprocessor.output;
+    }
+
+    verbose_printf("Preprocessing file %s.\n", file_table_name(token_list->front_token->location.file));
+
+    // Start reading the included headers while the file is being preprocessed
+    header_cache_prefetch(cache, token_list);
+
+    push_reader(&preprocessor, token_list, NULL, token_list->front_token->location);
+
+    // The linemarkers start with the input file, even if its first tokens come from a header
+    if (args->line_markers) {
+        emit_spacer(&preprocessor, (Location) {token_list->front_token->location.file, 1});
+    }
+
+    for (Token *token; !preprocessor.is_aborted && (token = next_chunked_token(&preprocessor));) {
+        Reader *reader = preprocessor.reader;
+        Token *directive = reader->is_expansion ? NULL : directive_name(token);
+
+        // Anything but the guard's conditional itself means that the file is not wrapped in an include guard
+        if (reader->guard_state != GUARD_OPEN && reader->guard_state != GUARD_NONE && !token->is_comment &&
+            !(reader->guard_state == GUARD_EXPECTED && directive && directive->symbol == SYMBOL_IFNDEF)) {
+            reader->guard_state = GUARD_NONE;
+        }
+
+        if (directive) {
+            int is_processed = 1;
+
+            while (next_token(&preprocessor) != directive) {
+            }
+
+            switch (directive->symbol) {
+                case SYMBOL_INCLUDE: {
+                    StatsPhase phase = stats_enter(PHASE_INCLUDE);
+                    process_include(&preprocessor, token);
+                    stats_leave(phase);
+                    break;
+                }
+                case SYMBOL_DEFINE:
+                    process_define(&preprocessor, token);
+                    break;
+                case SYMBOL_UNDEF:
+                    process_undef(&preprocessor, token);
+                    break;
+
+                case SYMBOL_IF:
+                    process_if(&preprocessor, token);
+                    break;
+                case SYMBOL_IFDEF:
+                case SYMBOL_IFNDEF:
+                    process_ifdef(&preprocessor, token, directive->symbol == SYMBOL_IFNDEF);
+                    break;
+                case SYMBOL_ELIF:
+                case SYMBOL_ELSE:
+                    process_else(&preprocessor, token, directive->symbol == SYMBOL_ELIF);
+                    break;
+                case SYMBOL_ENDIF:
+                    process_endif(&preprocessor, token);
+                    break;
+
+                case SYMBOL_PRAGMA:
+                    is_processed = process_pragma(&preprocessor, token);
+                    break;
+
+                default:
+                    is_processed = 0;
+            }
+
+            if (is_processed) {
+                continue;
+            }
+
+            // Other directives make no difference to the dependencies
+            if (args->dependencies_only) {
+                skip_line(&preprocessor, token->location);
+                continue;
+            }
+
+            // Leave other directives in the output as they are, without expanding macros in them
+            emit_token(&preprocessor, token);
+            emit_token(&preprocessor, directive);
+
+            for (Token *next; (next = next_line_token(&preprocessor, token->location));) {
+                emit_token(&preprocessor, next);
+            }
+
+            continue;
+        }
+
+        // Null directive, a '#' alone on its line
+        if (token->operator == '#' && !reader->is_expansion &&
+            (!token->prev || !is_on_line(token, token->prev->location)) &&
+            (!reader->token || reader->token->is_gap || !is_on_line(reader->token, token->location))) {
+            continue;
+        }
+
+        // Only the directives are followed for the dependencies, the text is left as it is
+        if (args->dependencies_only) {
+            continue;
+        }
+
+        Macro *macro = find_macro(&preprocessor.macro_table, token);
+
+        if (macro && expand_invocation(&preprocessor, token, macro)) {
+            continue;
+        }
+
+        emit_token(&preprocessor, token);
+    }
+
+    if (stream) {
+        layout_finish(&preprocessor.stream);
+
+        if (preprocessor.arena != preprocessor.output->arena) {
+            delete_arena(preprocessor.arena);
+            token_list->arena = preprocessor.output->arena;
+            token_list->front_token = token_list->back_token = NULL;
+        }
+
+        delete_arena(preprocessor.macro_arena);
+    }
+
+    delete_macro_table(&preprocessor.macro_table);
+    free(preprocessor.included);
+
+    return preprocessor.is_aborted ? NULL : preprocessor.output;
+}
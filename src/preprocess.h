@@ -0,0 +1,12 @@
+#ifndef TCPP_PREPROCESS_H
+#define TCPP_PREPROCESS_H
+
+#include "token.h"
+#include "header.h"
+#include "writer.h"
+#include "file.h"
+
+TokenList *preprocess_token_list(TokenList *token_list, HeaderCache *cache, FileList *files, FileList *misses,
+                                 Writer *stream);
+
+#endif //TCPP_PREPROCESS_H
@@ -0,0 +1,196 @@
+#include <stdint.h>
+#include "scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SCAN_NEON
+#endif
+
+/**
+ * Scalar version of scan_find_any. Also used for the tails of the vectorized versions.
+ */
+static const char *find_any_scalar(const char *start, const char *end, char ch1, char ch2, char ch3, char ch4) {
+    for (; start < end; start++) {
+        if (*start == ch1 || *start == ch2 || *start == ch3 || *start == ch4) {
+            break;
+        }
+    }
+
+    return start;
+}
+
+/**
+ * Scalar version of scan_skip_blanks. Also used for the tails of the vectorized versions.
+ */
+static const char *skip_blanks_scalar(const char *start, const char *end) {
+    while (start < end && (*start == ' ' || *start == '\t')) {
+        start++;
+    }
+
+    return start;
+}
+
+#ifdef SCAN_X86
+
+/**
+ * SSE2 version of scan_find_any, 16 characters at a time.
+ */
+__attribute__((target("sse2")))
+static const char *find_any_sse2(const char *start, const char *end, char ch1, char ch2, char ch3, char ch4) {
+    const __m128i v1 = _mm_set1_epi8(ch1), v2 = _mm_set1_epi8(ch2), v3 = _mm_set1_epi8(ch3), v4 = _mm_set1_epi8(ch4);
+
+    for (; end - start >= 16; start += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i *) start);
+        __m128i match = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, v1), _mm_cmpeq_epi8(block, v2)),
+                                     _mm_or_si128(_mm_cmpeq_epi8(block, v3), _mm_cmpeq_epi8(block, v4)));
+        unsigned int mask = (unsigned int) _mm_movemask_epi8(match);
+
+        if (mask) {
+            return start + __builtin_ctz(mask);
+        }
+    }
+
+    return find_any_scalar(start, end, ch1, ch2, ch3, ch4);
+}
+
+/**
+ * SSE2 version of scan_skip_blanks, 16 characters at a time.
+ */
+__attribute__((target("sse2")))
+static const char *skip_blanks_sse2(const char *start, const char *end) {
+    const __m128i space = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t');
+
+    for (; end - start >= 16; start += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i *) start);
+        __m128i blank = _mm_or_si128(_mm_cmpeq_epi8(block, space), _mm_cmpeq_epi8(block, tab));
+        unsigned int mask = ~(unsigned int) _mm_movemask_epi8(blank) & 0xffffu;
+
+        if (mask) {
+            return start + __builtin_ctz(mask);
+        }
+    }
+
+    return skip_blanks_scalar(start, end);
+}
+
+/**
+ * AVX2 version of scan_find_any, 32 characters at a time.
+ */
+__attribute__((target("avx2")))
+static const char *find_any_avx2(const char *start, const char *end, char ch1, char ch2, char ch3, char ch4) {
+    const __m256i v1 = _mm256_set1_epi8(ch1), v2 = _mm256_set1_epi8(ch2);
+    const __m256i v3 = _mm256_set1_epi8(ch3), v4 = _mm256_set1_epi8(ch4);
+
+    for (; end - start >= 32; start += 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i *) start);
+        __m256i match = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(block, v1), _mm256_cmpeq_epi8(block, v2)),
+                                        _mm256_or_si256(_mm256_cmpeq_epi8(block, v3), _mm256_cmpeq_epi8(block, v4)));
+        unsigned int mask = (unsigned int) _mm256_movemask_epi8(match);
+
+        if (mask) {
+            return start + __builtin_ctz(mask);
+        }
+    }
+
+    return find_any_sse2(start, end, ch1, ch2, ch3, ch4);
+}
+
+/**
+ * AVX2 version of scan_skip_blanks, 32 characters at a time.
+ */
+__attribute__((target("avx2")))
+static const char *skip_blanks_avx2(const char *start, const char *end) {
+    const __m256i space = _mm256_set1_epi8(' '), tab = _mm256_set1_epi8('\t');
+
+    for (; end - start >= 32; start += 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i *) start);
+        __m256i blank = _mm256_or_si256(_mm256_cmpeq_epi8(block, space), _mm256_cmpeq_epi8(block, tab));
+        unsigned int mask = ~(unsigned int) _mm256_movemask_epi8(blank);
+
+        if (mask) {
+            return start + __builtin_ctz(mask);
+        }
+    }
+
+    return skip_blanks_sse2(start, end);
+}
+
+#endif //SCAN_X86
+
+#ifdef SCAN_NEON
+
+/**
+ * Converts a NEON comparison result into a 64-bit mask with 4 bits per character.
+ */
+static uint64_t neon_mask(uint8x16_t match) {
+    uint8x8_t narrowed = vshrn_n_u16(vreinterpretq_u16_u8(match), 4);
+    return vget_lane_u64(vreinterpret_u64_u8(narrowed), 0);
+}
+
+/**
+ * NEON version of scan_find_any, 16 characters at a time.
+ */
+static const char *find_any_neon(const char *start, const char *end, char ch1, char ch2, char ch3, char ch4) {
+    const uint8x16_t v1 = vdupq_n_u8((uint8_t) ch1), v2 = vdupq_n_u8((uint8_t) ch2);
+    const uint8x16_t v3 = vdupq_n_u8((uint8_t) ch3), v4 = vdupq_n_u8((uint8_t) ch4);
+
+    for (; end - start >= 16; start += 16) {
+        uint8x16_t block = vld1q_u8((const uint8_t *) start);
+        uint8x16_t match = vorrq_u8(vorrq_u8(vceqq_u8(block, v1), vceqq_u8(block, v2)),
+                                    vorrq_u8(vceqq_u8(block, v3), vceqq_u8(block, v4)));
+        uint64_t mask = neon_mask(match);
+
+        if (mask) {
+            return start + (__builtin_ctzll(mask) >> 2);
+        }
+    }
+
+    return find_any_scalar(start, end, ch1, ch2, ch3, ch4);
+}
+
+/**
+ * NEON version of scan_skip_blanks, 16 characters at a time.
+ */
+static const char *skip_blanks_neon(const char *start, const char *end) {
+    const uint8x16_t space = vdupq_n_u8(' '), tab = vdupq_n_u8('\t');
+
+    for (; end - start >= 16; start += 16) {
+        uint8x16_t block = vld1q_u8((const uint8_t *) start);
+        uint64_t mask = neon_mask(vmvnq_u8(vorrq_u8(vceqq_u8(block, space), vceqq_u8(block, tab))));
+
+        if (mask) {
+            return start + (__builtin_ctzll(mask) >> 2);
+        }
+    }
+
+    return skip_blanks_scalar(start, end);
+}
+
+#endif //SCAN_NEON
+
+const char *(*scan_find_any)(const char *, const char *, char, char, char, char) = find_any_scalar;
+
+const char *(*scan_skip_blanks)(const char *, const char *) = skip_blanks_scalar;
+
+/**
+ * Selects the fastest scanning kernels supported by the current CPU. Until called, the scalar kernels are used.
+ */
+void scan_init(void) {
+#if defined(SCAN_X86)
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2")) {
+        scan_find_any = find_any_avx2;
+        scan_skip_blanks = skip_blanks_avx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        scan_find_any = find_any_sse2;
+        scan_skip_blanks = skip_blanks_sse2;
+    }
+#elif defined(SCAN_NEON)
+    scan_find_any = find_any_neon;
+    scan_skip_blanks = skip_blanks_neon;
+#endif
+}
@@ -0,0 +1,25 @@
+#ifndef TCPP_SCAN_H
+#define TCPP_SCAN_H
+
+/**
+ * Finds the first character in [START, END) which is equal to any of the 4 given characters. Pass the same character
+ * several times to search for less than 4.
+ *
+ * Points to the fastest implementation available on the current CPU after scan_init.
+ *
+ * @return The position of the found character, END if there is none.
+ */
+extern const char *(*scan_find_any)(const char *start, const char *end, char ch1, char ch2, char ch3, char ch4);
+
+/**
+ * Finds the first character in [START, END) which is neither a space nor a horizontal tab.
+ *
+ * Points to the fastest implementation available on the current CPU after scan_init.
+ *
+ * @return The position of the found character, END if there is none.
+ */
+extern const char *(*scan_skip_blanks)(const char *start, const char *end);
+
+void scan_init(void);
+
+#endif //TCPP_SCAN_H
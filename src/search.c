@@ -0,0 +1,384 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "search.h"
+
+/**
+ * The values of the probes hash map. Hash maps cannot hold NULL values, so both results are non-zero.
+ */
+typedef enum ProbeResult {
+    PROBE_UNKNOWN,
+    PROBE_FOUND,
+    PROBE_MISSING
+} ProbeResult;
+
+/**
+ * Stores the state of a directory at the time it was first probed.
+ */
+typedef struct WatchedDirectory {
+    int exists;
+    struct timespec modified;
+} WatchedDirectory;
+
+/**
+ * Generates the (empty) hash maps and arena in which an include search remembers the file system.
+ *
+ * @param search The include search.
+ */
+static void init_memory(IncludeSearch *search) {
+    if (!(search->probes = new_hash_map(256, 0x1b873593)) || !(search->listings = new_hash_map(64, 0x1b873593)) ||
+        !(search->watched = new_hash_map(64, 0x1b873593))) {
+        fprintf(stderr, "Could not allocate enough memory.");
+        exit(EXIT_FAILURE);
+    }
+
+    search->arena = new_arena();
+}
+
+/**
+ * Deletes everything an include search remembers about the file system.
+ *
+ * @param search The include search.
+ */
+static void delete_memory(IncludeSearch *search) {
+    for (unsigned int i = 0; i < search->listings->size; i++) {
+        if (search->listings->entries[i].key) {
+            delete_hash_map(search->listings->entries[i].value);
+        }
+    }
+
+    delete_hash_map(search->probes);
+    delete_hash_map(search->listings);
+    delete_hash_map(search->watched);
+    delete_arena(search->arena);
+}
+
+/**
+ * Generates a new include search over the given directories.
+ *
+ * @param directories The directories to search, in order. The array itself is not copied.
+ * @param directory_count The number of directories.
+ * @param is_listing 1 to read the directories' listings instead of probing them name by name, 0 otherwise.
+ * @return A newly generated include search.
+ */
+IncludeSearch *new_include_search(char **directories, int directory_count, int is_listing) {
+    IncludeSearch *search = calloc(1, sizeof *search);
+
+    if (!search) {
+        fprintf(stderr, "Could not allocate enough memory.");
+        exit(EXIT_FAILURE);
+    }
+
+    search->directories = directories;
+    search->directory_count = directory_count;
+    search->is_listing = is_listing;
+    init_memory(search);
+    pthread_mutex_init(&search->lock, NULL);
+
+    return search;
+}
+
+/**
+ * Deletes an include search together with everything it remembers.
+ *
+ * @param search An include search to delete.
+ */
+void delete_include_search(IncludeSearch *search) {
+    delete_memory(search);
+    pthread_mutex_destroy(&search->lock);
+    free(search);
+}
+
+/**
+ * Joins a directory and a name into a path.
+ *
+ * @param directory The directory, with or without a trailing '/'. An empty directory stands for the current one.
+ * @param directory_length The length of the directory.
+ * @param name The name.
+ * @param name_length The length of the name.
+ * @return A newly allocated path.
+ */
+static char *join_path(const char *directory, size_t directory_length, const char *name, size_t name_length) {
+    int has_separator = directory_length && directory[directory_length - 1] != '/';
+    char *path = malloc((directory_length + has_separator + name_length + 1) * sizeof *path);
+
+    if (!path) {
+        fprintf(stderr, "Could not allocate enough memory.");
+        exit(EXIT_FAILURE);
+    }
+
+    memcpy(path, directory, directory_length);
+    if (has_separator) {
+        path[directory_length] = '/';
+    }
+    memcpy(&path[directory_length + has_separator], name, name_length);
+    path[directory_length + has_separator + name_length] = '\0';
+
+    return path;
+}
+
+/**
+ * Reads the current state of a directory.
+ *
+ * @param directory The directory (the current one if empty).
+ * @param watched The state to fill in.
+ */
+static void read_directory_state(const char *directory, WatchedDirectory *watched) {
+    struct stat info;
+
+    watched->exists = stat(directory[0] ? directory : ".", &info) == 0;
+    watched->modified = watched->exists ? info.st_mtim : (struct timespec) {0, 0};
+}
+
+/**
+ * Starts watching the directory of a probed path for changes, unless it is watched already. Must be called with the
+ * search's lock held, which is released while the directory is read.
+ *
+ * @param search The include search to which the directory belongs.
+ * @param path The probed path.
+ */
+static void watch_directory(IncludeSearch *search, const char *path) {
+    const char *separator = strrchr(path, '/');
+    unsigned int length = separator ? (unsigned int) (separator - path) + 1 : 0;
+
+    if (hash_map_get_key(search->watched, path, length)) {
+        return;
+    }
+
+    char *directory = strndup(path, length);
+
+    if (!directory) {
+        fprintf(stderr, "Could not allocate enough memory.");
+        exit(EXIT_FAILURE);
+    }
+
+    pthread_mutex_unlock(&search->lock);
+
+    WatchedDirectory state;
+    read_directory_state(directory, &state);
+
+    pthread_mutex_lock(&search->lock);
+
+    if (!hash_map_get_key(search->watched, directory, length)) {
+        WatchedDirectory *watched = arena_alloc(search->arena, sizeof *watched);
+        *watched = state;
+        hash_map_insert_key(search->watched, arena_strndup(search->arena, directory, length), length, watched);
+    }
+
+    free(directory);
+}
+
+/**
+ * Retrieves the listing of a directory, reading it if it has not been read yet. Must be called with the search's lock
+ * held, which is released while the directory is read.
+ *
+ * @param search The include search to which the directory belongs.
+ * @param directory The directory (the current one if empty).
+ * @param directory_length The length of the directory.
+ * @return A hash map of the directory's entries, NULL if it could not be read.
+ */
+static HashMap *directory_listing(IncludeSearch *search, const char *directory, size_t directory_length) {
+    HashMap *listing = hash_map_get_key(search->listings, directory, (unsigned int) directory_length);
+
+    if (listing) {
+        return listing->count ? listing : NULL;
+    }
+
+    unsigned int generation = search->generation;
+    pthread_mutex_unlock(&search->lock);
+
+    char *path = join_path(directory_length ? directory : ".", directory_length ? directory_length : 1, "", 0);
+    DIR *stream = opendir(path);
+    free(path);
+
+    // Directories which cannot be read get an empty listing (there is always "." otherwise)
+    listing = new_hash_map(64, 0x1b873593);
+    Arena *names = new_arena();
+
+    if (!listing) {
+        fprintf(stderr, "Could not allocate enough memory.");
+        exit(EXIT_FAILURE);
+    }
+
+    for (struct dirent *entry; stream && (entry = readdir(stream));) {
+        size_t length = strlen(entry->d_name);
+        hash_map_insert_key(listing, arena_strndup(names, entry->d_name, length), (unsigned int) length,
+                            (void *) (uintptr_t) PROBE_FOUND);
+    }
+
+    if (stream) {
+        closedir(stream);
+    }
+
+    pthread_mutex_lock(&search->lock);
+
+    // Another thread might have read the directory in the meantime, or made the search forget everything
+    HashMap *existing = hash_map_get_key(search->listings, directory, (unsigned int) directory_length);
+
+    if (existing || generation != search->generation) {
+        delete_hash_map(listing);
+        delete_arena(names);
+        return existing && existing->count ? existing : NULL;
+    }
+
+    // The names are moved over to the search's arena, so that they are freed together with it
+    for (unsigned int i = 0; i < listing->size; i++) {
+        HashMapEntry *entry = &listing->entries[i];
+
+        if (entry->key) {
+            entry->key = arena_strndup(search->arena, entry->key, entry->length);
+        }
+    }
+
+    delete_arena(names);
+    hash_map_insert_key(search->listings, arena_strndup(search->arena, directory, directory_length),
+                        (unsigned int) directory_length, listing);
+
+    return listing->count ? listing : NULL;
+}
+
+/**
+ * Probes a directory for a header. The result is remembered, so the file system is accessed only the first time a
+ * path is probed.
+ *
+ * @param search The include search in which to probe.
+ * @param directory The directory (the current one if empty).
+ * @param directory_length The length of the directory.
+ * @param name The header's name.
+ * @param name_length The length of the name.
+ * @param misses A list to which to append the path if the header is not there, NULL to leave it out.
+ * @return The newly allocated path of the header, NULL if it is not in the directory.
+ */
+static char *probe(IncludeSearch *search, const char *directory, size_t directory_length, const char *name,
+                   size_t name_length, FileList *misses) {
+    char *path = join_path(directory, directory_length, name, name_length);
+    unsigned int path_length = (unsigned int) strlen(path);
+
+    pthread_mutex_lock(&search->lock);
+    ProbeResult result = (ProbeResult) (uintptr_t) hash_map_get_key(search->probes, path, path_length);
+
+    if (result != PROBE_UNKNOWN) {
+        search->hits++;
+    } else {
+        // The directory is watched before it is probed, so that no change made in the meantime goes unnoticed
+        unsigned int generation = search->generation;
+        watch_directory(search, path);
+
+        // A name which is not in the directory's listing cannot be found there
+        const char *separator = memchr(name, '/', name_length);
+        size_t entry_length = separator ? (size_t) (separator - name) : name_length;
+        HashMap *listing = search->is_listing ? directory_listing(search, directory, directory_length) : NULL;
+
+        if (listing && !hash_map_get_key(listing, name, (unsigned int) entry_length)) {
+            result = PROBE_MISSING;
+        } else {
+            pthread_mutex_unlock(&search->lock);
+
+            struct stat info;
+            result = (stat(path, &info) == 0 && !S_ISDIR(info.st_mode)) ? PROBE_FOUND : PROBE_MISSING;
+
+            pthread_mutex_lock(&search->lock);
+        }
+
+        search->misses++;
+
+        // The result is not remembered if everything has been forgotten in the meantime
+        if (generation == search->generation && !hash_map_get_key(search->probes, path, path_length)) {
+            hash_map_insert_key(search->probes, arena_strndup(search->arena, path, path_length), path_length,
+                                (void *) (uintptr_t) result);
+        }
+    }
+
+    pthread_mutex_unlock(&search->lock);
+
+    if (result != PROBE_FOUND) {
+        if (misses) {
+            file_list_append(misses, file_table_add(path));
+        }
+
+        free(path);
+        return NULL;
+    }
+
+    return path;
+}
+
+/**
+ * Checks if any of the directories probed by an include search has changed, and makes the search forget everything
+ * it remembers about the file system if so.
+ *
+ * @param search The include search to revalidate.
+ */
+void include_search_revalidate(IncludeSearch *search) {
+    pthread_mutex_lock(&search->lock);
+
+    int is_changed = 0;
+
+    for (unsigned int i = 0; i < search->watched->size && !is_changed; i++) {
+        const HashMapEntry *entry = &search->watched->entries[i];
+
+        if (!entry->key) {
+            continue;
+        }
+
+        // The keys are copied into the zero-initialized arena, so they are terminated
+        const WatchedDirectory *watched = entry->value;
+        WatchedDirectory state;
+        read_directory_state(entry->key, &state);
+
+        is_changed = state.exists != watched->exists || state.modified.tv_sec != watched->modified.tv_sec ||
+                     state.modified.tv_nsec != watched->modified.tv_nsec;
+    }
+
+    if (is_changed) {
+        delete_memory(search);
+        init_memory(search);
+        search->generation++;
+    }
+
+    pthread_mutex_unlock(&search->lock);
+}
+
+/**
+ * Finds an included header, the way GCC does: headers included with quotes are searched for in the directory of the
+ * including file first, then in the same directories as the ones included with angle brackets.
+ *
+ * @param search The include search in which to find the header.
+ * @param including_file The location of the including file.
+ * @param name The header's name (without quotes or angle brackets).
+ * @param name_length The length of the name.
+ * @param is_system 1 if the header is included with angle brackets, 0 if it is included with quotes.
+ * @param misses A list to which to append the paths probed before the header was found (or all of them if it was not),
+ *  NULL to leave them out. A header appearing at any of them would be found instead.
+ * @return The newly allocated path of the header, NULL if it could not be found.
+ */
+char *include_search_resolve(IncludeSearch *search, const char *including_file, const char *name, size_t name_length,
+                             int is_system, FileList *misses) {
+    char *path;
+
+    if (name_length && name[0] == '/') {
+        return probe(search, "", 0, name, name_length, misses);
+    }
+
+    if (!is_system) {
+        const char *separator = strrchr(including_file, '/');
+        size_t directory_length = separator ? (size_t) (separator - including_file) + 1 : 0;
+
+        if ((path = probe(search, including_file, directory_length, name, name_length, misses))) {
+            return path;
+        }
+    }
+
+    for (int i = 0; i < search->directory_count; i++) {
+        const char *directory = search->directories[i];
+
+        if ((path = probe(search, directory, strlen(directory), name, name_length, misses))) {
+            return path;
+        }
+    }
+
+    return NULL;
+}
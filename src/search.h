@@ -0,0 +1,53 @@
+#ifndef TCPP_SEARCH_H
+#define TCPP_SEARCH_H
+
+#include <stddef.h>
+#include <pthread.h>
+#include "hashmap.h"
+#include "arena.h"
+#include "file.h"
+
+/**
+ * Stores the directories searched for included headers, in the order in which they are searched: the '-I'
+ * directories first, then the '-isystem' ones.
+ *
+ * Every path probed for a header is remembered in PROBES, whether the header was found there or not, so that no path
+ * is probed on the file system more than once. With IS_LISTING set, a directory is read in full the first time it is
+ * probed and its entries are kept in LISTINGS, so that probes for names which are not in the directory need no system
+ * call at all.
+ *
+ * WATCHED holds the modification time of every directory which has been probed, as headers can only appear in or
+ * disappear from a directory by changing it. If any of them changes, everything remembered is forgotten, which starts
+ * a new GENERATION of the search.
+ *
+ * The search is shared by all the threads and LOCK is held while it is accessed, but not while the file system is.
+ * HITS and MISSES count the probes answered from PROBES and from the file system.
+ */
+typedef struct IncludeSearch {
+    char **directories;
+    int directory_count;
+
+    int is_listing;
+
+    HashMap *probes;
+    HashMap *listings;
+    HashMap *watched;
+    Arena *arena;
+    unsigned int generation;
+
+    unsigned int hits;
+    unsigned int misses;
+
+    pthread_mutex_t lock;
+} IncludeSearch;
+
+IncludeSearch *new_include_search(char **directories, int directory_count, int is_listing);
+
+void delete_include_search(IncludeSearch *search);
+
+void include_search_revalidate(IncludeSearch *search);
+
+char *include_search_resolve(IncludeSearch *search, const char *including_file, const char *name, size_t name_length,
+                             int is_system, FileList *misses);
+
+#endif //TCPP_SEARCH_H
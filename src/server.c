@@ -0,0 +1,511 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "server.h"
+#include "args.h"
+#include "pool.h"
+#include "unit.h"
+#include "layout.h"
+#include "writer.h"
+
+/**
+ * Stores the state of a running server.
+ *
+ * ACTIVE is the number of requests being handled. The retired token lists of the header cache are only deleted when
+ * there are none. IS_STOPPING is set once a shutdown has been requested.
+ */
+typedef struct Server {
+    int fd;
+    HeaderCache *cache;
+
+    int active;
+    int is_stopping;
+    pthread_mutex_t lock;
+} Server;
+
+/**
+ * Stores a connection accepted by a server, to be handled on a worker thread.
+ */
+typedef struct Connection {
+    Server *server;
+    int fd;
+} Connection;
+
+/**
+ * Fills in the address of a Unix domain socket.
+ *
+ * @param address The address to fill in.
+ * @param socket_file The location of the socket.
+ * @return 1 if successful, 0 if the location is too long.
+ */
+static int socket_address(struct sockaddr_un *address, const char *socket_file) {
+    memset(address, 0, sizeof *address);
+    address->sun_family = AF_UNIX;
+
+    if (strlen(socket_file) >= sizeof address->sun_path) {
+        fprintf(stderr, "Socket location %s is too long.\n", socket_file);
+        return 0;
+    }
+
+    strcpy(address->sun_path, socket_file);
+
+    return 1;
+}
+
+/**
+ * Connects to a server.
+ *
+ * @param socket_file The location of the server's socket.
+ * @return The file descriptor of the connection, -1 if the server could not be reached.
+ */
+static int connect_socket(const char *socket_file) {
+    struct sockaddr_un address;
+    int fd;
+
+    if (!socket_address(&address, socket_file) || (fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+        return -1;
+    }
+
+    if (connect(fd, (struct sockaddr *) &address, sizeof address) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/**
+ * Creates the listening socket of a server. A socket left behind by a server which has not been shut down is
+ * replaced, one which is still listening is not.
+ *
+ * @param socket_file The location of the socket.
+ * @return The file descriptor of the socket, -1 if it could not be created.
+ */
+static int listen_socket(const char *socket_file) {
+    struct sockaddr_un address;
+    int fd;
+
+    if (!socket_address(&address, socket_file) || (fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+        return -1;
+    }
+
+    int is_bound = bind(fd, (struct sockaddr *) &address, sizeof address) == 0;
+
+    if (!is_bound && errno == EADDRINUSE) {
+        int other = connect_socket(socket_file);
+
+        if (other >= 0) {
+            fprintf(stderr, "A server is already listening on %s.\n", socket_file);
+            close(other);
+            close(fd);
+            return -1;
+        }
+
+        unlink(socket_file);
+        is_bound = bind(fd, (struct sockaddr *) &address, sizeof address) == 0;
+    }
+
+    if (!is_bound || listen(fd, SOMAXCONN) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/**
+ * Reads data from a file descriptor, retrying if interrupted.
+ *
+ * @param fd The file descriptor to read from.
+ * @param buffer The buffer to read into.
+ * @param size The size of the buffer.
+ * @return The number of bytes read, 0 at the end of the data, -1 if unsuccessful.
+ */
+static ssize_t read_some(int fd, char *buffer, size_t size) {
+    ssize_t length;
+
+    do {
+        length = read(fd, buffer, size);
+    } while (length < 0 && errno == EINTR);
+
+    return length;
+}
+
+/**
+ * Reads a request from a connection, up to the empty line ending it.
+ *
+ * @param fd The file descriptor of the connection.
+ * @param request The buffer of SERVER_REQUEST_SIZE bytes to read into. The request is terminated in it.
+ * @return 1 if successful, 0 if the request is incomplete or too large.
+ */
+static int read_request(int fd, char *request) {
+    size_t length = 0;
+
+    while (length < SERVER_REQUEST_SIZE - 1) {
+        ssize_t count = read_some(fd, &request[length], SERVER_REQUEST_SIZE - 1 - length);
+
+        if (count <= 0) {
+            return 0;
+        }
+
+        length += (size_t) count;
+        request[length] = '\0';
+
+        if ((length == 1 && request[0] == '\n') || strstr(request, "\n\n")) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Sends a single formatted line back over a connection.
+ *
+ * @param writer The writer of the connection.
+ * @param format A format specifier string.
+ * @param ... Additional arguments.
+ */
+__attribute__((format(printf, 2, 3)))
+static void respond(Writer *writer, const char *format, ...) {
+    char line[SERVER_REQUEST_SIZE];
+
+    va_list ap;
+    va_start(ap, format);
+    int length = vsnprintf(line, sizeof line - 1, format, ap);
+    va_end(ap);
+
+    if (length < 0) {
+        return;
+    }
+
+    if ((size_t) length > sizeof line - 2) {
+        length = (int) sizeof line - 2;
+    }
+
+    line[length] = '\n';
+    writer_write(writer, line, (size_t) length + 1);
+}
+
+/**
+ * Preprocesses the translation unit of a request. The files of the cached headers are checked for changes first.
+ *
+ * @param server The server handling the request.
+ * @param writer The writer of the connection.
+ * @param input_file The location of the translation unit's file.
+ * @param output_file Where to write the output, "-" to send it back over the connection.
+ */
+static void handle_preprocess(Server *server, Writer *writer, char *input_file, char *output_file) {
+    pthread_mutex_lock(&server->lock);
+    server->active++;
+    header_cache_revalidate(server->cache);
+    pthread_mutex_unlock(&server->lock);
+
+    TranslationUnit unit = {input_file, output_file, server->cache};
+
+    if (!translation_unit_preprocess(&unit, NULL)) {
+        respond(writer, "error Could not preprocess %s.", input_file);
+    } else if (strcmp(output_file, "-") == 0) {
+        respond(writer, "ok %d %d", unit.tokens->line_count, unit.tokens->comment_count);
+        write_token_list(unit.output, writer);
+        verbose_printf("Sent %s back.\n", input_file);
+    } else {
+        Writer *file = writer_open(output_file);
+
+        if (!file) {
+            respond(writer, "error Could not open or create file %s.", output_file);
+        } else {
+            write_token_list(unit.output, file);
+
+            if (!writer_close(file)) {
+                respond(writer, "error Could not write to file %s.", output_file);
+            } else {
+                respond(writer, "ok %d %d", unit.tokens->line_count, unit.tokens->comment_count);
+                verbose_printf("Wrote %s to %s.\n", input_file, output_file);
+            }
+        }
+    }
+
+    translation_unit_release(&unit);
+
+    // Old tokens can only be deleted once no translation unit might be reading them
+    pthread_mutex_lock(&server->lock);
+    if (--server->active == 0) {
+        header_cache_purge(server->cache);
+    }
+    pthread_mutex_unlock(&server->lock);
+}
+
+/**
+ * Handles a connection accepted by a server: reads its request, answers it and closes the connection.
+ *
+ * @param argument The connection to handle.
+ */
+static void handle_connection(void *argument) {
+    Connection *connection = argument;
+    Server *server = connection->server;
+    Writer *writer = writer_open_fd(connection->fd);
+    char *request = malloc(SERVER_REQUEST_SIZE * sizeof *request);
+
+    if (!writer || !request) {
+        fprintf(stderr, "Could not allocate enough memory.");
+        exit(EXIT_FAILURE);
+    }
+
+    char *input_file = NULL, *output_file = NULL;
+    int is_shutdown = 0, is_valid = read_request(connection->fd, request);
+
+    for (char *line = request, *end; is_valid && *line != '\n'; line = end + 1) {
+        end = strchr(line, '\n');
+        *end = '\0';
+
+        if (strncmp(line, "input ", 6) == 0) {
+            input_file = &line[6];
+        } else if (strncmp(line, "output ", 7) == 0) {
+            output_file = &line[7];
+        } else if (strcmp(line, "shutdown") == 0) {
+            is_shutdown = 1;
+        } else {
+            is_valid = 0;
+        }
+    }
+
+    if (!is_valid) {
+        respond(writer, "error Malformed request.");
+    } else if (is_shutdown) {
+        pthread_mutex_lock(&server->lock);
+        server->is_stopping = 1;
+        pthread_mutex_unlock(&server->lock);
+
+        // Wakes up the accepting thread
+        shutdown(server->fd, SHUT_RDWR);
+        respond(writer, "ok 0 0");
+    } else if (!input_file) {
+        respond(writer, "error No input file specified.");
+    } else if (!output_file) {
+        respond(writer, "error No output file specified.");
+    } else {
+        handle_preprocess(server, writer, input_file, output_file);
+    }
+
+    // A client which has gone away cannot be told anything anymore
+    writer_close(writer);
+    close(connection->fd);
+    free(request);
+    free(connection);
+}
+
+/**
+ * Runs a server until a shutdown is requested, handling the requests on JOBS worker threads.
+ *
+ * @param socket_file The location of the socket on which to listen. Removed when the server stops.
+ * @param cache The header cache kept between the requests.
+ * @return 1 if the server has been shut down on request, 0 if it could not be started.
+ */
+int server_run(const char *socket_file, HeaderCache *cache) {
+    Server server = {listen_socket(socket_file), cache};
+
+    if (server.fd < 0) {
+        fprintf(stderr, "Could not listen on %s.\n", socket_file);
+        return 0;
+    }
+
+    // Writing to a client which has gone away must not stop the server
+    signal(SIGPIPE, SIG_IGN);
+    pthread_mutex_init(&server.lock, NULL);
+
+    ThreadPool *pool = new_thread_pool(args->jobs);
+    normal_printf("Listening on %s.\n", socket_file);
+
+    for (;;) {
+        int fd = accept(server.fd, NULL, NULL);
+
+        pthread_mutex_lock(&server.lock);
+        int is_stopping = server.is_stopping;
+        pthread_mutex_unlock(&server.lock);
+
+        if (fd < 0 && !is_stopping && (errno == EINTR || errno == ECONNABORTED)) {
+            continue;
+        } else if (fd < 0 || is_stopping) {
+            if (fd >= 0) {
+                close(fd);
+            }
+
+            break;
+        }
+
+        Connection *connection = malloc(sizeof *connection);
+
+        if (!connection) {
+            fprintf(stderr, "Could not allocate enough memory.");
+            exit(EXIT_FAILURE);
+        }
+
+        connection->server = &server;
+        connection->fd = fd;
+        thread_pool_submit(pool, handle_connection, connection);
+    }
+
+    // Let the requests being handled finish first
+    delete_thread_pool(pool);
+    close(server.fd);
+    unlink(socket_file);
+    pthread_mutex_destroy(&server.lock);
+
+    normal_printf("Server on %s shut down.\n", socket_file);
+
+    return server.is_stopping;
+}
+
+/**
+ * Makes an absolute path out of a file name, so that a server understands it regardless of its working directory.
+ *
+ * @param file_name The file name ("-" is kept as it is).
+ * @return A newly allocated path.
+ */
+static char *absolute_path(const char *file_name) {
+    char *directory = NULL;
+
+    if (file_name[0] != '/' && strcmp(file_name, "-") != 0 && !(directory = getcwd(NULL, 0))) {
+        fprintf(stderr, "Could not find the working directory.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t length = (directory ? strlen(directory) + 1 : 0) + strlen(file_name);
+    char *path = malloc((length + 1) * sizeof *path);
+
+    if (!path) {
+        fprintf(stderr, "Could not allocate enough memory.");
+        exit(EXIT_FAILURE);
+    }
+
+    sprintf(path, "%s%s%s", directory ? directory : "", directory ? "/" : "", file_name);
+    free(directory);
+
+    return path;
+}
+
+/**
+ * Sends a single request to a server and handles its answer. Output sent back is written to stdout.
+ *
+ * @param socket_file The location of the server's socket.
+ * @param request The request, ending with an empty line.
+ * @param input_file The translation unit of the request, NULL for a shutdown.
+ * @return 1 if the request has been successful, 0 otherwise.
+ */
+static int send_request(const char *socket_file, const char *request, const char *input_file) {
+    int fd = connect_socket(socket_file);
+
+    if (fd < 0) {
+        fprintf(stderr, "Could not connect to the server on %s.\n", socket_file);
+        return 0;
+    }
+
+    Writer *writer = writer_open_fd(fd);
+
+    if (!writer) {
+        fprintf(stderr, "Could not allocate enough memory.");
+        exit(EXIT_FAILURE);
+    }
+
+    writer_write(writer, request, strlen(request));
+
+    if (!writer_close(writer)) {
+        fprintf(stderr, "Could not send the request to the server on %s.\n", socket_file);
+        close(fd);
+        return 0;
+    }
+
+    // Read the answer's line, anything after it is output sent back
+    char buffer[SERVER_REQUEST_SIZE];
+    char *line_end = NULL;
+    size_t length = 0;
+    ssize_t count;
+
+    while (!line_end && length < sizeof buffer - 1 && (count = read_some(fd, &buffer[length],
+                                                                          sizeof buffer - 1 - length)) > 0) {
+        length += (size_t) count;
+        buffer[length] = '\0';
+        line_end = strchr(buffer, '\n');
+    }
+
+    int lines, comments;
+
+    if (!line_end || sscanf(buffer, "ok %d %d", &lines, &comments) != 2) {
+        const char *message = strncmp(buffer, "error ", 6) == 0 ? &buffer[6] : buffer;
+        fprintf(stderr, "%.*s\n", (int) ((line_end ? line_end : &buffer[length]) - message), message);
+        close(fd);
+        return 0;
+    }
+
+    Writer *output = writer_open("-");
+
+    if (!output) {
+        fprintf(stderr, "Could not allocate enough memory.");
+        exit(EXIT_FAILURE);
+    }
+
+    writer_write(output, line_end + 1, length - (size_t) (line_end + 1 - buffer));
+
+    while ((count = read_some(fd, buffer, sizeof buffer)) > 0) {
+        writer_write(output, buffer, (size_t) count);
+    }
+
+    int success = writer_close(output) && count == 0;
+    close(fd);
+
+    if (input_file && args->input_count > 1) {
+        normal_printf("%s: %d non-empty lines found, %d comments found.\n", input_file, lines, comments);
+    } else if (input_file) {
+        normal_printf("%d non-empty lines found.\n", lines);
+        normal_printf("%d comments found.\n", comments);
+    }
+
+    return success;
+}
+
+/**
+ * Sends the input files to a server to be preprocessed, one request each, or requests it to shut down.
+ *
+ * @param socket_file The location of the server's socket.
+ * @return 1 if all the requests have been successful, 0 otherwise.
+ */
+int server_connect(const char *socket_file) {
+    if (args->shutdown) {
+        return send_request(socket_file, "shutdown\n\n", NULL);
+    }
+
+    int success = 1;
+
+    for (int i = 0; i < args->input_count; i++) {
+        char *output_file = args->input_count > 1 ? default_output_file(args->input_files[i]) : args->output_file;
+        char *input_path = absolute_path(args->input_files[i]);
+        char *output_path = absolute_path(output_file);
+        char *request = malloc((strlen(input_path) + strlen(output_path) + 18) * sizeof *request);
+
+        if (!request) {
+            fprintf(stderr, "Could not allocate enough memory.");
+            exit(EXIT_FAILURE);
+        }
+
+        sprintf(request, "input %s\noutput %s\n\n", input_path, output_path);
+        success &= send_request(socket_file, request, args->input_files[i]);
+
+        if (args->input_count > 1) {
+            free(output_file);
+        }
+
+        free(request);
+        free(input_path);
+        free(output_path);
+    }
+
+    return success;
+}
@@ -0,0 +1,30 @@
+#ifndef TCPP_SERVER_H
+#define TCPP_SERVER_H
+
+#include "header.h"
+
+/**
+ * The largest request a server accepts, in bytes.
+ */
+#define SERVER_REQUEST_SIZE 0x4000
+
+/*
+ * A server preprocesses translation units on request, keeping its header cache (and with it the include search and
+ * the symbol table) between the requests, so that a build sending many requests only reads and tokenizes every header
+ * once. The options given when the server is started apply to all the requests.
+ *
+ * Requests are sent over a Unix domain socket, one per connection, as lines of text ending with an empty line:
+ *
+ *     input <file>      the translation unit to preprocess
+ *     output <file>     where to write the output, "-" to send it back over the connection
+ *     shutdown          stops the server once the requests being handled have finished
+ *
+ * The server answers with a single line, "ok <lines> <comments>" followed by the output if it is sent back, or
+ * "error <message>". Relative file names are resolved in the server's working directory.
+ */
+
+int server_run(const char *socket_file, HeaderCache *cache);
+
+int server_connect(const char *socket_file);
+
+#endif //TCPP_SERVER_H
@@ -0,0 +1,187 @@
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "source.h"
+#include "stats.h"
+
+/**
+ * Reads the whole content of a file descriptor into a newly allocated buffer.
+ *
+ * Used for files which cannot be memory-mapped (pipes, character devices, etc.).
+ *
+ * @param fd The file descriptor from which to read.
+ * @param size A pointer into which to store the number of bytes read.
+ * @return A newly allocated buffer, NULL if reading failed.
+ */
+static char *read_whole_file(int fd, size_t *size) {
+    size_t capacity = 0x10000;
+    char *buffer = malloc(capacity);
+
+    *size = 0;
+
+    while (buffer) {
+        if (*size == capacity) {
+            char *grown = realloc(buffer, capacity *= 2);
+
+            if (!grown) {
+                break;
+            }
+
+            buffer = grown;
+        }
+
+        ssize_t length = read(fd, &buffer[*size], capacity - *size);
+
+        if (length == 0) {
+            return buffer;
+        } else if (length < 0) {
+            break;
+        }
+
+        *size += length;
+    }
+
+    free(buffer);
+    return NULL;
+}
+
+/**
+ * Opens a source file and loads its whole content into memory.
+ *
+ * @param file_name The location of the file to open.
+ * @return A newly generated source, NULL if the file could not be opened or read.
+ */
+Source *source_open(char *file_name) {
+    int fd = open(file_name, O_RDONLY);
+
+    if (fd < 0) {
+        return NULL;
+    }
+
+    Source *source = calloc(1, sizeof *source);
+    struct stat info;
+
+    source->file_name = file_name;
+
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        void *data = mmap(NULL, (size_t) info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (data != MAP_FAILED) {
+            madvise(data, (size_t) info.st_size, MADV_SEQUENTIAL);
+
+            source->data = data;
+            source->size = (size_t) info.st_size;
+            source->is_mapped = 1;
+        }
+    }
+
+    if (!source->is_mapped) {
+        source->data = read_whole_file(fd, &source->size);
+    }
+
+    close(fd);
+
+    if (!source->data) {
+        free(source);
+        return NULL;
+    }
+
+    source->end = source->data + source->size;
+    source->cursor = source->data;
+
+    stats_add(COUNTER_BYTES_READ, source->size);
+
+    return source;
+}
+
+/**
+ * Opens a source over a buffer instead of a file, e.g. for text given on the command line.
+ *
+ * @param file_name The name under which to report the source.
+ * @param data The content, taken over by the source (freed when it is closed).
+ * @param size The size of the content.
+ * @return A newly generated source.
+ */
+Source *source_open_memory(char *file_name, char *data, size_t size) {
+    Source *source = calloc(1, sizeof *source);
+
+    if (!source) {
+        fprintf(stderr, "Could not allocate enough memory.");
+        exit(EXIT_FAILURE);
+    }
+
+    source->file_name = file_name;
+    source->data = data;
+    source->size = size;
+    source->end = data + size;
+    source->cursor = data;
+
+    return source;
+}
+
+/**
+ * Copies a raw part of a source into a buffer, skipping line continuations and converting CR & CRLF line endings to LF.
+ *
+ * @param source The source to which the part belongs.
+ * @param start The first raw character of the part.
+ * @param end The position after the last raw character of the part.
+ * @param buffer A buffer of at least END - START characters into which to copy.
+ * @return The number of characters copied.
+ */
+size_t source_normalize(const Source *source, const char *start, const char *end, char *buffer) {
+    size_t length = 0;
+
+    while ((start = source_skip_splices(source, start)) < end) {
+        char ch = *start++;
+
+        if (ch == '\r') {
+            ch = '\n';
+
+            if (start < end && *start == '\n') {
+                start++;
+            }
+        }
+
+        buffer[length++] = ch;
+    }
+
+    return length;
+}
+
+/**
+ * Hashes the content of a file with 64-bit FNV-1a.
+ *
+ * @param data The content.
+ * @param size The size of the content.
+ * @return The hash.
+ */
+uint64_t source_hash(const char *data, size_t size) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ (unsigned char) data[i]) * 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+/**
+ * Closes a source and frees the memory allocated to it.
+ *
+ * @param source A source to close.
+ */
+void source_close(Source *source) {
+    if (!source) {
+        return;
+    }
+
+    if (source->is_mapped) {
+        munmap((void *) source->data, source->size);
+    } else {
+        free((void *) source->data);
+    }
+
+    free(source);
+}
@@ -0,0 +1,151 @@
+#ifndef TCPP_SOURCE_H
+#define TCPP_SOURCE_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Stores location in a file. FILE is the file's id in the global file table.
+ */
+typedef struct Location {
+    unsigned int file;
+
+    int line;
+    int column;
+} Location;
+
+/**
+ * Stores the whole content of a source file and a cursor over it.
+ *
+ * The content is either memory-mapped or read in one go (for pipes and other non-regular files).
+ */
+typedef struct Source {
+    char *file_name;
+
+    const char *data;
+    const char *end;
+    const char *cursor;
+
+    size_t size;
+    int is_mapped;
+
+    int normalized;
+
+    struct Source *next;
+} Source;
+
+Source *source_open(char *file_name);
+
+Source *source_open_memory(char *file_name, char *data, size_t size);
+
+void source_close(Source *source);
+
+size_t source_normalize(const Source *source, const char *start, const char *end, char *buffer);
+
+uint64_t source_hash(const char *data, size_t size);
+
+/**
+ * Skips all line continuations (backslash followed by LF, CR or CRLF) starting at a given position.
+ *
+ * @param source A source in which to skip.
+ * @param cursor The position from which to skip.
+ * @return The first position which does not start a line continuation.
+ */
+static inline const char *source_skip_splices(const Source *source, const char *cursor) {
+    while (cursor + 1 < source->end && cursor[0] == '\\' && (cursor[1] == '\n' || cursor[1] == '\r')) {
+        cursor += (cursor[1] == '\r' && cursor + 2 < source->end && cursor[2] == '\n') ? 3 : 2;
+    }
+
+    return cursor;
+}
+
+/**
+ * Peeks the next character in a source. Line continuations are skipped and CR line endings are reported as LF.
+ *
+ * @param source The source from which to peek.
+ * @return The peeked character, EOF at the end of the source.
+ */
+static inline int source_peek_char(const Source *source) {
+    const char *cursor = source->cursor;
+
+    if (cursor < source->end && *cursor != '\\' && *cursor != '\r') {
+        return *cursor;
+    }
+
+    cursor = source_skip_splices(source, cursor);
+
+    if (cursor >= source->end) {
+        return EOF;
+    }
+
+    return *cursor == '\r' ? '\n' : *cursor;
+}
+
+/**
+ * Reads the next character from a source. Advances the current location accordingly.
+ *
+ * Line continuations are skipped and CR & CRLF line endings are converted to LF for consistency. Every such
+ * adjustment is counted in the NORMALIZED field, so that callers can tell if the raw bytes they read differ from
+ * the characters they got.
+ *
+ * @param source A source from which to read.
+ * @param ch A character pointer into which to read.
+ * @param location The current location in a file.
+ * @return 1 if successful, 0 otherwise.
+ */
+static inline int source_read_char(Source *source, char *ch, Location *location) {
+    const char *cursor = source_skip_splices(source, source->cursor);
+
+    if (cursor != source->cursor) {
+        source->normalized++;
+    }
+
+    if (cursor >= source->end) {
+        source->cursor = source->end;
+        *ch = (char) EOF;
+        return 0;
+    }
+
+    *ch = *cursor++;
+
+    // CR -> LF, skipping the LF of CRLF
+    if (*ch == '\r') {
+        *ch = '\n';
+        source->normalized++;
+
+        if (cursor < source->end && *cursor == '\n') {
+            cursor++;
+        }
+    }
+
+    source->cursor = cursor;
+
+    // Progress location
+    if (*ch == '\n') {
+        location->line++;
+        location->column = 0;
+    } else {
+        location->column++;
+    }
+
+    return 1;
+}
+
+/**
+ * Moves the cursor of a source forward to a given position on the same line. Advances the current location
+ * accordingly.
+ *
+ * Used to skip runs of plain characters found by the scanning kernels, so there must be no line endings or line
+ * continuations in between.
+ *
+ * @param source A source in which to move the cursor.
+ * @param position The new position of the cursor.
+ * @param location The current location in a file.
+ */
+static inline void source_skip_to(Source *source, const char *position, Location *location) {
+    location->column += (int) (position - source->cursor);
+    source->cursor = position;
+}
+
+#endif //TCPP_SOURCE_H
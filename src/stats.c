@@ -0,0 +1,257 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+#include "stats.h"
+#include "header.h"
+
+/**
+ * The least wall time after which the CPU time of a thread is read again, in nanoseconds.
+ */
+static const uint64_t window = 1000000;
+
+/**
+ * The statistics of the current thread, NULL until it records any.
+ */
+__thread Stats *thread_stats;
+
+/**
+ * The statistics of all the threads which have recorded any, linked through NEXT. Protected by STATS_LOCK.
+ */
+static Stats *all_stats;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * The names of the phases, indexed by StatsPhase.
+ */
+static const char *phase_names[PHASE_COUNT] = {
+        [PHASE_PREPROCESS] = "preprocess",
+        [PHASE_TOKENIZE] = "tokenize",
+        [PHASE_INCLUDE] = "include",
+        [PHASE_MACRO] = "macro",
+        [PHASE_OUTPUT] = "output",
+};
+
+/**
+ * The names of the counters, indexed by StatsCounter.
+ */
+static const char *counter_names[COUNTER_COUNT] = {
+        [COUNTER_BYTES_READ] = "bytes_read",
+        [COUNTER_TOKENS_CREATED] = "tokens_created",
+        [COUNTER_TOKENS_EMITTED] = "tokens_emitted",
+        [COUNTER_COMMENTS_REMOVED] = "comments_removed",
+        [COUNTER_HASH_LOOKUPS] = "hash_lookups",
+        [COUNTER_HASH_PROBES] = "hash_probes",
+        [COUNTER_HASH_HITS] = "hash_hits",
+        [COUNTER_MACRO_EXPANSIONS] = "macro_expansions",
+        [COUNTER_BYTES_WRITTEN] = "bytes_written",
+};
+
+/**
+ * Reads a clock.
+ *
+ * @param clock The clock to read.
+ * @return The time of the clock in nanoseconds.
+ */
+static uint64_t read_clock(clockid_t clock) {
+    struct timespec time;
+    clock_gettime(clock, &time);
+
+    return (uint64_t) time.tv_sec * 1000000000 + (uint64_t) time.tv_nsec;
+}
+
+/**
+ * Creates the statistics of the current thread.
+ *
+ * @return The statistics, stored in THREAD_STATS.
+ */
+Stats *stats_register(void) {
+    Stats *stats = calloc(1, sizeof *stats);
+
+    if (!stats) {
+        fprintf(stderr, "Could not allocate enough memory.");
+        exit(EXIT_FAILURE);
+    }
+
+    pthread_mutex_lock(&stats_lock);
+    stats->next = all_stats;
+    all_stats = stats;
+    pthread_mutex_unlock(&stats_lock);
+
+    return thread_stats = stats;
+}
+
+/**
+ * Splits the CPU time of a thread since it was last read between the phases, by the wall time spent in each of them.
+ *
+ * @param stats The statistics of the thread.
+ * @param now The current wall time.
+ */
+static void close_window(Stats *stats, uint64_t now) {
+    uint64_t cpu = read_clock(CLOCK_THREAD_CPUTIME_ID);
+    uint64_t total = 0;
+
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        total += stats->window_wall[i];
+    }
+
+    double elapsed = (double) (cpu - stats->window_cpu);
+
+    for (int i = 0; total && i < PHASE_COUNT; i++) {
+        stats->cpu[i] += (uint64_t) (elapsed * (double) stats->window_wall[i] / (double) total);
+        stats->window_wall[i] = 0;
+    }
+
+    stats->window_start = now;
+    stats->window_cpu = cpu;
+}
+
+/**
+ * Switches the phase in which the time of the current thread is recorded.
+ *
+ * @param phase The phase to switch to, PHASE_NONE to stop recording.
+ * @return The phase that was switched from.
+ */
+StatsPhase stats_switch(StatsPhase phase) {
+    Stats *stats = thread_stats ? thread_stats : stats_register();
+    StatsPhase previous = stats->phase;
+
+    if (phase == previous) {
+        return previous;
+    }
+
+    uint64_t now = read_clock(CLOCK_MONOTONIC);
+
+    if (previous == PHASE_NONE) {
+        stats->window_start = now;
+        stats->window_cpu = read_clock(CLOCK_THREAD_CPUTIME_ID);
+    } else {
+        stats->wall[previous] += now - stats->switched;
+        stats->window_wall[previous] += now - stats->switched;
+
+        if (phase == PHASE_NONE || now - stats->window_start >= window) {
+            close_window(stats, now);
+        }
+    }
+
+    stats->phase = phase;
+    stats->switched = now;
+
+    return previous;
+}
+
+/**
+ * The names of the counters kept by the header cache and its include search, written after the other counters.
+ */
+static const char *cache_counter_names[] = {"header_hits", "header_misses", "probe_hits", "probe_misses"};
+
+#define CACHE_COUNTER_COUNT (sizeof cache_counter_names / sizeof *cache_counter_names)
+
+/**
+ * Writes statistics as a table.
+ *
+ * @param file The file to write to.
+ * @param total The statistics to write.
+ * @param cache_counters The counters of the header cache, indexed like CACHE_COUNTER_NAMES.
+ */
+static void write_table(FILE *file, const Stats *total, const uint64_t *cache_counters) {
+    fprintf(file, "%-18s %12s %12s\n", "phase", "wall (s)", "cpu (s)");
+
+    for (int i = PHASE_NONE + 1; i < PHASE_COUNT; i++) {
+        fprintf(file, "%-18s %12.6f %12.6f\n", phase_names[i], (double) total->wall[i] / 1e9,
+                (double) total->cpu[i] / 1e9);
+    }
+
+    fprintf(file, "\n%-18s %12s\n", "counter", "value");
+
+    for (int i = 0; i < COUNTER_COUNT; i++) {
+        fprintf(file, "%-18s %12llu\n", counter_names[i], (unsigned long long) total->counters[i]);
+    }
+
+    for (size_t i = 0; i < CACHE_COUNTER_COUNT; i++) {
+        fprintf(file, "%-18s %12llu\n", cache_counter_names[i], (unsigned long long) cache_counters[i]);
+    }
+}
+
+/**
+ * Writes statistics as JSON.
+ *
+ * @param file The file to write to.
+ * @param total The statistics to write.
+ * @param cache_counters The counters of the header cache, indexed like CACHE_COUNTER_NAMES.
+ */
+static void write_json(FILE *file, const Stats *total, const uint64_t *cache_counters) {
+    fprintf(file, "{\n  \"phases\": {");
+
+    for (int i = PHASE_NONE + 1; i < PHASE_COUNT; i++) {
+        fprintf(file, "%s\n    \"%s\": {\"wall_seconds\": %.6f, \"cpu_seconds\": %.6f}", i > PHASE_NONE + 1 ? "," : "",
+                phase_names[i], (double) total->wall[i] / 1e9, (double) total->cpu[i] / 1e9);
+    }
+
+    fprintf(file, "\n  },\n  \"counters\": {");
+
+    for (int i = 0; i < COUNTER_COUNT; i++) {
+        fprintf(file, "%s\n    \"%s\": %llu", i ? "," : "", counter_names[i], (unsigned long long) total->counters[i]);
+    }
+
+    for (size_t i = 0; i < CACHE_COUNTER_COUNT; i++) {
+        fprintf(file, ",\n    \"%s\": %llu", cache_counter_names[i], (unsigned long long) cache_counters[i]);
+    }
+
+    fprintf(file, "\n  }\n}\n");
+}
+
+/**
+ * Writes the statistics of all the threads, summed up, to stderr as a table or into a file as JSON. Meant to be called
+ * once the translation units have been preprocessed, the prefetches still running are waited for.
+ *
+ * @param cache The header cache of the run, whose hits and misses (and those of its include search) are written too.
+ * @param file_name The location of the file into which to write JSON, NULL to write a table to stderr.
+ * @return 1 if successful, 0 otherwise.
+ */
+int stats_dump(HeaderCache *cache, const char *file_name) {
+    Stats total = {{0}};
+
+    if (cache->prefetch_pool) {
+        thread_pool_wait(cache->prefetch_pool);
+    }
+
+    pthread_mutex_lock(&stats_lock);
+
+    for (const Stats *stats = all_stats; stats; stats = stats->next) {
+        for (int i = 0; i < PHASE_COUNT; i++) {
+            total.wall[i] += stats->wall[i];
+            total.cpu[i] += stats->cpu[i];
+        }
+
+        for (int i = 0; i < COUNTER_COUNT; i++) {
+            total.counters[i] += stats->counters[i];
+        }
+    }
+
+    pthread_mutex_unlock(&stats_lock);
+
+    uint64_t cache_counters[CACHE_COUNTER_COUNT] = {cache->hits, cache->misses, cache->search->hits,
+                                                    cache->search->misses};
+
+    if (!file_name) {
+        write_table(stderr, &total, cache_counters);
+        return 1;
+    }
+
+    FILE *file = fopen(file_name, "w");
+
+    if (!file) {
+        fprintf(stderr, "Could not open or create file %s.\n", file_name);
+        return 0;
+    }
+
+    write_json(file, &total, cache_counters);
+
+    if (ferror(file) | fclose(file)) {
+        fprintf(stderr, "Could not write to file %s.\n", file_name);
+        return 0;
+    }
+
+    return 1;
+}
@@ -0,0 +1,107 @@
+#ifndef TCPP_STATS_H
+#define TCPP_STATS_H
+
+#include <stdint.h>
+#include "args.h"
+
+struct HeaderCache;
+
+/**
+ * The phases in which the time of a run is recorded. Time spent outside of all phases (e.g. waiting for tasks) is not
+ * recorded. PHASE_PREPROCESS covers directives, conditionals and everything else not in another phase.
+ */
+typedef enum StatsPhase {
+    PHASE_NONE,
+
+    PHASE_PREPROCESS,
+    PHASE_TOKENIZE,
+    PHASE_INCLUDE,
+    PHASE_MACRO,
+    PHASE_OUTPUT,
+
+    PHASE_COUNT
+} StatsPhase;
+
+/**
+ * The counters of a run. Hash map lookups include the ones made while inserting and deleting keys, PROBES counts every
+ * slot compared.
+ */
+typedef enum StatsCounter {
+    COUNTER_BYTES_READ,
+    COUNTER_TOKENS_CREATED,
+    COUNTER_TOKENS_EMITTED,
+    COUNTER_COMMENTS_REMOVED,
+    COUNTER_HASH_LOOKUPS,
+    COUNTER_HASH_PROBES,
+    COUNTER_HASH_HITS,
+    COUNTER_MACRO_EXPANSIONS,
+    COUNTER_BYTES_WRITTEN,
+
+    COUNTER_COUNT
+} StatsCounter;
+
+/**
+ * Stores the timings and counters of a single thread, so that recording them needs no synchronization. All times are
+ * in nanoseconds.
+ *
+ * Reading the CPU time of a thread takes a system call, so it is only read when a phase is switched to after at least
+ * WINDOW (see stats.c) since the last reading, and split between the phases by the wall time spent in each of them
+ * since then (WINDOW_WALL). The wall time is read on every switch.
+ */
+typedef struct Stats {
+    uint64_t wall[PHASE_COUNT];
+    uint64_t cpu[PHASE_COUNT];
+    uint64_t counters[COUNTER_COUNT];
+
+    StatsPhase phase;
+    uint64_t switched;
+
+    uint64_t window_wall[PHASE_COUNT];
+    uint64_t window_start;
+    uint64_t window_cpu;
+
+    struct Stats *next;
+} Stats;
+
+extern __thread Stats *thread_stats;
+
+Stats *stats_register(void);
+
+StatsPhase stats_switch(StatsPhase phase);
+
+int stats_dump(struct HeaderCache *cache, const char *file_name);
+
+/**
+ * Adds to a counter of the current thread if statistics are collected ('--stats').
+ *
+ * @param counter The counter to add to.
+ * @param amount The amount to add.
+ */
+static inline void stats_add(StatsCounter counter, uint64_t amount) {
+    if (args->stats) {
+        (thread_stats ? thread_stats : stats_register())->counters[counter] += amount;
+    }
+}
+
+/**
+ * Starts recording the time of the current thread in a phase if statistics are collected ('--stats').
+ *
+ * @param phase The phase to enter.
+ * @return The phase that was entered before, to be passed into stats_leave.
+ */
+static inline StatsPhase stats_enter(StatsPhase phase) {
+    return args->stats ? stats_switch(phase) : PHASE_NONE;
+}
+
+/**
+ * Goes back to recording the time of the current thread in the phase that was entered before.
+ *
+ * @param previous The phase returned by the matching stats_enter.
+ */
+static inline void stats_leave(StatsPhase previous) {
+    if (args->stats) {
+        stats_switch(previous);
+    }
+}
+
+#endif //TCPP_STATS_H
@@ -0,0 +1,366 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include "store.h"
+#include "args.h"
+#include "symbol.h"
+#include "file.h"
+#include "stats.h"
+#include "tokenizer.h"
+
+/**
+ * Identifies token store files, followed by the version of their format.
+ */
+static const char store_magic[4] = {'T', 'C', 'P', 'T'};
+static const uint32_t store_version = 3;
+
+/**
+ * Stores the fixed-size header of a token store file.
+ *
+ * A token store file holds the fully tokenized list of a single header. The header is followed by SYMBOL_COUNT
+ * StoredSymbol entries (the identifiers used in the list, interned when the file is loaded), TOKEN_COUNT StoredToken
+ * entries, and STRINGS_SIZE bytes of the tokens' and identifiers' contents, which the loaded tokens point into.
+ *
+ * SIZE, the modification time and CONTENT_HASH describe the header's file when it was tokenized. The file only has to
+ * be hashed again if its modification time has changed.
+ */
+typedef struct StoreHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t keep_comments;
+
+    uint32_t symbol_count;
+    uint32_t token_count;
+    uint32_t strings_size;
+
+    uint64_t size;
+    int64_t modified_sec;
+    int64_t modified_nsec;
+    uint64_t content_hash;
+} StoreHeader;
+
+/**
+ * Stores an identifier in a token store file.
+ */
+typedef struct StoredSymbol {
+    uint32_t offset;
+    uint32_t length;
+} StoredSymbol;
+
+/**
+ * The flags of a StoredToken.
+ */
+typedef enum StoredFlag {
+    STORED_HAS_SPACE = 1 << 0,
+    STORED_IS_IDENTIFIER = 1 << 1,
+    STORED_IS_NUMBER = 1 << 2,
+    STORED_IS_COMMENT = 1 << 3,
+    STORED_IS_DIRECTIVE = 1 << 4,
+    STORED_CONTINUES_LINE = 1 << 5
+} StoredFlag;
+
+/**
+ * Stores a token in a token store file. SYMBOL is an index into the file's identifiers, unused for other tokens.
+ */
+typedef struct StoredToken {
+    uint32_t offset;
+    uint32_t length;
+    uint32_t width;
+    uint32_t symbol;
+
+    int32_t line;
+    int32_t column;
+
+    char operator;
+    uint8_t flags;
+    uint16_t padding;
+} StoredToken;
+
+/**
+ * Makes the location of the token store file of a header. The name of the file is the hash of the header's canonical
+ * path, marked with a 'c' if comments are kept, as they are tokens then.
+ *
+ * @param directory The directory of the token store.
+ * @param header The header.
+ * @return A newly allocated path.
+ */
+static char *store_path(const char *directory, const Header *header) {
+    uint64_t hash = source_hash(header->path, strlen(header->path));
+    size_t length = strlen(directory) + 22;
+    char *path = malloc(length * sizeof *path);
+
+    if (!path) {
+        fprintf(stderr, "Could not allocate enough memory.");
+        exit(EXIT_FAILURE);
+    }
+
+    snprintf(path, length, "%s/%016llx%s.tct", directory, (unsigned long long) hash, args->keep_comments ? "c" : "");
+
+    return path;
+}
+
+/**
+ * Checks if a token store file still describes the current content of its header's file. The file is only read and
+ * hashed if its modification time differs from the stored one.
+ *
+ * @param stored The header of the token store file.
+ * @param header The header.
+ * @param info The current status of the header's file.
+ * @return 1 if it does, 0 otherwise.
+ */
+static int is_store_current(const StoreHeader *stored, const Header *header, const struct stat *info) {
+    if (memcmp(stored->magic, store_magic, sizeof store_magic) != 0 || stored->version != store_version ||
+        stored->keep_comments != (uint32_t) args->keep_comments || stored->size != (uint64_t) info->st_size) {
+        return 0;
+    }
+
+    if (stored->modified_sec == info->st_mtim.tv_sec && stored->modified_nsec == info->st_mtim.tv_nsec) {
+        return 1;
+    }
+
+    Source *source = source_open(header->file_name);
+
+    if (!source) {
+        return 0;
+    }
+
+    int is_current = source_hash(source->data, source->size) == stored->content_hash;
+    source_close(source);
+
+    return is_current;
+}
+
+/**
+ * Loads the tokens of a header from its token store file, instead of tokenizing the header's file.
+ *
+ * The token store file is mapped into memory and stays mapped together with the token list, as the tokens point into
+ * it. Nothing is left to be tokenized in the list.
+ *
+ * @param directory The directory of the token store.
+ * @param header The header whose tokens to load.
+ * @param info The current status of the header's file.
+ * @param arena An arena from which to allocate the token list.
+ * @return A newly generated token list, NULL if there is no token store file for the header or it is out of date.
+ */
+TokenList *store_load(const char *directory, const Header *header, const struct stat *info, Arena *arena) {
+    char *path = store_path(directory, header);
+    Source *source = source_open(path);
+    free(path);
+
+    if (!source) {
+        return NULL;
+    }
+
+    const StoreHeader *stored = (const StoreHeader *) source->data;
+    size_t symbols_offset = sizeof *stored;
+
+    if (source->size < sizeof *stored || !is_store_current(stored, header, info) ||
+        source->size != symbols_offset + stored->symbol_count * sizeof(StoredSymbol) +
+                        stored->token_count * sizeof(StoredToken) + stored->strings_size) {
+        source_close(source);
+        return NULL;
+    }
+
+    const StoredSymbol *symbols = (const StoredSymbol *) (source->data + symbols_offset);
+    const StoredToken *records = (const StoredToken *) (symbols + stored->symbol_count);
+    const char *strings = (const char *) (records + stored->token_count);
+
+    // Intern every identifier once, rather than once per token
+    unsigned int *symbol_ids = malloc((stored->symbol_count + 1) * sizeof *symbol_ids);
+
+    if (!symbol_ids) {
+        fprintf(stderr, "Could not allocate enough memory.");
+        exit(EXIT_FAILURE);
+    }
+
+    for (uint32_t i = 0; i < stored->symbol_count; i++) {
+        symbol_ids[i] = intern(&strings[symbols[i].offset], symbols[i].length);
+    }
+
+    verbose_printf("Loading tokens of %s from the token store.\n", header->file_name);
+
+    TokenList *token_list = new_token_list(arena);
+    token_list->sources = source;
+
+    Token *tokens = stored->token_count ? arena_alloc(arena, stored->token_count * sizeof *tokens) : NULL;
+    stats_add(COUNTER_TOKENS_CREATED, stored->token_count);
+
+    for (uint32_t i = 0; i < stored->token_count; i++) {
+        const StoredToken *record = &records[i];
+        Token *token = &tokens[i];
+
+        token->string = &strings[record->offset];
+        token->length = (int) record->length;
+        token->width = (int) record->width;
+        token->operator = record->operator;
+
+        token->has_space = (record->flags & STORED_HAS_SPACE) != 0;
+        token->is_identifier = (record->flags & STORED_IS_IDENTIFIER) != 0;
+        token->is_number = (record->flags & STORED_IS_NUMBER) != 0;
+        token->is_comment = (record->flags & STORED_IS_COMMENT) != 0;
+        token->is_directive = (record->flags & STORED_IS_DIRECTIVE) != 0;
+        token->continues_line = (record->flags & STORED_CONTINUES_LINE) != 0;
+        token->symbol = token->is_identifier ? symbol_ids[record->symbol] : SYMBOL_NONE;
+
+        token->location.file = header->file;
+        token->location.line = record->line;
+        token->location.column = record->column;
+
+        token->prev = i ? &tokens[i - 1] : NULL;
+        token->next = i + 1 < stored->token_count ? &tokens[i + 1] : NULL;
+    }
+
+    token_list->front_token = tokens;
+    token_list->back_token = tokens ? &tokens[stored->token_count - 1] : NULL;
+
+    free(symbol_ids);
+
+    return token_list;
+}
+
+/**
+ * Writes a block of memory into a file.
+ *
+ * @param file The file into which to write.
+ * @param data The memory.
+ * @param size The size of the memory.
+ * @return 1 if successful, 0 otherwise.
+ */
+static int write_block(FILE *file, const void *data, size_t size) {
+    return size == 0 || fwrite(data, size, 1, file) == 1;
+}
+
+/**
+ * Tokenizes a header completely and saves its tokens into its token store file, so that later runs can load them with
+ * store_load. The file is written under a temporary name first, so readers never see it incomplete.
+ *
+ * Must not be called while other threads are reading the header's tokens.
+ *
+ * @param directory The directory of the token store.
+ * @param header The header whose tokens to save.
+ * @return 1 if successful, 0 otherwise.
+ */
+int store_save(const char *directory, Header *header) {
+    TokenList *list = header->tokens;
+    Source *source = list->sources;
+
+    for (Token *token = list->front_token; token;) {
+        token = token->is_gap ? tokenize_gap(list, token) : token->next;
+    }
+
+    StoreHeader stored = {{0}};
+    memcpy(stored.magic, store_magic, sizeof store_magic);
+    stored.version = store_version;
+    stored.keep_comments = (uint32_t) args->keep_comments;
+    stored.size = (uint64_t) header->size;
+    stored.modified_sec = header->modified.tv_sec;
+    stored.modified_nsec = header->modified.tv_nsec;
+    stored.content_hash = source_hash(source->data, source->size);
+
+    for (Token *token = list->front_token; token; token = token->next) {
+        stored.token_count += !token->is_gap;
+    }
+
+    StoredToken *records = calloc(stored.token_count + 1, sizeof *records);
+    StoredSymbol *symbols = calloc(stored.token_count + 1, sizeof *symbols);
+    char *strings = malloc(source->size + 1);
+    HashMap *symbol_indexes = new_hash_map(256, 0x85ebca6b);
+
+    if (!records || !symbols || !strings || !symbol_indexes) {
+        fprintf(stderr, "Could not allocate enough memory.");
+        exit(EXIT_FAILURE);
+    }
+
+    // The tokens' contents are never longer than the source, except for the few normalized ones (spliced lines)
+    size_t strings_capacity = source->size + 1;
+    uint32_t index = 0;
+
+    for (Token *token = list->front_token; token; token = token->next) {
+        if (token->is_gap) {
+            continue;
+        }
+
+        StoredToken *record = &records[index++];
+        void *symbol = token->is_identifier ?
+                       hash_map_get_key(symbol_indexes, token->string, (unsigned int) token->length) : NULL;
+
+        // Every identifier's content is stored once, shared by all its tokens
+        if (symbol) {
+            record->offset = symbols[(uintptr_t) symbol - 1].offset;
+        } else {
+            if (stored.strings_size + (size_t) token->length > strings_capacity) {
+                strings_capacity = (stored.strings_size + (size_t) token->length) * 2;
+                strings = realloc(strings, strings_capacity);
+
+                if (!strings) {
+                    fprintf(stderr, "Could not allocate enough memory.");
+                    exit(EXIT_FAILURE);
+                }
+            }
+
+            record->offset = stored.strings_size;
+            memcpy(&strings[record->offset], token->string, (size_t) token->length);
+            stored.strings_size += (uint32_t) token->length;
+        }
+
+        if (token->is_identifier && !symbol) {
+            symbols[stored.symbol_count].offset = record->offset;
+            symbols[stored.symbol_count].length = (uint32_t) token->length;
+            symbol = (void *) (uintptr_t) ++stored.symbol_count;
+            hash_map_insert_key(symbol_indexes, token->string, (unsigned int) token->length, symbol);
+        }
+
+        record->length = (uint32_t) token->length;
+        record->width = (uint32_t) token->width;
+        record->symbol = token->is_identifier ? (uint32_t) (uintptr_t) symbol - 1 : 0;
+        record->line = token->location.line;
+        record->column = token->location.column;
+        record->operator = token->operator;
+        record->flags = (uint8_t) ((token->has_space ? STORED_HAS_SPACE : 0) |
+                                   (token->is_identifier ? STORED_IS_IDENTIFIER : 0) |
+                                   (token->is_number ? STORED_IS_NUMBER : 0) |
+                                   (token->is_comment ? STORED_IS_COMMENT : 0) |
+                                   (token->is_directive ? STORED_IS_DIRECTIVE : 0) |
+                                   (token->continues_line ? STORED_CONTINUES_LINE : 0));
+    }
+
+    char *path = store_path(directory, header);
+    size_t temporary_length = strlen(path) + 24;
+    char *temporary = malloc(temporary_length * sizeof *temporary);
+
+    if (!temporary) {
+        fprintf(stderr, "Could not allocate enough memory.");
+        exit(EXIT_FAILURE);
+    }
+
+    snprintf(temporary, temporary_length, "%s.%ld", path, (long) getpid());
+
+    FILE *file = fopen(temporary, "wb");
+    int is_saved = file && write_block(file, &stored, sizeof stored) &&
+                   write_block(file, symbols, stored.symbol_count * sizeof *symbols) &&
+                   write_block(file, records, stored.token_count * sizeof *records) &&
+                   write_block(file, strings, stored.strings_size);
+
+    if (file && fclose(file) != 0) {
+        is_saved = 0;
+    }
+
+    if (is_saved && rename(temporary, path) != 0) {
+        is_saved = 0;
+    }
+
+    if (!is_saved) {
+        remove(temporary);
+    }
+
+    free(temporary);
+    free(path);
+    free(records);
+    free(symbols);
+    free(strings);
+    delete_hash_map(symbol_indexes);
+
+    return is_saved;
+}
@@ -0,0 +1,11 @@
+#ifndef TCPP_STORE_H
+#define TCPP_STORE_H
+
+#include <sys/stat.h>
+#include "header.h"
+
+TokenList *store_load(const char *directory, const Header *header, const struct stat *info, Arena *arena);
+
+int store_save(const char *directory, Header *header);
+
+#endif //TCPP_STORE_H
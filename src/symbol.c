@@ -0,0 +1,97 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "symbol.h"
+
+SymbolTable *symbol_table;
+
+/**
+ * The strings of all known symbols, indexed by KnownSymbol.
+ */
+static const char *known_symbols[SYMBOL_KNOWN_COUNT] = {
+        [SYMBOL_INCLUDE] = "include",
+        [SYMBOL_DEFINE] = "define",
+        [SYMBOL_UNDEF] = "undef",
+        [SYMBOL_IF] = "if",
+        [SYMBOL_IFDEF] = "ifdef",
+        [SYMBOL_IFNDEF] = "ifndef",
+        [SYMBOL_ELIF] = "elif",
+        [SYMBOL_ELSE] = "else",
+        [SYMBOL_ENDIF] = "endif",
+        [SYMBOL_PRAGMA] = "pragma",
+        [SYMBOL_ONCE] = "once",
+        [SYMBOL_DEFINED] = "defined",
+        [SYMBOL_VA_ARGS] = "__VA_ARGS__",
+};
+
+/**
+ * Initializes the global symbol table SYMBOL_TABLE and interns all known symbols into it.
+ */
+void symbol_table_init(void) {
+    symbol_table = calloc(1, sizeof *symbol_table);
+
+    if (!symbol_table || !(symbol_table->map = new_hash_map(0x400, 0x9747b28c))) {
+        fprintf(stderr, "Could not allocate enough memory.");
+        exit(EXIT_FAILURE);
+    }
+
+    symbol_table->arena = new_arena();
+    pthread_rwlock_init(&symbol_table->lock, NULL);
+
+    // Reserve id 0 (SYMBOL_NONE) for tokens which are not identifiers
+    symbol_table->count = 1;
+
+    for (int i = SYMBOL_NONE + 1; i < SYMBOL_KNOWN_COUNT; i++) {
+        intern(known_symbols[i], (unsigned int) strlen(known_symbols[i]));
+    }
+}
+
+/**
+ * Interns an identifier into the global symbol table. Safe to be called from multiple threads at once.
+ *
+ * @param string The identifier to intern. It is copied if it has not been interned before.
+ * @param length The length of the identifier.
+ * @return The id of the identifier's symbol, the same for every occurrence of the identifier.
+ */
+unsigned int intern(const char *string, unsigned int length) {
+    unsigned int hash = hash_map_hash(symbol_table->map, string, length);
+
+    pthread_rwlock_rdlock(&symbol_table->lock);
+    void *id = hash_map_get_hashed_key(symbol_table->map, string, length, hash);
+    pthread_rwlock_unlock(&symbol_table->lock);
+
+    if (id) {
+        return (unsigned int) (uintptr_t) id;
+    }
+
+    pthread_rwlock_wrlock(&symbol_table->lock);
+
+    // Another thread might have interned the identifier in the meantime
+    if ((id = hash_map_get_hashed_key(symbol_table->map, string, length, hash))) {
+        pthread_rwlock_unlock(&symbol_table->lock);
+        return (unsigned int) (uintptr_t) id;
+    }
+
+    if (symbol_table->count >= symbol_table->capacity) {
+        symbol_table->capacity = symbol_table->capacity ? symbol_table->capacity * 2 : 0x400;
+        symbol_table->symbols = realloc(symbol_table->symbols,
+                                        symbol_table->capacity * sizeof *symbol_table->symbols);
+
+        if (!symbol_table->symbols) {
+            fprintf(stderr, "Could not allocate enough memory.");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    unsigned int symbol = symbol_table->count++;
+    Symbol *entry = &symbol_table->symbols[symbol];
+
+    entry->string = arena_strndup(symbol_table->arena, string, length);
+    entry->length = length;
+
+    hash_map_insert_hashed_key(symbol_table->map, entry->string, length, hash, (void *) (uintptr_t) symbol);
+    pthread_rwlock_unlock(&symbol_table->lock);
+
+    return symbol;
+}
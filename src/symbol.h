@@ -0,0 +1,62 @@
+#ifndef TCPP_SYMBOL_H
+#define TCPP_SYMBOL_H
+
+#include <pthread.h>
+#include "hashmap.h"
+#include "arena.h"
+
+/**
+ * Symbols which are interned in advance, so that they can be compared against without a lookup.
+ */
+typedef enum KnownSymbol {
+    SYMBOL_NONE,
+
+    SYMBOL_INCLUDE,
+    SYMBOL_DEFINE,
+    SYMBOL_UNDEF,
+    SYMBOL_IF,
+    SYMBOL_IFDEF,
+    SYMBOL_IFNDEF,
+    SYMBOL_ELIF,
+    SYMBOL_ELSE,
+    SYMBOL_ENDIF,
+    SYMBOL_PRAGMA,
+    SYMBOL_ONCE,
+    SYMBOL_DEFINED,
+    SYMBOL_VA_ARGS,
+
+    SYMBOL_KNOWN_COUNT
+} KnownSymbol;
+
+/**
+ * Stores an interned identifier.
+ */
+typedef struct Symbol {
+    const char *string;
+    unsigned int length;
+} Symbol;
+
+/**
+ * Stores information about all the interned identifiers. A symbol's id is its index in the SYMBOLS array.
+ *
+ * The table is shared by all the threads. LOCK is held for reading while looking a symbol up and for writing while
+ * adding one.
+ */
+typedef struct SymbolTable {
+    HashMap *map;
+    Arena *arena;
+
+    Symbol *symbols;
+    unsigned int count;
+    unsigned int capacity;
+
+    pthread_rwlock_t lock;
+} SymbolTable;
+
+extern SymbolTable *symbol_table;
+
+void symbol_table_init(void);
+
+unsigned int intern(const char *string, unsigned int length);
+
+#endif //TCPP_SYMBOL_H
@@ -0,0 +1,217 @@
+#include <ctype.h>
+#include <stddef.h>
+#include <string.h>
+#include "token.h"
+#include "symbol.h"
+#include "stats.h"
+
+/**
+ * Checks if two given locations are on the same line.
+ *
+ * @param loc1 The first location.
+ * @param loc2 The second location.
+ * @return 1 if they are, 0 otherwise.
+ */
+int same_line(Location loc1, Location loc2) {
+    return loc1.line == loc2.line && loc1.file == loc2.file;
+}
+
+/**
+ * Checks if a token is on a given logical line: on the same line as the location, or continuing the line after a
+ * multi-line comment. The tokens before it on the line must be on the logical line too, so the tokens of a line have to
+ * be checked in order.
+ *
+ * @param token The token.
+ * @param line A location on the line.
+ * @return 1 if it is, 0 otherwise.
+ */
+int is_on_line(const Token *token, Location line) {
+    return same_line(token->location, line) || token->continues_line;
+}
+
+/**
+ * Checks if a character is an appropriate first character for an identifier.
+ *
+ * @param ch The character to be checked.
+ * @return 1 if it is, 0 otherwise.
+ */
+int is_identifier(char ch) {
+    return isalpha(ch) || ch == '_' || ch == '$';
+}
+
+/**
+ * Generates a new token.
+ *
+ * The token does not own its content, which has to outlive it.
+ *
+ * @param arena An arena from which to allocate the token.
+ * @param string Token's content.
+ * @param length The length of token's content.
+ * @param end_location Token's final character's location in a file.
+ * @return A newly generated token.
+ */
+Token *new_token(Arena *arena, const char *string, int length, Location end_location) {
+    Token *token = arena_alloc(arena, sizeof *token);
+
+    token->string = string;
+    token->length = length;
+    token->width = length;
+
+    token->location = end_location;
+    token->location.column -= length;
+
+    stats_add(COUNTER_TOKENS_CREATED, 1);
+
+    return token;
+}
+
+/**
+ * Generates a copy of a token, which is not linked to any token list.
+ *
+ * @param arena An arena from which to allocate the copy.
+ * @param token A token to copy.
+ * @return A newly generated token.
+ */
+Token *copy_token(Arena *arena, const Token *token) {
+    Token *copy = arena_alloc(arena, sizeof *copy);
+
+    // The links are left out (they come last), another thread might be relinking them
+    memcpy(copy, token, offsetof(Token, prev));
+
+    stats_add(COUNTER_TOKENS_CREATED, 1);
+
+    return copy;
+}
+
+/**
+ * Generates a new, empty token list.
+ *
+ * @param arena An arena from which to allocate the list and its tokens.
+ * @return A newly generated token list.
+ */
+TokenList *new_token_list(Arena *arena) {
+    TokenList *token_list = arena_alloc(arena, sizeof *token_list);
+    token_list->arena = arena;
+
+    return token_list;
+}
+
+/**
+ * Finds the token preceding a given one, skipping the comments in between (which are only tokens with
+ * 'keep_comments').
+ *
+ * @param token The token.
+ * @return The preceding token which is not a comment, NULL if there is none.
+ */
+static const Token *prev_code_token(const Token *token) {
+    for (token = token->prev; token && token->is_comment; token = token->prev) {
+    }
+
+    return token;
+}
+
+/**
+ * Automatically sets a token's flags based on token's present information. Identifiers get interned.
+ *
+ * @param token The token to which to set the flags to.
+ */
+void set_token_flags(Token *token) {
+    token->operator = (char) ((token->length == 1) ? token->string[0] : '\0');
+
+    token->is_identifier = is_identifier(token->string[0]);
+    token->symbol = token->is_identifier ? intern(token->string, (unsigned int) token->length) : SYMBOL_NONE;
+    token->is_number = isdigit(token->string[0]) != 0;
+    token->is_comment = token->length > 1 && token->string[0] == '/' &&
+                        (token->string[1] == '/' || token->string[1] == '*');
+
+    // Comments are whitespace, also between the '#' and the name of a directive
+    const Token *hash = token->is_comment ? NULL : prev_code_token(token);
+    token->is_directive = hash && hash->operator == '#' && is_on_line(token, hash->location);
+
+    if (token->is_directive) {
+        const Token *before = prev_code_token(hash);
+
+        if (before && is_on_line(hash, before->location)) {
+            token->is_directive = 0;
+        }
+    }
+}
+
+/**
+ * Appends a token at the end of a token list, keeping the token's flags as they are.
+ *
+ * @param list A token list into which to append the token.
+ * @param token A token to be appended.
+ */
+void append_token(TokenList *list, Token *token) {
+    if (!list->front_token) {
+        list->front_token = token;
+    } else {
+        list->back_token->next = token;
+    }
+
+    token->prev = list->back_token;
+    token->next = NULL;
+    list->back_token = token;
+}
+
+/**
+ * Inserts a token at the end of a token list. Automatically sets the token's flags.
+ *
+ * @param list A token list into which to insert the token.
+ * @param token A token to be inserted.
+ */
+void insert_token(TokenList *list, Token *token) {
+    append_token(list, token);
+    set_token_flags(token);
+}
+
+/**
+ * Deletes a token list and frees the memory allocated to it.
+ *
+ * All the tokens of the list are freed at once together with the list's arena.
+ *
+ * @param token_list A token list to delete.
+ */
+void delete_token_list(TokenList *token_list) {
+    while (token_list->sources) {
+        Source *next = token_list->sources->next;
+        source_close(token_list->sources);
+        token_list->sources = next;
+    }
+
+    delete_arena(token_list->arena);
+}
+
+/**
+ * Deletes a token from a given token list.
+ *
+ * The token is only unlinked, its memory is freed together with the list's arena.
+ *
+ * @param token_list A token list from which to delete the token.
+ * @param token A token to delete.
+ * @return The next token in the token list.
+ */
+Token *delete_token_from_list(TokenList *token_list, Token *token) {
+    if (!token) {
+        return NULL;
+    }
+
+    Token *prev = token->prev;
+    Token *next = token->next;
+
+    if (prev) {
+        prev->next = next;
+    }
+    if (next) {
+        next->prev = prev;
+    }
+    if (token_list->front_token == token) {
+        token_list->front_token = next;
+    }
+    if (token_list->back_token == token) {
+        token_list->back_token = prev;
+    }
+
+    return next;
+}
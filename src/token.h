@@ -0,0 +1,100 @@
+#ifndef TCPP_TOKEN_H
+#define TCPP_TOKEN_H
+
+#include "source.h"
+#include "arena.h"
+
+/**
+ * Stores token information and pointers to its neighboring tokens, creating a doubly-linked list.
+ *
+ * WIDTH is the number of columns the token takes up in its source file. It stays the same when the token's content is
+ * replaced, so that the following tokens on the line keep their columns. HAS_SPACE is set if whitespace precedes the
+ * token, which is needed for the tokens of macro expansions, as they all share the location of the invocation.
+ * CONTINUES_LINE is set on the tokens which follow a multi-line comment on their line: they are on the same logical
+ * line as the tokens before them (e.g. of a directive), even though their LOCATION is on a later line.
+ *
+ * HIDE_SET holds the macros which must not be expanded from the token again, NULL for tokens straight from a file.
+ *
+ * Gap tokens (IS_GAP) stand for a part of the source which has not been tokenized yet. Their STRING and LENGTH cover
+ * the raw characters of the part, which always starts at the beginning of a line, and their LOCATION is where it
+ * starts.
+ *
+ * Every pass over the tokens reads them one by one, so they are packed to take up a single cache line (64 bytes on
+ * 64-bit targets): the flags are single bits sharing a word with OPERATOR, and the links come last, so that copies
+ * only touch the first 48 bytes. Tokens are allocated one after another from arenas, which keeps the tokens of a list
+ * next to each other in memory too.
+ */
+typedef struct Token {
+    const char *string;
+    struct HideSet *hide_set;
+    Location location;
+
+    int length;
+    int width;
+    unsigned int symbol;
+
+    char operator;
+    unsigned int has_space: 1;
+    unsigned int is_identifier: 1;
+    unsigned int is_number: 1;
+    unsigned int is_comment: 1;
+    unsigned int is_directive: 1;
+    unsigned int is_gap: 1;
+    unsigned int continues_line: 1;
+
+    struct Token *prev;
+    struct Token *next;
+} Token;
+
+/**
+ * Stores information about doubly-linked token list.
+ *
+ * LINE_COUNT is the number of non-empty lines and COMMENT_COUNT the number of comments found while tokenizing, whether
+ * the comments were kept in the list or not. Multi-line tokens (continued lines, multi-line comments, etc.) are
+ * considered to be 1 line.
+ */
+typedef struct TokenList {
+    Token *front_token;
+    Token *back_token;
+
+    Source *sources;
+    Arena *arena;
+
+    int line_count;
+    int comment_count;
+} TokenList;
+
+/**
+ * Follows the link to a token's successor. Threads sharing a token list publish the tokens of its gaps by relinking
+ * their predecessors atomically, so the link is read atomically as well.
+ *
+ * @param token The token whose successor to get.
+ * @return The next token, NULL at the end of the list.
+ */
+static inline Token *token_next(const Token *token) {
+    return __atomic_load_n(&token->next, __ATOMIC_ACQUIRE);
+}
+
+int same_line(Location loc1, Location loc2);
+
+int is_on_line(const Token *token, Location line);
+
+int is_identifier(char ch);
+
+Token *new_token(Arena *arena, const char *string, int length, Location end_location);
+
+Token *copy_token(Arena *arena, const Token *token);
+
+TokenList *new_token_list(Arena *arena);
+
+void set_token_flags(Token *token);
+
+void append_token(TokenList *list, Token *token);
+
+void insert_token(TokenList *list, Token *token);
+
+void delete_token_list(TokenList *token_list);
+
+Token *delete_token_from_list(TokenList *token_list, Token *token);
+
+#endif //TCPP_TOKEN_H
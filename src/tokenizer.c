@@ -0,0 +1,638 @@
+#include <stdio.h>
+#include <ctype.h>
+#include <string.h>
+#include "tokenizer.h"
+#include "args.h"
+#include "symbol.h"
+#include "file.h"
+#include "stats.h"
+#include "trace.h"
+#include "scan.h"
+
+/**
+ * Generates a new token from a raw part of a source.
+ *
+ * The token points straight into the source unless the part contains line continuations or CR line endings, in which
+ * case a normalized copy of it is made in the arena.
+ *
+ * @param arena An arena from which to allocate the token.
+ * @param source The source to which the part belongs.
+ * @param start The first raw character of the part.
+ * @param is_normalized Non-zero if the source normalized any characters of the part while reading it.
+ * @param end_location Token's final character's location in a file.
+ * @return A newly generated token.
+ */
+static Token *new_source_token(Arena *arena, const Source *source, const char *start, int is_normalized,
+                               Location end_location) {
+    if (!is_normalized) {
+        return new_token(arena, start, (int) (source->cursor - start), end_location);
+    }
+
+    char *string = arena_alloc(arena, (size_t) (source->cursor - start));
+
+    return new_token(arena, string, (int) source_normalize(source, start, source->cursor, string), end_location);
+}
+
+/**
+ * Reads a string until an END character (inclusive) or the end of the line. Advances current file location accordingly.
+ *
+ * Escape sequences are skipped for string and char literals, so an escaped END character does not end the string.
+ *
+ * @param source A source from which to read.
+ * @param end The final character of the string scope.
+ * @param location The current location in a file.
+ */
+static void read_until(Source *source, char end, Location *location) {
+    char ch;
+
+    for (;;) {
+        source_skip_to(source, scan_find_any(source->cursor, source->end, end, '\\', '\n', '\r'), location);
+
+        if (!source_read_char(source, &ch, location) || ch == end || ch == '\n') {
+            break;
+        }
+
+        if (ch == '\\' && end != '>' && source_peek_char(source) != '\n') {
+            source_read_char(source, &ch, location);
+        }
+    }
+}
+
+/**
+ * Links the tokens generated from the start of a gap into the token list in front of the gap.
+ *
+ * The gap's predecessor might have been moved into another list by now (the preprocessor moves the tokens of the main
+ * file into its output), so it is only relinked if it still points to the gap. The gap itself stays in the list even
+ * once nothing is left of it, as readers of shared lists might still be holding it.
+ *
+ * The relinking is the last step, so that other threads following the list see the new tokens complete.
+ *
+ * @param token_list The token list to which the gap belongs.
+ * @param gap The gap.
+ * @param prev The gap's predecessor at the time the tokens were generated.
+ * @param first The first generated token, NULL if none were generated.
+ * @param last The last generated token, NULL if none were generated.
+ * @return The first generated token, or the token following the gap if there were none.
+ */
+static Token *link_gap_tokens(TokenList *token_list, Token *gap, Token *prev, Token *first, Token *last) {
+    if (!first) {
+        return gap->next;
+    }
+
+    last->next = gap;
+    gap->prev = last;
+
+    if (prev && prev->next == gap) {
+        __atomic_store_n(&prev->next, first, __ATOMIC_RELEASE);
+    }
+    if (token_list->front_token == gap) {
+        __atomic_store_n(&token_list->front_token, first, __ATOMIC_RELEASE);
+    }
+
+    return first;
+}
+
+/**
+ * Generates a token list for an open source, taking the source over.
+ *
+ * The source is not tokenized right away. Instead, the list holds a single gap token which covers the whole source and
+ * is tokenized on demand with tokenize_gap, so that the parts of the source which are never needed (like inactive
+ * groups of conditionals) are never tokenized.
+ *
+ * @param source The source to tokenize, closed with the token list.
+ * @param arena An arena from which to allocate the token list.
+ * @return A newly generated token list.
+ */
+TokenList *tokenize_source(Source *source, Arena *arena) {
+    StatsPhase phase = stats_enter(PHASE_TOKENIZE);
+    uint64_t start = trace_begin();
+    unsigned int file = file_table_add(source->file_name);
+    TokenList *token_list = new_token_list(arena);
+    token_list->sources = source;
+
+    if (source->size) {
+        Token *gap = arena_alloc(arena, sizeof *gap);
+
+        gap->string = source->data;
+        gap->length = (int) source->size;
+        gap->is_gap = 1;
+        gap->location.file = file;
+        gap->location.line = 1;
+
+        append_token(token_list, gap);
+    }
+
+    trace_end(TRACE_TOKENIZE, start, file, SYMBOL_NONE, source->size);
+    stats_leave(phase);
+
+    return token_list;
+}
+
+/**
+ * Reads a given "*.c" file and generates a token list for it (see tokenize_source).
+ *
+ * @param file_name The location of the file to tokenize.
+ * @param arena An arena from which to allocate the token list.
+ * @return A newly generated token list, NULL if the file could not be opened.
+ */
+TokenList *tokenize_file(char *file_name, Arena *arena) {
+    StatsPhase phase = stats_enter(PHASE_TOKENIZE);
+    Source *source = source_open(file_name);
+
+    if (!source) {
+        stats_leave(phase);
+        return NULL;
+    }
+
+    verbose_printf("Tokenizing file %s.\n", file_name);
+    TokenList *token_list = tokenize_source(source, arena);
+    stats_leave(phase);
+
+    return token_list;
+}
+
+/**
+ * Tokenizes the first line of a gap and inserts the generated tokens in front of it. Lines which end up generating no
+ * tokens (blank lines, comments, etc.) are tokenized as well, together with the line which follows them. The gap is
+ * shrunk to the rest of its part.
+ *
+ * More information on this process:
+ * https://gcc.gnu.org/onlinedocs/cpp/Tokenization.html#Tokenization
+ *
+ * Comments are skipped without generating tokens for them unless 'keep_comments' is set.
+ *
+ * @param token_list The token list to which the gap belongs.
+ * @param gap The gap to tokenize.
+ * @return The first generated token, or the token following the gap if there were none.
+ */
+Token *tokenize_gap(TokenList *token_list, Token *gap) {
+    StatsPhase phase = stats_enter(PHASE_TOKENIZE);
+    Arena *arena = token_list->arena;
+    Source source = *token_list->sources;
+    Location location = gap->location;
+    Token *first = NULL;
+    Token *last = NULL;
+    char ch;
+    int last_line = 0;
+    int has_space = 1;
+
+    source.cursor = gap->string;
+    source.end = gap->string + gap->length;
+
+    for (;;) {
+        // Skip indentation and other blanks in bulk
+        const char *blanks = source.cursor;
+        source_skip_to(&source, scan_skip_blanks(source.cursor, source.end), &location);
+        has_space |= source.cursor != blanks;
+
+        // Remember where the token starts in the source
+        source.cursor = source_skip_splices(&source, source.cursor);
+        const char *start = source.cursor;
+        int normalized = source.normalized;
+
+        if (!source_read_char(&source, &ch, &location)) {
+            break;
+        }
+
+        if (ch == '\n' && last) {
+            break;
+        }
+
+        if (isspace(ch)) {
+            has_space = 1;
+            continue;
+        }
+
+        int is_comment = 0;
+
+        if (is_identifier(ch) || isdigit(ch)) {
+            // Name or number
+
+            do {
+                ch = (char) source_peek_char(&source);
+            } while ((is_identifier(ch) || isdigit(ch)) && source_read_char(&source, &ch, &location));
+
+        } else if (ch == '/' && source_peek_char(&source) == '/') {
+            // Single line comments (//)
+            is_comment = 1;
+
+            do {
+                source_skip_to(&source, scan_find_any(source.cursor, source.end, '\n', '\r', '\\', '\\'), &location);
+                ch = (char) source_peek_char(&source);
+            } while (ch != '\n' && source_read_char(&source, &ch, &location));
+
+        } else if (ch == '/' && source_peek_char(&source) == '*') {
+            // Multiline comments (/* */)
+            is_comment = 1;
+
+            source_read_char(&source, &ch, &location);
+
+            do {
+                source_skip_to(&source, scan_find_any(source.cursor, source.end, '*', '\n', '\r', '\\'), &location);
+            } while (source_read_char(&source, &ch, &location) && !(ch == '*' && source_peek_char(&source) == '/'));
+
+            source_read_char(&source, &ch, &location);
+
+        } else if (ch == '\"' || ch == '\'') {
+            // String and char literals (" ')
+
+            read_until(&source, ch, &location);
+
+        } else if (ch == '<' && last && last->is_directive && last->symbol == SYMBOL_INCLUDE) {
+            // Include (< >)
+
+            read_until(&source, '>', &location);
+        }
+
+        if (location.line > last_line) {
+            last_line = location.line;
+            token_list->line_count++;
+        }
+
+        if (is_comment) {
+            token_list->comment_count++;
+
+            if (!args->keep_comments) {
+                stats_add(COUNTER_COMMENTS_REMOVED, 1);
+                has_space = 1;
+                continue;
+            }
+        }
+
+        Token *token = new_source_token(arena, &source, start, source.normalized != normalized, location);
+        token->has_space = has_space;
+        token->continues_line = last && (last->continues_line || !same_line(last->location, location));
+        has_space = 0;
+
+        token->prev = last ? last : gap->prev;
+        if (last) {
+            last->next = token;
+        } else {
+            first = token;
+        }
+        last = token;
+
+        set_token_flags(token);
+    }
+
+    Token *prev = gap->prev;
+
+    gap->string = source.cursor;
+    gap->length = (int) (source.end - source.cursor);
+    gap->location = location;
+
+    Token *next = link_gap_tokens(token_list, gap, prev, first, last);
+    stats_leave(phase);
+
+    return next;
+}
+
+/**
+ * Checks if a line ending is preceded by a backslash, which makes it a line continuation.
+ *
+ * @param start The start of the characters before the line ending.
+ * @param position The position of the line ending.
+ * @return 1 if it is, 0 otherwise.
+ */
+static int is_line_continuation(const char *start, const char *position) {
+    if (*position == '\n' && position > start && position[-1] == '\r') {
+        position--;
+    }
+
+    return position > start && position[-1] == '\\';
+}
+
+/**
+ * Skips a line ending (LF, CR or CRLF).
+ *
+ * @param position The position of the line ending.
+ * @param end The end of the characters.
+ * @return The position following the line ending.
+ */
+static const char *skip_line_ending(const char *position, const char *end) {
+    return (*position == '\r' && position + 1 < end && position[1] == '\n') ? position + 2 : position + 1;
+}
+
+/**
+ * Skips line continuations.
+ *
+ * @param cursor The position from which to skip.
+ * @param end The end of the characters.
+ * @return The first position which does not start a line continuation.
+ */
+static const char *skip_splices(const char *cursor, const char *end) {
+    while (cursor + 1 < end && cursor[0] == '\\' && (cursor[1] == '\n' || cursor[1] == '\r')) {
+        cursor = skip_line_ending(cursor + 1, end);
+    }
+
+    return cursor;
+}
+
+/**
+ * Skips blanks and line continuations, neither of which makes a difference to the directive on a line.
+ *
+ * @param cursor The position from which to skip.
+ * @param end The end of the characters.
+ * @return The first position which is neither a blank nor starts a line continuation.
+ */
+static const char *skip_blanks_and_splices(const char *cursor, const char *end) {
+    for (const char *next; (next = skip_splices(scan_skip_blanks(cursor, end), end)) != cursor;) {
+        cursor = next;
+    }
+
+    return cursor;
+}
+
+/**
+ * Skips the rest of a multiline comment (after its '/''*'), counting the lines it spans.
+ *
+ * @param start The start of the characters.
+ * @param cursor The position from which to skip.
+ * @param end The end of the characters.
+ * @param line The current line, advanced accordingly.
+ * @return The position following the comment.
+ */
+static const char *skip_multiline_comment(const char *start, const char *cursor, const char *end, int *line) {
+    for (;;) {
+        const char *position = scan_find_any(cursor, end, '*', '\n', '\r', '*');
+
+        if (position >= end) {
+            return end;
+        }
+
+        if (*position == '*') {
+            const char *next = skip_splices(position + 1, end);
+
+            if (next < end && *next == '/') {
+                return next + 1;
+            }
+
+            cursor = position + 1;
+            continue;
+        }
+
+        if (!is_line_continuation(start, position)) {
+            (*line)++;
+        }
+
+        cursor = skip_line_ending(position, end);
+    }
+}
+
+/**
+ * Finds the end of a single line comment, i.e. the first line ending which is not a line continuation.
+ *
+ * @param start The start of the characters.
+ * @param cursor The position from which to search.
+ * @param end The end of the characters.
+ * @return The position of the line ending, END if there is none.
+ */
+static const char *find_line_end(const char *start, const char *cursor, const char *end) {
+    for (;;) {
+        const char *position = scan_find_any(cursor, end, '\n', '\r', '\n', '\r');
+
+        if (position >= end || !is_line_continuation(start, position)) {
+            return position;
+        }
+
+        cursor = skip_line_ending(position, end);
+    }
+}
+
+/**
+ * Skips the rest of a string or char literal (after its opening quote). Escape sequences are skipped, so an escaped
+ * quote does not end the literal.
+ *
+ * @param cursor The position from which to skip.
+ * @param end The end of the characters.
+ * @param quote The quote which ends the literal ('"' or '\'').
+ * @return The position following the literal, or of the line ending at which an unterminated literal ends.
+ */
+static const char *skip_literal(const char *cursor, const char *end, char quote) {
+    for (;;) {
+        const char *position = scan_find_any(cursor, end, quote, '\\', '\n', '\r');
+
+        if (position >= end || *position == '\n' || *position == '\r') {
+            return position;
+        }
+
+        if (*position == quote) {
+            return position + 1;
+        }
+
+        // Escape sequence or line continuation
+        cursor = position + 1 < end ? skip_line_ending(position + 1, end) : end;
+    }
+}
+
+/**
+ * The kinds of directives which a group of lines is scanned for.
+ */
+typedef enum DirectiveKind {
+    DIRECTIVE_OTHER,
+    DIRECTIVE_OPENING,
+    DIRECTIVE_MIDDLE,
+    DIRECTIVE_CLOSING
+} DirectiveKind;
+
+/**
+ * Classifies a directive by its name.
+ *
+ * @param name The name of the directive.
+ * @param length The length of the name.
+ * @return The kind of the directive.
+ */
+static DirectiveKind directive_kind(const char *name, size_t length) {
+    if ((length == 2 && !memcmp(name, "if", 2)) || (length == 5 && !memcmp(name, "ifdef", 5)) ||
+        (length == 6 && !memcmp(name, "ifndef", 6))) {
+        return DIRECTIVE_OPENING;
+    }
+
+    if ((length == 4 && !memcmp(name, "elif", 4)) || (length == 4 && !memcmp(name, "else", 4))) {
+        return DIRECTIVE_MIDDLE;
+    }
+
+    if (length == 5 && !memcmp(name, "endif", 5)) {
+        return DIRECTIVE_CLOSING;
+    }
+
+    return DIRECTIVE_OTHER;
+}
+
+/**
+ * Scans lines for the conditional directive (#elif, #else or #endif) which ends their group, skipping nested
+ * conditionals. Only a '#' at the start of a line and the name following it are looked at besides comments and
+ * string and char literals (so that they do not hide or fake directives), and no tokens are generated.
+ *
+ * @param token_list The token list to which the lines belong. Its line and comment counts are advanced.
+ * @param cursor The start of the lines.
+ * @param end The end of the lines.
+ * @param depth The nesting depth of conditionals, advanced accordingly. NULL to stop at any directive instead.
+ * @param line The current line, advanced accordingly.
+ * @return The start of the line of the directive, NULL if there is none.
+ */
+static const char *scan_group(TokenList *token_list, const char *cursor, const char *end, int *depth, int *line) {
+    const char *start = cursor;
+
+    while (cursor < end) {
+        const char *line_start = cursor;
+        int is_line_start = 1;
+        int is_counted = 0;
+
+        for (;;) {
+            cursor = skip_blanks_and_splices(cursor, end);
+
+            if (is_line_start && cursor < end && *cursor == '#') {
+                char name[16];
+                size_t length = 0;
+                int name_line = *line, comments = 0;
+
+                cursor = skip_blanks_and_splices(cursor + 1, end);
+
+                // Comments may separate the name from the '#' (they are only counted once the line is skipped)
+                for (const char *next; cursor < end && *cursor == '/' &&
+                                       (next = skip_splices(cursor + 1, end)) < end && *next == '*';) {
+                    comments++;
+                    cursor = skip_blanks_and_splices(skip_multiline_comment(start, next + 1, end, &name_line), end);
+                }
+
+                // The name might be split by line continuations too (longer names are no directives anyway)
+                for (; cursor < end && (is_identifier(*cursor) || isdigit(*cursor));
+                     cursor = skip_splices(cursor + 1, end)) {
+                    if (length < sizeof name) {
+                        name[length++] = *cursor;
+                    }
+                }
+
+                DirectiveKind kind = directive_kind(name, length);
+
+                if (!depth) {
+                    return line_start;
+                } else if (kind == DIRECTIVE_OPENING) {
+                    (*depth)++;
+                } else if (kind != DIRECTIVE_OTHER) {
+                    if (*depth == 0) {
+                        return line_start;
+                    }
+
+                    if (kind == DIRECTIVE_CLOSING) {
+                        (*depth)--;
+                    }
+                }
+
+                token_list->comment_count += comments;
+                *line = name_line;
+            }
+
+            if (!is_counted && cursor < end && *cursor != '\n' && *cursor != '\r') {
+                is_counted = 1;
+                token_list->line_count++;
+            }
+
+            const char *position = scan_find_any(cursor, end, '\n', '\r', '/', '\"');
+
+            // Char literals are rare, they are looked for in what has been scanned over only
+            const char *quote = memchr(cursor, '\'', (size_t) ((position < end ? position : end) - cursor));
+
+            if (quote) {
+                position = quote;
+            }
+
+            if (position >= end) {
+                return NULL;
+            }
+
+            // Only blanks and comments may precede a directive
+            if (position != cursor) {
+                is_line_start = 0;
+            }
+
+            // Comments might be split by line continuations too
+            const char *next = *position == '/' ? skip_splices(position + 1, end) : position;
+
+            if (*position == '/' && next < end && *next == '*') {
+                token_list->comment_count++;
+                cursor = skip_multiline_comment(start, next + 1, end, line);
+
+            } else if (*position == '/' && next < end && *next == '/') {
+                token_list->comment_count++;
+                is_line_start = 0;
+                cursor = find_line_end(start, next + 1, end);
+
+            } else if (*position == '\"' || *position == '\'') {
+                is_line_start = 0;
+                cursor = skip_literal(position + 1, end, *position);
+
+            } else if (*position == '/') {
+                is_line_start = 0;
+                cursor = position + 1;
+
+            } else {
+                // Line ending
+                cursor = skip_line_ending(position, end);
+
+                if (!is_line_continuation(start, position)) {
+                    (*line)++;
+                    break;
+                }
+
+                is_line_start = 0;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Skips the lines at the start of a gap, up to the conditional directive (#elif, #else or #endif) which ends their
+ * group. Nested conditionals are skipped as a whole. The skipped lines are not tokenized, but split off into a gap of
+ * their own, in case they are needed later.
+ *
+ * @param token_list The token list to which the gap belongs.
+ * @param gap The gap in which to skip.
+ * @param depth The nesting depth of conditionals at the start of the gap, advanced accordingly. NULL to skip up to any
+ *  directive instead, e.g. when only the directives are needed.
+ * @return The '#' token of the directive if it was found (the line of the directive is tokenized), otherwise the token
+ *  following the gap.
+ */
+Token *skip_gap(TokenList *token_list, Token *gap, int *depth) {
+    StatsPhase phase = stats_enter(PHASE_TOKENIZE);
+    int line = gap->location.line;
+    const char *position = scan_group(token_list, gap->string, gap->string + gap->length, depth, &line);
+
+    if (!position) {
+        stats_leave(phase);
+        return gap->next;
+    }
+
+    if (position != gap->string) {
+        Token *skipped = arena_alloc(token_list->arena, sizeof *skipped);
+
+        skipped->string = gap->string;
+        skipped->length = (int) (position - gap->string);
+        skipped->is_gap = 1;
+        skipped->location = gap->location;
+
+        skipped->prev = gap->prev;
+        skipped->next = gap;
+
+        if (gap->prev && gap->prev->next == gap) {
+            __atomic_store_n(&gap->prev->next, skipped, __ATOMIC_RELEASE);
+        }
+        if (token_list->front_token == gap) {
+            __atomic_store_n(&token_list->front_token, skipped, __ATOMIC_RELEASE);
+        }
+
+        gap->prev = skipped;
+        gap->length -= skipped->length;
+        gap->string = position;
+        gap->location.line = line;
+        gap->location.column = 0;
+    }
+
+    Token *token = tokenize_gap(token_list, gap);
+    stats_leave(phase);
+
+    return token;
+}
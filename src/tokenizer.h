@@ -0,0 +1,14 @@
+#ifndef TCPP_TOKENIZER_H
+#define TCPP_TOKENIZER_H
+
+#include "token.h"
+
+TokenList *tokenize_source(Source *source, Arena *arena);
+
+TokenList *tokenize_file(char *file_name, Arena *arena);
+
+Token *tokenize_gap(TokenList *token_list, Token *gap);
+
+Token *skip_gap(TokenList *token_list, Token *gap, int *depth);
+
+#endif //TCPP_TOKENIZER_H
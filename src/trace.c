@@ -0,0 +1,206 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "trace.h"
+#include "file.h"
+#include "symbol.h"
+
+/**
+ * The least time a macro expansion has to take to be recorded, in nanoseconds. Most expansions take far less, and
+ * recording all of them would bury the includes.
+ */
+static const uint64_t macro_threshold = 20000;
+
+/**
+ * The spans of the current thread, NULL until it records any.
+ */
+static __thread TraceBuffer *thread_trace;
+
+/**
+ * The buffers of all the threads which have recorded any spans, linked through NEXT. Protected by TRACE_LOCK.
+ */
+static TraceBuffer *all_traces;
+static int trace_count;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * The names of the kinds of spans, used as their categories in the trace. Indexed by TraceKind.
+ */
+static const char *kind_names[] = {
+        [TRACE_UNIT] = "unit",
+        [TRACE_INCLUDE] = "include",
+        [TRACE_TOKENIZE] = "tokenize",
+        [TRACE_MACRO] = "macro",
+};
+
+/**
+ * Reads the clock of the trace.
+ *
+ * @return The current time in nanoseconds, never 0.
+ */
+uint64_t trace_clock(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return (uint64_t) time.tv_sec * 1000000000 + (uint64_t) time.tv_nsec + 1;
+}
+
+/**
+ * Records a span in the buffer of the current thread. Macro expansions shorter than MACRO_THRESHOLD are left out.
+ *
+ * @param kind The kind of the span.
+ * @param start The start of the span.
+ * @param file The id of the span's file.
+ * @param symbol The symbol of the expanded macro.
+ * @param size The size of the span's file, or the depth of its include.
+ */
+void trace_span(TraceKind kind, uint64_t start, unsigned int file, unsigned int symbol, uint64_t size) {
+    uint64_t end = trace_clock();
+
+    if (kind == TRACE_MACRO && end - start < macro_threshold) {
+        return;
+    }
+
+    TraceBuffer *buffer = thread_trace;
+
+    if (!buffer) {
+        buffer = thread_trace = calloc(1, sizeof *buffer);
+
+        if (!buffer) {
+            fprintf(stderr, "Could not allocate enough memory.");
+            exit(EXIT_FAILURE);
+        }
+
+        pthread_mutex_lock(&trace_lock);
+        buffer->id = trace_count++;
+        buffer->next = all_traces;
+        all_traces = buffer;
+        pthread_mutex_unlock(&trace_lock);
+    }
+
+    if (buffer->count == buffer->capacity) {
+        buffer->capacity = buffer->capacity ? buffer->capacity * 2 : 0x100;
+        buffer->spans = realloc(buffer->spans, buffer->capacity * sizeof *buffer->spans);
+
+        if (!buffer->spans) {
+            fprintf(stderr, "Could not allocate enough memory.");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    buffer->spans[buffer->count++] = (TraceSpan) {kind, file, symbol, size, start, end};
+}
+
+/**
+ * Writes a string as a JSON string.
+ *
+ * @param file The file to write to.
+ * @param string The string to write.
+ * @param length The length of the string.
+ */
+static void write_json_string(FILE *file, const char *string, size_t length) {
+    fputc('"', file);
+
+    for (size_t i = 0; i < length; i++) {
+        unsigned char ch = (unsigned char) string[i];
+
+        if (ch == '"' || ch == '\\') {
+            fprintf(file, "\\%c", ch);
+        } else if (ch < 0x20) {
+            fprintf(file, "\\u%04x", ch);
+        } else {
+            fputc(ch, file);
+        }
+    }
+
+    fputc('"', file);
+}
+
+/**
+ * Writes a span as a complete event of the trace event format.
+ *
+ * @param file The file to write to.
+ * @param span The span to write.
+ * @param thread The id of the thread which recorded the span.
+ * @param origin The time from which the timestamps of the trace are counted.
+ */
+static void write_span(FILE *file, const TraceSpan *span, int thread, uint64_t origin) {
+    const char *file_name = file_table_name(span->file);
+    const char *name = file_name;
+    size_t length = strlen(file_name);
+
+    if (span->kind == TRACE_MACRO) {
+        name = symbol_table->symbols[span->symbol].string;
+        length = symbol_table->symbols[span->symbol].length;
+    }
+
+    fprintf(file, "{\"name\": ");
+    write_json_string(file, name, length);
+    fprintf(file, ", \"cat\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": %d, \"tid\": %d, ",
+            kind_names[span->kind], (double) (span->start - origin) / 1e3, (double) (span->end - span->start) / 1e3,
+            (int) getpid(), thread);
+
+    fprintf(file, "\"args\": {");
+
+    if (span->kind == TRACE_MACRO) {
+        fprintf(file, "\"file\": ");
+        write_json_string(file, file_name, strlen(file_name));
+    } else if (span->kind == TRACE_TOKENIZE) {
+        fprintf(file, "\"bytes\": %llu", (unsigned long long) span->size);
+    } else if (span->kind == TRACE_INCLUDE) {
+        fprintf(file, "\"depth\": %llu", (unsigned long long) span->size);
+    }
+
+    fprintf(file, "}}");
+}
+
+/**
+ * Writes the spans recorded by all the threads into a file, in the trace event format read by Chrome's about:tracing
+ * and Perfetto. Meant to be called once all the threads have finished recording.
+ *
+ * @param file_name The location of the file to write to.
+ * @return 1 if successful, 0 otherwise.
+ */
+int trace_write(const char *file_name) {
+    FILE *file = fopen(file_name, "w");
+
+    if (!file) {
+        fprintf(stderr, "Could not open or create file %s.\n", file_name);
+        return 0;
+    }
+
+    pthread_mutex_lock(&trace_lock);
+
+    uint64_t origin = UINT64_MAX;
+
+    for (const TraceBuffer *buffer = all_traces; buffer; buffer = buffer->next) {
+        for (size_t i = 0; i < buffer->count; i++) {
+            origin = buffer->spans[i].start < origin ? buffer->spans[i].start : origin;
+        }
+    }
+
+    const char *separator = "\n";
+    fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+
+    for (const TraceBuffer *buffer = all_traces; buffer; buffer = buffer->next) {
+        for (size_t i = 0; i < buffer->count; i++) {
+            fprintf(file, "%s", separator);
+            write_span(file, &buffer->spans[i], buffer->id, origin);
+            separator = ",\n";
+        }
+    }
+
+    pthread_mutex_unlock(&trace_lock);
+
+    fprintf(file, "\n]}\n");
+
+    if (ferror(file) | fclose(file)) {
+        fprintf(stderr, "Could not write to file %s.\n", file_name);
+        return 0;
+    }
+
+    return 1;
+}
@@ -0,0 +1,81 @@
+#ifndef TCPP_TRACE_H
+#define TCPP_TRACE_H
+
+#include <stdint.h>
+#include "args.h"
+
+/**
+ * The kinds of spans recorded in a trace.
+ *
+ * TRACE_UNIT spans the preprocessing of a translation unit and TRACE_INCLUDE the reading of an included header, nested
+ * under the span of the file which includes it. TRACE_TOKENIZE spans opening a file for tokenizing (the file is then
+ * tokenized lazily, inside the spans of the files reading it) and TRACE_MACRO a macro expansion which takes at least
+ * the threshold in trace.c.
+ */
+typedef enum TraceKind {
+    TRACE_UNIT,
+    TRACE_INCLUDE,
+    TRACE_TOKENIZE,
+    TRACE_MACRO
+} TraceKind;
+
+/**
+ * Stores a recorded span. FILE is the id of the span's file in the file table, SYMBOL the macro's symbol for
+ * TRACE_MACRO spans. SIZE is the file's size for TRACE_TOKENIZE spans and the depth of the include for TRACE_INCLUDE
+ * ones. The times are in nanoseconds since the trace was started.
+ */
+typedef struct TraceSpan {
+    TraceKind kind;
+    unsigned int file;
+    unsigned int symbol;
+    uint64_t size;
+
+    uint64_t start;
+    uint64_t end;
+} TraceSpan;
+
+/**
+ * Stores the spans recorded by a single thread, so that recording them needs no synchronization. ID identifies the
+ * thread in the trace.
+ */
+typedef struct TraceBuffer {
+    TraceSpan *spans;
+    size_t count;
+    size_t capacity;
+
+    int id;
+
+    struct TraceBuffer *next;
+} TraceBuffer;
+
+uint64_t trace_clock(void);
+
+void trace_span(TraceKind kind, uint64_t start, unsigned int file, unsigned int symbol, uint64_t size);
+
+int trace_write(const char *file_name);
+
+/**
+ * Starts a span if a trace is recorded ('--trace').
+ *
+ * @return The start of the span, to be passed into trace_end, 0 if no trace is recorded.
+ */
+static inline uint64_t trace_begin(void) {
+    return args->trace_file ? trace_clock() : 0;
+}
+
+/**
+ * Ends a span started with trace_begin and records it.
+ *
+ * @param kind The kind of the span.
+ * @param start The start of the span, returned by trace_begin.
+ * @param file The id of the span's file.
+ * @param symbol The symbol of the expanded macro, SYMBOL_NONE for spans which are not TRACE_MACRO ones.
+ * @param size The size of the span's file, or the depth of its include.
+ */
+static inline void trace_end(TraceKind kind, uint64_t start, unsigned int file, unsigned int symbol, uint64_t size) {
+    if (start) {
+        trace_span(kind, start, file, symbol, size);
+    }
+}
+
+#endif //TCPP_TRACE_H
@@ -0,0 +1,279 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include "unit.h"
+#include "layout.h"
+#include "args.h"
+#include "tokenizer.h"
+#include "preprocess.h"
+#include "stats.h"
+#include "trace.h"
+#include "symbol.h"
+#include "depend.h"
+#include "manifest.h"
+#include "plain.h"
+
+/**
+ * Writes a token list to a file.
+ *
+ * @param token_list A token list to write.
+ * @param file_name The location of the file to write to, "-" for stdout.
+ * @return 1 if successful, 0 otherwise.
+ */
+static int write_token_list_to_file(const TokenList *token_list, const char *file_name) {
+    Writer *writer = writer_open(file_name);
+
+    if (!writer) {
+        fprintf(stderr, "Could not open or create file %s.\n", file_name);
+        return 0;
+    }
+
+    verbose_printf("Writing tokens to %s.\n", file_name);
+    write_token_list(token_list, writer);
+
+    if (!writer_close(writer)) {
+        fprintf(stderr, "Could not write to file %s.\n", file_name);
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * Preprocesses a translation unit, without writing it anywhere yet unless it is streamed. The translation unit gets
+ * its own arena and macros, the header cache is shared with the other translation units. Sets IS_FAILED if
+ * unsuccessful.
+ *
+ * @param unit The translation unit to preprocess.
+ * @param stream A writer through which to write the output while preprocessing (leaving OUTPUT empty), NULL to only
+ *  collect it in OUTPUT.
+ * @return 1 if successful, 0 otherwise.
+ */
+int translation_unit_preprocess(TranslationUnit *unit, Writer *stream) {
+    StatsPhase phase = stats_enter(PHASE_PREPROCESS);
+    uint64_t start = trace_begin();
+
+    // Keep track of the files opened while preprocessing, starting with the input file
+    file_list_append(&unit->files, file_table_add(unit->input_file));
+
+    // Generate a new raw token list from the input, which might have been opened already
+    if (unit->source) {
+        verbose_printf("Tokenizing file %s.\n", unit->input_file);
+        unit->tokens = tokenize_source(unit->source, new_arena());
+        unit->source = NULL;
+    } else {
+        unit->tokens = tokenize_file(unit->input_file, new_arena());
+    }
+
+    if (!unit->tokens) {
+        fprintf(stderr, "Could not open file %s.\n", unit->input_file);
+        unit->is_failed = 1;
+        stats_leave(phase);
+        return 0;
+    }
+
+    unit->output = preprocess_token_list(unit->tokens, unit->header_cache, &unit->files,
+                                         args->manifest ? &unit->misses : NULL, stream);
+    unit->line_count = unit->tokens->line_count;
+    unit->comment_count = unit->tokens->comment_count;
+    trace_end(TRACE_UNIT, start, unit->files.files[0], SYMBOL_NONE, 0);
+    stats_leave(phase);
+
+    if (!unit->output) {
+        unit->is_failed = 1;
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * Frees the token lists and the file list of a translation unit once it has been written.
+ *
+ * @param unit The translation unit to release.
+ */
+void translation_unit_release(TranslationUnit *unit) {
+    // The preprocessed list shares its arena with the raw one
+    if (unit->tokens) {
+        delete_token_list(unit->tokens);
+    }
+
+    source_close(unit->source);
+    file_list_clear(&unit->files);
+    file_list_clear(&unit->misses);
+
+    unit->source = NULL;
+    unit->tokens = NULL;
+    unit->output = NULL;
+}
+
+/**
+ * Writes the Makefile rule of a translation unit, making its object file depend on a list of files.
+ *
+ * @param unit The translation unit.
+ * @param files The files the translation unit depends on, starting with its input file.
+ * @param writer The writer to which to write.
+ */
+void translation_unit_write_dependencies(const TranslationUnit *unit, const FileList *files, Writer *writer) {
+    char *target = dependency_target(unit->input_file);
+
+    write_dependency_rule(writer, target, files);
+    free(target);
+}
+
+/**
+ * Writes the Makefile rule of a preprocessed translation unit into its dependency file ('-MD').
+ *
+ * @param unit The translation unit.
+ * @return 1 if successful, 0 otherwise.
+ */
+static int write_dependency_file(const TranslationUnit *unit) {
+    char *file_name = args->dependency_file ? NULL : dependency_file(unit->output_file, unit->input_file);
+    const char *name = file_name ? file_name : args->dependency_file;
+    Writer *writer = writer_open(name);
+    int success = 1;
+
+    if (!writer) {
+        fprintf(stderr, "Could not open or create file %s.\n", name);
+        free(file_name);
+        return 0;
+    }
+
+    verbose_printf("Writing dependencies to %s.\n", name);
+    translation_unit_write_dependencies(unit, &unit->files, writer);
+
+    if (!writer_close(writer)) {
+        fprintf(stderr, "Could not write to file %s.\n", name);
+        success = 0;
+    }
+
+    free(file_name);
+
+    return success;
+}
+
+/**
+ * Preprocesses a translation unit while writing it to its output file.
+ *
+ * @param unit The translation unit to preprocess.
+ * @return 1 if successful, 0 otherwise.
+ */
+static int stream_translation_unit(TranslationUnit *unit) {
+    Writer *writer = writer_open(unit->output_file);
+
+    if (!writer) {
+        fprintf(stderr, "Could not open or create file %s.\n", unit->output_file);
+        unit->is_failed = 1;
+        return 0;
+    }
+
+    verbose_printf("Streaming tokens to %s.\n", unit->output_file);
+    int success = translation_unit_preprocess(unit, writer);
+
+    if (!writer_close(writer)) {
+        fprintf(stderr, "Could not write to file %s.\n", unit->output_file);
+        unit->is_failed = 1;
+    }
+
+    return success;
+}
+
+/**
+ * Writes the input file of a translation unit straight to its output file if it is plain (see plain_scan), without
+ * tokenizing it. Sets IS_FAILED if the output could not be written. Otherwise, the opened input file is left in SOURCE,
+ * so that it can be tokenized without being read again (it might be a pipe).
+ *
+ * @param unit The translation unit.
+ * @return 1 if the translation unit has been written, 0 if it has to be preprocessed.
+ */
+static int write_plain_translation_unit(TranslationUnit *unit) {
+    StatsPhase phase = stats_enter(PHASE_PREPROCESS);
+    uint64_t start = trace_begin();
+    Source *source = source_open(unit->input_file);
+    unsigned int file = file_table_add(unit->input_file);
+
+    if (!source || !plain_scan(source, file, NULL, NULL, NULL)) {
+        unit->source = source;
+        stats_leave(phase);
+        return 0;
+    }
+
+    file_list_append(&unit->files, file);
+    Writer *writer = writer_open(unit->output_file);
+
+    if (!writer) {
+        fprintf(stderr, "Could not open or create file %s.\n", unit->output_file);
+        unit->is_failed = 1;
+    } else {
+        StatsPhase output = stats_enter(PHASE_OUTPUT);
+        Layout layout = {writer};
+
+        verbose_printf("Writing plain file %s to %s.\n", unit->input_file, unit->output_file);
+        plain_scan(source, file, &layout, &unit->line_count, &unit->comment_count);
+        layout_finish(&layout);
+        stats_leave(output);
+
+        if (!writer_close(writer)) {
+            fprintf(stderr, "Could not write to file %s.\n", unit->output_file);
+            unit->is_failed = 1;
+        }
+    }
+
+    source_close(source);
+    trace_end(TRACE_UNIT, start, file, SYMBOL_NONE, 0);
+    stats_leave(phase);
+
+    return 1;
+}
+
+/**
+ * Preprocesses a translation unit and writes it to its output file, streaming it there if the STREAM argument is set.
+ * Its Makefile rule is written too with '-MD'. With '-M', nothing is written, the files it depends on are kept in
+ * DEPENDENCIES instead.
+ *
+ * With a MANIFEST, the output file is left as it is if it is still up to date, and the manifest is saved otherwise.
+ * Plain input files (without directives) are written without being tokenized, unless comments are kept.
+ *
+ * @param argument The translation unit to preprocess.
+ */
+void preprocess_translation_unit(void *argument) {
+    TranslationUnit *unit = argument;
+    int is_streamed = args->stream && !args->dependencies_only;
+    int is_reused = args->manifest && !args->dependencies_only && manifest_load(args->manifest, unit);
+
+    if (is_reused) {
+        verbose_printf("Output %s is up to date.\n", unit->output_file);
+    }
+
+    int is_plain = !is_reused && !args->keep_comments && !args->dependencies_only &&
+                   write_plain_translation_unit(unit);
+
+    if (is_reused || is_plain ||
+        (is_streamed ? stream_translation_unit(unit) : translation_unit_preprocess(unit, NULL))) {
+        if (args->dependencies_only) {
+            unit->dependencies = unit->files;
+            unit->files = (FileList) {0};
+        } else if (!is_streamed && !is_reused && !is_plain) {
+            unit->is_failed = !write_token_list_to_file(unit->output, unit->output_file);
+        }
+
+        if (args->manifest && !is_reused && !unit->is_failed && !args->dependencies_only &&
+            !manifest_save(args->manifest, unit)) {
+            fprintf(stderr, "Could not save the manifest of %s.\n", unit->input_file);
+        }
+
+        if (args->dependencies && !write_dependency_file(unit)) {
+            unit->is_failed = 1;
+        }
+
+        // Print information about the input file (it is tokenized while being preprocessed)
+        if (args->input_count > 1) {
+            normal_printf("%s: %d non-empty lines found, %d comments found.\n",
+                          unit->input_file, unit->line_count, unit->comment_count);
+        } else {
+            normal_printf("%d non-empty lines found.\n", unit->line_count);
+            normal_printf("%d comments found.\n", unit->comment_count);
+        }
+    }
+
+    translation_unit_release(unit);
+}
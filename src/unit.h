@@ -0,0 +1,46 @@
+#ifndef TCPP_UNIT_H
+#define TCPP_UNIT_H
+
+#include "token.h"
+#include "header.h"
+#include "writer.h"
+#include "file.h"
+
+/**
+ * Stores a translation unit to be preprocessed, possibly on a worker thread.
+ *
+ * SOURCE is the input file if it has been opened before the unit is preprocessed (to find out whether it is plain), so
+ * that it is not read twice. It is taken over by TOKENS, the raw token list of the input file. OUTPUT is the
+ * preprocessed one (sharing its arena), both lists being NULL until the unit has been preprocessed successfully. FILES holds the files opened while preprocessing. With '-M', they are
+ * moved into DEPENDENCIES, kept until the rules of all the translation units are written in order. With a manifest,
+ * MISSES holds the paths probed for included headers without finding them (see manifest.c). LINE_COUNT and
+ * COMMENT_COUNT are the counts of the input file.
+ */
+typedef struct TranslationUnit {
+    char *input_file;
+    char *output_file;
+
+    HeaderCache *header_cache;
+
+    Source *source;
+    TokenList *tokens;
+    TokenList *output;
+    FileList files;
+    FileList dependencies;
+    FileList misses;
+
+    int line_count;
+    int comment_count;
+
+    int is_failed;
+} TranslationUnit;
+
+int translation_unit_preprocess(TranslationUnit *unit, Writer *stream);
+
+void translation_unit_release(TranslationUnit *unit);
+
+void translation_unit_write_dependencies(const TranslationUnit *unit, const FileList *files, Writer *writer);
+
+void preprocess_translation_unit(void *argument);
+
+#endif //TCPP_UNIT_H
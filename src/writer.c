@@ -0,0 +1,186 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include "writer.h"
+#include "stats.h"
+
+/**
+ * Writes all the given buffers to a file descriptor, retrying on partial writes.
+ *
+ * @param fd The file descriptor to write to.
+ * @param iov The buffers to write. Modified while writing.
+ * @param count The number of buffers.
+ * @return 1 if successful, 0 otherwise.
+ */
+static int write_all(int fd, struct iovec *iov, int count) {
+    StatsPhase phase = stats_enter(PHASE_OUTPUT);
+
+    while (count > 0) {
+        ssize_t written = writev(fd, iov, count);
+
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            stats_leave(phase);
+            return 0;
+        }
+
+        stats_add(COUNTER_BYTES_WRITTEN, (uint64_t) written);
+
+        // Skip the buffers which were written in full and advance the partially written one
+        while (count > 0 && (size_t) written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            count--;
+        }
+
+        if (count > 0) {
+            iov->iov_base = (char *) iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+
+    stats_leave(phase);
+
+    return 1;
+}
+
+/**
+ * Opens a file for buffered writing.
+ *
+ * @param file_name The location of the file to write to, "-" for stdout.
+ * @return A newly generated writer, NULL if the file could not be opened or created.
+ */
+Writer *writer_open(const char *file_name) {
+    if (strcmp(file_name, "-") == 0) {
+        return writer_open_fd(STDOUT_FILENO);
+    }
+
+    int fd = open(file_name, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+
+    if (fd < 0) {
+        return NULL;
+    }
+
+    Writer *writer = writer_open_fd(fd);
+
+    if (!writer) {
+        close(fd);
+        return NULL;
+    }
+
+    writer->is_borrowed = 0;
+
+    return writer;
+}
+
+/**
+ * Opens an already open file descriptor for buffered writing. The file descriptor stays open when the writer is
+ * closed.
+ *
+ * @param fd The file descriptor to write to.
+ * @return A newly generated writer, NULL if there is not enough memory.
+ */
+Writer *writer_open_fd(int fd) {
+    Writer *writer = malloc(sizeof *writer);
+
+    if (!writer) {
+        return NULL;
+    }
+
+    writer->fd = fd;
+    writer->is_borrowed = 1;
+    writer->has_failed = 0;
+    writer->length = 0;
+
+    return writer;
+}
+
+/**
+ * Flushes a writer and closes its file (stdout is left open).
+ *
+ * @param writer A writer to close.
+ * @return 1 if everything was written successfully, 0 otherwise.
+ */
+int writer_close(Writer *writer) {
+    int success = writer_flush(writer);
+
+    if (!writer->is_borrowed && close(writer->fd) != 0) {
+        success = 0;
+    }
+
+    free(writer);
+
+    return success;
+}
+
+/**
+ * Writes the buffered content of a writer to its file.
+ *
+ * @param writer A writer to flush.
+ * @return 1 if everything written so far was written successfully, 0 otherwise.
+ */
+int writer_flush(Writer *writer) {
+    if (writer->length && !writer->has_failed) {
+        struct iovec iov = {writer->buffer, writer->length};
+        writer->has_failed = !write_all(writer->fd, &iov, 1);
+    }
+
+    writer->length = 0;
+
+    return !writer->has_failed;
+}
+
+/**
+ * Writes data through a writer.
+ *
+ * Data which does not fit into the buffer is written out together with the buffered content in a single call.
+ *
+ * @param writer A writer through which to write.
+ * @param data The data to write.
+ * @param length The length of the data.
+ */
+void writer_write(Writer *writer, const char *data, size_t length) {
+    if (length <= WRITER_BUFFER_SIZE - writer->length) {
+        memcpy(&writer->buffer[writer->length], data, length);
+        writer->length += length;
+        return;
+    }
+
+    if (!writer->has_failed) {
+        struct iovec iov[2] = {{writer->buffer, writer->length},
+                               {(void *) data, length}};
+        writer->has_failed = !write_all(writer->fd, iov, 2);
+    }
+
+    writer->length = 0;
+}
+
+/**
+ * Writes a run of the same character through a writer.
+ *
+ * @param writer A writer through which to write.
+ * @param ch The character to write.
+ * @param count The number of times to write the character.
+ */
+void writer_fill(Writer *writer, char ch, size_t count) {
+    while (count) {
+        if (writer->length == WRITER_BUFFER_SIZE) {
+            writer_flush(writer);
+        }
+
+        size_t length = WRITER_BUFFER_SIZE - writer->length;
+        if (length > count) {
+            length = count;
+        }
+
+        memset(&writer->buffer[writer->length], ch, length);
+        writer->length += length;
+        count -= length;
+    }
+}
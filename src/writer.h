@@ -0,0 +1,36 @@
+#ifndef TCPP_WRITER_H
+#define TCPP_WRITER_H
+
+#include <stddef.h>
+
+/**
+ * The size of a writer's buffer.
+ */
+#define WRITER_BUFFER_SIZE 0x20000
+
+/**
+ * Stores information about a buffered output sink. IS_BORROWED is set if the file descriptor is not closed together
+ * with the writer (stdout, sockets, etc.).
+ */
+typedef struct Writer {
+    int fd;
+    int is_borrowed;
+    int has_failed;
+
+    size_t length;
+    char buffer[WRITER_BUFFER_SIZE];
+} Writer;
+
+Writer *writer_open(const char *file_name);
+
+Writer *writer_open_fd(int fd);
+
+int writer_close(Writer *writer);
+
+int writer_flush(Writer *writer);
+
+void writer_write(Writer *writer, const char *data, size_t length);
+
+void writer_fill(Writer *writer, char ch, size_t count);
+
+#endif //TCPP_WRITER_H
@@ -0,0 +1,31 @@
+#!/bin/sh
+# Runs a regression case: a directory holding a 'main.c' and the output 'expected.i' tcpp has to produce from it.
+# The input is preprocessed with the options listed in the case's 'options' file, if any. Cases which need more than
+# one run provide a 'run.sh' instead, which is given the tcpp executable and writes the output to compare to stdout.
+# Every case runs in a copy of its directory, so that the files it creates are left out of the tree.
+#
+# Usage: regression.sh <tcpp> <case directory>
+
+if [ $# -ne 2 ]; then
+    echo "Usage: $0 <tcpp> <case directory>" >&2
+    exit 2
+fi
+
+tcpp=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+cp -R "$2"/. "$work" || exit 1
+cd "$work" || exit 1
+
+if [ -f run.sh ]; then
+    sh run.sh "$tcpp" > actual.i || exit 1
+else
+    "$tcpp" -q $(cat options 2>/dev/null) -i main.c -o actual.i || exit 1
+fi
+
+if ! cmp -s expected.i actual.i; then
+    echo "$(basename "$2"): output differs from expected.i:" >&2
+    diff expected.i actual.i >&2
+    exit 1
+fi
@@ -0,0 +1,3 @@
+int a = 1 + 1;
+int b = (1-1);
+int c = ( z );
@@ -0,0 +1,11 @@
+#define A 1 /* the body goes on
+ */ + 1
+#define OBJ_LIKE (1-1)
+#define OBJ_LIKE /* white space */ (1-1) /* other */
+#define FUNC_LIKE(a) ( a )
+#define FUNC_LIKE( a )( /* note the white space */ \
+a /* other stuff on this line
+*/ )
+int a = A;
+int b = OBJ_LIKE;
+int c = FUNC_LIKE(z);
@@ -0,0 +1,6 @@
+int not_taken;
+
+
+
+
+int continued;
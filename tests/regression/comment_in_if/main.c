@@ -0,0 +1,11 @@
+#if 1 /* the expression goes on
+ */ && 0
+int taken;
+#else
+int not_taken;
+#endif
+#if 0 /* and on
+   and on */ || 1 /*
+ */ || 0
+int continued;
+#endif
@@ -0,0 +1,6 @@
+int header;
+int header;
+int main_file;
+int header;
+int outer;
+int spaced ;
@@ -0,0 +1,6 @@
+#include "header.h"
+#include "header.h"
+int main_file;
+
+#include "outer.h"
+int   spaced ;
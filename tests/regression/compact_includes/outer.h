@@ -0,0 +1,2 @@
+#include "header.h"
+int outer;
@@ -0,0 +1 @@
+int value = 3;
@@ -0,0 +1,2 @@
+#define VALUE 3
+int value = VALUE;
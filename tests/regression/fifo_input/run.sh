@@ -0,0 +1,7 @@
+# An input which is not plain is read only once, so that it can be a pipe, whose content is gone once it has been read.
+mkfifo main.c || exit 1
+cat input.c > main.c &
+"$1" -q -i main.c -o main.i || exit 1
+wait
+
+cat main.i
@@ -0,0 +1,6 @@
+#ifndef G
+#define G
+int a;
+#else
+int b;
+#endif
@@ -0,0 +1,13 @@
+big_hex_positive
+minus_one_unsigned
+signed_compare
+wraps
+logical_shift
+arithmetic_shift
+conditional_unsigned
+signed_division
+unsigned_division
+max_signed
+wide
+logical
+big_octal
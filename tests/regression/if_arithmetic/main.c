@@ -0,0 +1,44 @@
+#if 0xffffffffffffffff > 0
+big_hex_positive
+#endif
+#if -1 < 0u
+wrong_signed
+#else
+minus_one_unsigned
+#endif
+#if -1 < 0
+signed_compare
+#endif
+#if 18446744073709551615u == -1
+wraps
+#endif
+#if (0u - 1) >> 63 == 1
+logical_shift
+#endif
+#if -16 >> 2 == -4
+arithmetic_shift
+#endif
+#if (1 ? -1 : 0u) > 0
+conditional_unsigned
+#endif
+#if -7 / 2 == -3 && -7 % 2 == -1
+signed_division
+#endif
+#if (-7u / 2) > 0
+unsigned_division
+#endif
+#if 0x7fffffffffffffff + 0 > 0
+max_signed
+#endif
+#if 0 && 1 / 0
+skipped_division
+#endif
+#if L'a' == 97 && 'a' == 97
+wide
+#endif
+#if !0u == 1 && (~0u > 0) && (1 == 1u) < 2
+logical
+#endif
+#if 0100000000000000000000 > 0
+big_octal
+#endif
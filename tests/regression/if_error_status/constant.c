@@ -0,0 +1,2 @@
+#if 99999999999999999999
+#endif
@@ -0,0 +1,3 @@
+constant.c:1: Too large integer constant in #if expression.
+defined.c:1: Operator 'defined' requires an identifier.
+division.c:1: Division by zero in #if expression.
@@ -0,0 +1,6 @@
+# Errors in #if expressions make the run fail, the error messages are compared as the output.
+for input in constant.c defined.c division.c; do
+    "$1" -q -i "$input" -o /dev/null 2>&1 && echo "$input: no failure"
+done
+
+exit 0
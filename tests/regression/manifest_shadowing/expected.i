@@ -0,0 +1,5 @@
+int first;
+
+int sub_quoted;
+
+
@@ -0,0 +1,2 @@
+#include <shadowed.h>
+#include "sub/includer.h"
@@ -0,0 +1,10 @@
+# Headers appearing where they would be found first, earlier on the search path or next to the including file, make
+# the output out of date although none of the files it was preprocessed from has changed.
+mkdir -p first manifests
+"$1" -q --manifest=manifests -I first -I second -i main.c -o main.i || exit 1
+
+echo 'int first;' > first/shadowed.h
+echo 'int sub_quoted;' > sub/quoted.h
+"$1" -q --manifest=manifests -I first -I second -i main.c -o main.i || exit 1
+
+cat main.i
@@ -0,0 +1 @@
+#include "quoted.h"
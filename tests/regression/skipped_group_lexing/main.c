@@ -0,0 +1,19 @@
+#if 0
+char quote = '"'; /* a comment
+#else
+which hides this line */
+char escaped = '\''; const char *s = "'"; /*
+#else
+*/
+const char *t = "/*"; char c = '/';
+#else
+int first;
+#endif
+#if 0
+\
+#endif
+int second;
+#/* comment */if 1
+int third;
+#endi\
+f
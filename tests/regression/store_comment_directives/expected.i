@@ -0,0 +1,5 @@
+int after;
+
+
+int taken;
+int main_file;
@@ -0,0 +1,10 @@
+#if 0
+int skipped;
+#/* comment */elif 0
+int skipped_elif;
+#/* comment */endif
+int after;
+#if 0
+#  /* comment */ else
+int taken;
+#endif
@@ -0,0 +1,9 @@
+# With 'keep_comments', headers loaded from the token store have their comments as tokens and no gaps, so their
+# skipped groups are read token by token. Comments between '#' and the directive's name must not hide the directive.
+mkdir -p store
+"$1" -q -c -i main.c -o unstored.i || exit 1
+"$1" -q -c --token_store=store -i main.c -o saved.i || exit 1
+"$1" -q -c --token_store=store -i main.c -o loaded.i || exit 1
+
+cmp -s unstored.i saved.i && cmp -s unstored.i loaded.i || echo "The outputs differ with the token store."
+cat loaded.i